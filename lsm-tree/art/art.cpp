@@ -0,0 +1 @@
+#include "art.h"
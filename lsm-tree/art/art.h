@@ -0,0 +1,618 @@
+#pragma once
+
+#include "../common/common.h"
+#include "../common/memtable.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Adaptive radix tree: keys are split into bytes, an inner node has a child per next byte and
+// grows from 4 to 16, 48 and 256 children as they are added. Chains of nodes with one child
+// are compressed into the prefix of the next node. A key which ends inside the tree (a prefix
+// of longer keys) is kept by the node it ends at and goes before its children. Bytes are
+// compared unsigned, which is the order of std::string. Lookups take O(key length).
+class ArtTree : public Memtable {
+public:
+    ArtTree() = default;
+
+    GetResult Get(K& key) override {
+        Leaf* leaf = Find(key);
+        if (!leaf) {
+            return { false, V(), false };
+        }
+        if (leaf->Tombstone) {
+            return { true, V(), true };
+        }
+        return { true, *leaf->Value, false };
+    }
+
+    PinnedGetResult GetPinned(K& key) override {
+        PinnedGetResult result;
+        Leaf* leaf = Find(key);
+        if (!leaf) {
+            return result;
+        }
+        result.IsFound = true;
+        result.IsDeleted = leaf->Tombstone;
+        if (!leaf->Tombstone) {
+            result.Value.Pin(leaf->Value, *leaf->Value);
+        }
+        return result;
+    }
+
+    std::vector<KVTombstone> GetQuery(K& start_key, K& end_key) override {
+        std::vector<KVTombstone> result;
+        K path;
+        Collect(Root_.get(), path, &start_key, &end_key, result);
+        return result;
+    }
+
+    void Add(K& key, V& value, bool is_deleting=false) override {
+        if (Insert(Root_, key, 0, std::make_shared<const V>(value), is_deleting)) {
+            ++Size_;
+        }
+    }
+
+    void Delete(K& key) override {
+        V dummy = V();
+        Add(key, dummy, true);
+    }
+
+    std::vector<KVTombstone> List() override {
+        std::vector<KVTombstone> result;
+        result.reserve(Size_);
+        K path;
+        Collect(Root_.get(), path, nullptr, nullptr, result);
+        return result;
+    }
+
+    std::unique_ptr<KVTSource> NewCursor() override {
+        return std::make_unique<Cursor>(Root_.get());
+    }
+
+    std::optional<K> GetMinKey() override {
+        Node* node = Root_.get();
+        while (node && node->Type != ENodeType::Leaf) {
+            auto* inner = static_cast<Inner*>(node);
+            if (inner->Terminal) {
+                return inner->Terminal->Key;
+            }
+            size_t position = 0;
+            node = NextChild(inner, position);
+        }
+        if (!node) {
+            return std::nullopt;
+        }
+        return static_cast<Leaf*>(node)->Key;
+    }
+
+    std::optional<K> GetMaxKey() override {
+        Node* node = Root_.get();
+        while (node && node->Type != ENodeType::Leaf) {
+            auto* inner = static_cast<Inner*>(node);
+            Node* last = nullptr;
+            size_t position = 0;
+            for (Node* child = NextChild(inner, position); child; child = NextChild(inner, position)) {
+                last = child;
+            }
+            if (!last) {
+                return inner->Terminal ? std::optional<K>(inner->Terminal->Key) : std::nullopt;
+            }
+            node = last;
+        }
+        if (!node) {
+            return std::nullopt;
+        }
+        return static_cast<Leaf*>(node)->Key;
+    }
+
+    void Erase() override {
+        Root_.reset();
+        Size_ = 0;
+    }
+
+    size_t GetSize() override {
+        return Size_;
+    }
+
+private:
+    enum class ENodeType : uint8_t {
+        Leaf,
+        Node4,
+        Node16,
+        Node48,
+        Node256,
+    };
+
+    struct Node {
+        Node(ENodeType type)
+            : Type(type)
+        {}
+
+        virtual ~Node() = default;
+
+        ENodeType Type;
+    };
+
+    struct Leaf : Node {
+        Leaf(const K& key, std::shared_ptr<const V> value, bool tombstone)
+            : Node(ENodeType::Leaf)
+            , Key(key)
+            , Value(std::move(value))
+            , Tombstone(tombstone)
+        {}
+
+        K Key;
+        // Shared with pinned values returned by GetPinned.
+        std::shared_ptr<const V> Value;
+        bool Tombstone;
+    };
+
+    struct Inner : Node {
+        using Node::Node;
+
+        // Bytes all keys below the node share after the byte which led to it.
+        std::string Prefix;
+        // Entry of the key which ends at this node.
+        std::unique_ptr<Leaf> Terminal;
+        uint16_t Count = 0;
+    };
+
+    // Node4 and Node16: the bytes of the children sorted, children at the same positions.
+    template <size_t CAPACITY, ENodeType TYPE>
+    struct SortedNode : Inner {
+        SortedNode()
+            : Inner(TYPE)
+        {}
+
+        std::array<uint8_t, CAPACITY> Bytes{};
+        std::array<std::unique_ptr<Node>, CAPACITY> Children;
+    };
+
+    using Node4 = SortedNode<4, ENodeType::Node4>;
+    using Node16 = SortedNode<16, ENodeType::Node16>;
+
+    struct Node48 : Inner {
+        Node48()
+            : Inner(ENodeType::Node48)
+        {
+            Index.fill(EMPTY);
+        }
+
+        static constexpr uint8_t EMPTY = 0xff;
+
+        // Position in Children of the child of every byte.
+        std::array<uint8_t, 256> Index;
+        std::array<std::unique_ptr<Node>, 48> Children;
+    };
+
+    struct Node256 : Inner {
+        Node256()
+            : Inner(ENodeType::Node256)
+        {}
+
+        std::array<std::unique_ptr<Node>, 256> Children;
+    };
+
+    Leaf* Find(const K& key) {
+        Node* node = Root_.get();
+        size_t depth = 0;
+        while (node) {
+            if (node->Type == ENodeType::Leaf) {
+                auto* leaf = static_cast<Leaf*>(node);
+                return leaf->Key == key ? leaf : nullptr;
+            }
+            auto* inner = static_cast<Inner*>(node);
+            if (key.compare(depth, inner->Prefix.size(), inner->Prefix) != 0) {
+                return nullptr;
+            }
+            depth += inner->Prefix.size();
+            if (depth == key.size()) {
+                return inner->Terminal.get();
+            }
+            auto* child = FindChild(inner, key[depth]);
+            node = child ? child->get() : nullptr;
+            ++depth;
+        }
+        return nullptr;
+    }
+
+    // Returns true if the key is new.
+    bool Insert(std::unique_ptr<Node>& ref, const K& key, size_t depth, std::shared_ptr<const V> value, bool tombstone) {
+        if (!ref) {
+            ref = std::make_unique<Leaf>(key, std::move(value), tombstone);
+            return true;
+        }
+        if (ref->Type == ENodeType::Leaf) {
+            auto* leaf = static_cast<Leaf*>(ref.get());
+            if (leaf->Key == key) {
+                leaf->Value = std::move(value);
+                leaf->Tombstone = tombstone;
+                return false;
+            }
+            // The leaf becomes a node of the common part of both keys.
+            size_t common = depth;
+            while (common < key.size() && common < leaf->Key.size() && key[common] == leaf->Key[common]) {
+                ++common;
+            }
+            std::unique_ptr<Node> inner = std::make_unique<Node4>();
+            static_cast<Inner*>(inner.get())->Prefix = key.substr(depth, common - depth);
+            std::unique_ptr<Leaf> old_leaf(static_cast<Leaf*>(ref.release()));
+            PlaceLeaf(inner, std::move(old_leaf), common);
+            PlaceLeaf(inner, std::make_unique<Leaf>(key, std::move(value), tombstone), common);
+            ref = std::move(inner);
+            return true;
+        }
+
+        auto* inner = static_cast<Inner*>(ref.get());
+        size_t matched = 0;
+        while (matched < inner->Prefix.size() && depth + matched < key.size() && key[depth + matched] == inner->Prefix[matched]) {
+            ++matched;
+        }
+        if (matched < inner->Prefix.size()) {
+            // The key leaves the prefix, the node is put under a new node of the matched part.
+            std::unique_ptr<Node> parent = std::make_unique<Node4>();
+            static_cast<Inner*>(parent.get())->Prefix = inner->Prefix.substr(0, matched);
+            uint8_t byte = inner->Prefix[matched];
+            inner->Prefix.erase(0, matched + 1);
+            AddChild(parent, byte, std::move(ref));
+            PlaceLeaf(parent, std::make_unique<Leaf>(key, std::move(value), tombstone), depth + matched);
+            ref = std::move(parent);
+            return true;
+        }
+        depth += inner->Prefix.size();
+        if (depth == key.size()) {
+            if (inner->Terminal) {
+                inner->Terminal->Value = std::move(value);
+                inner->Terminal->Tombstone = tombstone;
+                return false;
+            }
+            inner->Terminal = std::make_unique<Leaf>(key, std::move(value), tombstone);
+            return true;
+        }
+        if (auto* child = FindChild(inner, key[depth])) {
+            return Insert(*child, key, depth + 1, std::move(value), tombstone);
+        }
+        AddChild(ref, key[depth], std::make_unique<Leaf>(key, std::move(value), tombstone));
+        return true;
+    }
+
+    // Puts the leaf under the node, depth is the length of the key part the node covers.
+    static void PlaceLeaf(std::unique_ptr<Node>& ref, std::unique_ptr<Leaf> leaf, size_t depth) {
+        if (leaf->Key.size() == depth) {
+            static_cast<Inner*>(ref.get())->Terminal = std::move(leaf);
+            return;
+        }
+        uint8_t byte = leaf->Key[depth];
+        AddChild(ref, byte, std::move(leaf));
+    }
+
+    static std::unique_ptr<Node>* FindChild(Inner* inner, char key_byte) {
+        uint8_t byte = static_cast<uint8_t>(key_byte);
+        switch (inner->Type) {
+            case ENodeType::Node4:
+                return FindSorted(static_cast<Node4*>(inner), byte);
+            case ENodeType::Node16:
+                return FindSorted(static_cast<Node16*>(inner), byte);
+            case ENodeType::Node48: {
+                auto* node = static_cast<Node48*>(inner);
+                uint8_t position = node->Index[byte];
+                return position == Node48::EMPTY ? nullptr : &node->Children[position];
+            }
+            case ENodeType::Node256: {
+                auto& child = static_cast<Node256*>(inner)->Children[byte];
+                return child ? &child : nullptr;
+            }
+            default:
+                return nullptr;
+        }
+    }
+
+    template <typename TNode>
+    static std::unique_ptr<Node>* FindSorted(TNode* node, uint8_t byte) {
+        for (size_t i = 0; i < node->Count; ++i) {
+            if (node->Bytes[i] == byte) {
+                return &node->Children[i];
+            }
+        }
+        return nullptr;
+    }
+
+    // The node must not have a child of the byte. A full node is replaced by a larger one.
+    static void AddChild(std::unique_ptr<Node>& ref, uint8_t byte, std::unique_ptr<Node> child) {
+        auto* inner = static_cast<Inner*>(ref.get());
+        switch (inner->Type) {
+            case ENodeType::Node4:
+                if (inner->Count == 4) {
+                    ref = Grow<Node4, Node16>(ref);
+                    AddChild(ref, byte, std::move(child));
+                    return;
+                }
+                AddSorted(static_cast<Node4*>(inner), byte, std::move(child));
+                return;
+            case ENodeType::Node16:
+                if (inner->Count == 16) {
+                    ref = GrowTo48(ref);
+                    AddChild(ref, byte, std::move(child));
+                    return;
+                }
+                AddSorted(static_cast<Node16*>(inner), byte, std::move(child));
+                return;
+            case ENodeType::Node48: {
+                auto* node = static_cast<Node48*>(inner);
+                if (node->Count == 48) {
+                    ref = GrowTo256(ref);
+                    AddChild(ref, byte, std::move(child));
+                    return;
+                }
+                node->Index[byte] = node->Count;
+                node->Children[node->Count++] = std::move(child);
+                return;
+            }
+            case ENodeType::Node256:
+                static_cast<Node256*>(inner)->Children[byte] = std::move(child);
+                ++inner->Count;
+                return;
+            default:
+                return;
+        }
+    }
+
+    template <typename TNode>
+    static void AddSorted(TNode* node, uint8_t byte, std::unique_ptr<Node> child) {
+        size_t position = std::lower_bound(node->Bytes.begin(), node->Bytes.begin() + node->Count, byte) - node->Bytes.begin();
+        for (size_t i = node->Count; i > position; --i) {
+            node->Bytes[i] = node->Bytes[i - 1];
+            node->Children[i] = std::move(node->Children[i - 1]);
+        }
+        node->Bytes[position] = byte;
+        node->Children[position] = std::move(child);
+        ++node->Count;
+    }
+
+    static void MoveHeader(Inner* from, Inner* to) {
+        to->Prefix = std::move(from->Prefix);
+        to->Terminal = std::move(from->Terminal);
+        to->Count = from->Count;
+    }
+
+    template <typename TFrom, typename TTo>
+    static std::unique_ptr<Node> Grow(std::unique_ptr<Node>& ref) {
+        auto* from = static_cast<TFrom*>(ref.get());
+        auto to = std::make_unique<TTo>();
+        MoveHeader(from, to.get());
+        for (size_t i = 0; i < from->Count; ++i) {
+            to->Bytes[i] = from->Bytes[i];
+            to->Children[i] = std::move(from->Children[i]);
+        }
+        return to;
+    }
+
+    static std::unique_ptr<Node> GrowTo48(std::unique_ptr<Node>& ref) {
+        auto* from = static_cast<Node16*>(ref.get());
+        auto to = std::make_unique<Node48>();
+        MoveHeader(from, to.get());
+        for (size_t i = 0; i < from->Count; ++i) {
+            to->Index[from->Bytes[i]] = i;
+            to->Children[i] = std::move(from->Children[i]);
+        }
+        return to;
+    }
+
+    static std::unique_ptr<Node> GrowTo256(std::unique_ptr<Node>& ref) {
+        auto* from = static_cast<Node48*>(ref.get());
+        auto to = std::make_unique<Node256>();
+        MoveHeader(from, to.get());
+        for (size_t byte = 0; byte < 256; ++byte) {
+            if (from->Index[byte] != Node48::EMPTY) {
+                to->Children[byte] = std::move(from->Children[from->Index[byte]]);
+            }
+        }
+        return to;
+    }
+
+    // Appends the entries below the node in order, with bounds only the keys from [start_key, end_key].
+    // path is the part of the keys the node covers. A subtree is skipped when its path shows
+    // all its keys are out of the bounds.
+    static void Collect(Node* node, K& path, const K* start_key, const K* end_key, std::vector<KVTombstone>& result) {
+        if (!node) {
+            return;
+        }
+        if (node->Type == ENodeType::Leaf) {
+            AddLeaf(static_cast<Leaf*>(node), start_key, end_key, result);
+            return;
+        }
+        auto* inner = static_cast<Inner*>(node);
+        size_t path_size = path.size();
+        path += inner->Prefix;
+        if (!IsOutOfBounds(path, start_key, end_key)) {
+            if (inner->Terminal) {
+                AddLeaf(inner->Terminal.get(), start_key, end_key, result);
+            }
+            ForEachChild(inner, [&](uint8_t byte, Node* child) {
+                path.push_back(static_cast<char>(byte));
+                bool is_past_end = end_key && path > *end_key;
+                if (!is_past_end) {
+                    Collect(child, path, start_key, end_key, result);
+                }
+                path.pop_back();
+                return !is_past_end;
+            });
+        }
+        path.resize(path_size);
+    }
+
+    // All keys starting with path are less than start_key or greater than end_key.
+    static bool IsOutOfBounds(const K& path, const K* start_key, const K* end_key) {
+        if (end_key && path > *end_key) {
+            return true;
+        }
+        return start_key && path < *start_key && start_key->compare(0, path.size(), path) != 0;
+    }
+
+    static void AddLeaf(Leaf* leaf, const K* start_key, const K* end_key, std::vector<KVTombstone>& result) {
+        if ((start_key && leaf->Key < *start_key) || (end_key && leaf->Key > *end_key)) {
+            return;
+        }
+        result.emplace_back(leaf->Key, *leaf->Value, leaf->Tombstone);
+    }
+
+    // Child at or after position in the order of the children, position is moved past it.
+    // nullptr if there are no more children.
+    static Node* NextChild(Inner* inner, size_t& position) {
+        switch (inner->Type) {
+            case ENodeType::Node4: {
+                auto* node = static_cast<Node4*>(inner);
+                return position < node->Count ? node->Children[position++].get() : nullptr;
+            }
+            case ENodeType::Node16: {
+                auto* node = static_cast<Node16*>(inner);
+                return position < node->Count ? node->Children[position++].get() : nullptr;
+            }
+            case ENodeType::Node48: {
+                auto* node = static_cast<Node48*>(inner);
+                while (position < 256) {
+                    uint8_t index = node->Index[position++];
+                    if (index != Node48::EMPTY) {
+                        return node->Children[index].get();
+                    }
+                }
+                return nullptr;
+            }
+            case ENodeType::Node256: {
+                auto* node = static_cast<Node256*>(inner);
+                while (position < 256) {
+                    Node* child = node->Children[position++].get();
+                    if (child) {
+                        return child;
+                    }
+                }
+                return nullptr;
+            }
+            default:
+                return nullptr;
+        }
+    }
+
+    // Calls visit(byte, child) for the children in the order of their bytes while it returns true.
+    template <typename TVisit>
+    static void ForEachChild(Inner* inner, TVisit&& visit) {
+        switch (inner->Type) {
+            case ENodeType::Node4: {
+                auto* node = static_cast<Node4*>(inner);
+                for (size_t i = 0; i < node->Count && visit(node->Bytes[i], node->Children[i].get()); ++i) {
+                }
+                return;
+            }
+            case ENodeType::Node16: {
+                auto* node = static_cast<Node16*>(inner);
+                for (size_t i = 0; i < node->Count && visit(node->Bytes[i], node->Children[i].get()); ++i) {
+                }
+                return;
+            }
+            case ENodeType::Node48: {
+                auto* node = static_cast<Node48*>(inner);
+                for (size_t byte = 0; byte < 256; ++byte) {
+                    if (node->Index[byte] != Node48::EMPTY && !visit(byte, node->Children[node->Index[byte]].get())) {
+                        return;
+                    }
+                }
+                return;
+            }
+            case ENodeType::Node256: {
+                auto* node = static_cast<Node256*>(inner);
+                for (size_t byte = 0; byte < 256; ++byte) {
+                    if (node->Children[byte] && !visit(byte, node->Children[byte].get())) {
+                        return;
+                    }
+                }
+                return;
+            }
+            default:
+                return;
+        }
+    }
+
+    // In-order walk with a stack of the inner nodes on the path to the current leaf. The terminal
+    // entry of a node goes before its children.
+    class Cursor : public KVTSource {
+    public:
+        Cursor(Node* root) {
+            if (root && root->Type == ENodeType::Leaf) {
+                Load(static_cast<Leaf*>(root));
+            } else {
+                if (root) {
+                    Stack_.push_back({ static_cast<Inner*>(root), false, 0 });
+                }
+                Load(FindNextLeaf());
+            }
+        }
+
+        bool IsValid() override {
+            return IsValid_;
+        }
+
+        KVTombstone& Current() override {
+            return Current_;
+        }
+
+        void Next() override {
+            Load(FindNextLeaf());
+        }
+
+    private:
+        struct Frame {
+            Inner* InnerNode;
+            bool IsTerminalVisited;
+            // Position of the next child for NextChild.
+            size_t Position;
+        };
+
+        Leaf* FindNextLeaf() {
+            while (!Stack_.empty()) {
+                auto& frame = Stack_.back();
+                if (!frame.IsTerminalVisited) {
+                    frame.IsTerminalVisited = true;
+                    if (frame.InnerNode->Terminal) {
+                        return frame.InnerNode->Terminal.get();
+                    }
+                }
+                Node* child = NextChild(frame.InnerNode, frame.Position);
+                if (!child) {
+                    Stack_.pop_back();
+                } else if (child->Type == ENodeType::Leaf) {
+                    return static_cast<Leaf*>(child);
+                } else {
+                    Stack_.push_back({ static_cast<Inner*>(child), false, 0 });
+                }
+            }
+            return nullptr;
+        }
+
+        // Copies the entry into the buffer, which keeps the capacity of its strings from the
+        // previous entries.
+        void Load(Leaf* leaf) {
+            IsValid_ = (leaf != nullptr);
+            if (!leaf) {
+                return;
+            }
+            Current_.Key.assign(leaf->Key);
+            Current_.Value.assign(*leaf->Value);
+            Current_.Tombstone = leaf->Tombstone;
+            Current_.IsValuePointer = false;
+        }
+
+        std::vector<Frame> Stack_;
+        KVTombstone Current_;
+        bool IsValid_ = false;
+    };
+
+    std::unique_ptr<Node> Root_;
+    size_t Size_ = 0;
+};
@@ -0,0 +1,94 @@
+#include "art.h"
+#include "../b-tree/b_tree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <malloc.h>
+#include <random>
+#include <set>
+
+std::string GenString(size_t len, std::mt19937& g) {
+    std::string result;
+    for (size_t i = 0; i < len; ++i) {
+        result += 'a' + g() % 26;
+    }
+    return result;
+}
+
+double GetSecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Fills every memtable with the same entries and compares the time of adding them, of point
+// lookups in random order, of listing them and of walking them with a cursor as a flush does,
+// and the memory the memtable takes.
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cout << "usage: memtable_bench <entries>" << std::endl;
+        return 1;
+    }
+    size_t size = atoi(argv[1]);
+
+    std::mt19937 g(42);
+    std::set<std::string> keys;
+    while (keys.size() < size) {
+        keys.insert(GenString(10, g));
+    }
+    std::vector<std::pair<std::string, std::string>> key_values;
+    for (auto& key : keys) {
+        key_values.emplace_back(key, GenString(10, g));
+    }
+    std::shuffle(key_values.begin(), key_values.end(), g);
+    std::vector<std::string> lookups;
+    for (auto& kv : key_values) {
+        lookups.push_back(kv.first);
+    }
+    std::shuffle(lookups.begin(), lookups.end(), g);
+
+    std::vector<std::pair<std::string, std::unique_ptr<Memtable>>> memtables;
+    for (size_t min_degree : { 2, 4, 16, 64 }) {
+        memtables.emplace_back("BTREE " + std::to_string(min_degree), nullptr);
+    }
+    memtables.emplace_back("ART", nullptr);
+    for (size_t i = 0; i < memtables.size(); ++i) {
+        auto& [name, memtable] = memtables[i];
+        size_t memory_start = mallinfo2().uordblks;
+        auto start = std::chrono::steady_clock::now();
+        if (i + 1 < memtables.size()) {
+            memtable = std::make_unique<BTree>(std::stoul(name.substr(6)));
+        } else {
+            memtable = std::make_unique<ArtTree>();
+        }
+        for (auto& kv : key_values) {
+            memtable->Add(kv.first, kv.second);
+        }
+        double add_seconds = GetSecondsSince(start);
+        size_t memory = mallinfo2().uordblks - memory_start;
+
+        start = std::chrono::steady_clock::now();
+        size_t found = 0;
+        for (auto& key : lookups) {
+            found += memtable->GetPinned(key).IsFound;
+        }
+        double get_seconds = GetSecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        size_t listed = memtable->List().size();
+        double list_seconds = GetSecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        size_t walked = 0;
+        for (auto cursor = memtable->NewCursor(); cursor->IsValid(); cursor->Next()) {
+            ++walked;
+        }
+        double cursor_seconds = GetSecondsSince(start);
+
+        std::cout << name << ": ADD " << add_seconds << " sec, GET " << get_seconds << " sec, LIST "
+            << list_seconds << " sec, CURSOR " << cursor_seconds << " sec, " << (double) memory / size
+            << " bytes per entry, " << found << " found, " << listed << " listed, " << walked << " walked" << std::endl;
+        memtable.reset();
+    }
+    return 0;
+}
@@ -0,0 +1,197 @@
+#include "../art.h"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <map>
+#include <random>
+#include <set>
+
+std::string GenString(size_t len) {
+    std::random_device rd;
+    std::mt19937 g(rd());
+    std::string result;
+    for (size_t i = 0; i < len; ++i) {
+        result += 'a' + g() % 27;
+    }
+    return result;
+}
+
+std::vector<std::pair<std::string, std::string>> GenKeyValues(size_t n) {
+    size_t len = 10;
+    std::set<std::string> keys;
+    std::vector<std::pair<std::string, std::string>> result;
+    while (keys.size() < n) {
+        std::string new_key = GenString(len);
+        if (keys.find(new_key) == keys.end()) {
+            keys.insert(new_key);
+            result.emplace_back(new_key, GenString(len));
+        }
+    }
+    return result;
+}
+
+TEST(ArtTreeTest, TestAdd1000)
+{
+    ArtTree tree;
+    auto key_values = GenKeyValues(1000);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    ASSERT_EQ(tree.GetSize(), 1000);
+    std::shuffle(key_values.begin(), key_values.end(), std::mt19937(42));
+    for (auto& kv : key_values) {
+        ASSERT_EQ(tree.Get(kv.first).IsFound, true);
+        ASSERT_EQ(tree.Get(kv.first).Value, kv.second);
+        std::string missing = kv.first.substr(0, 5);
+        ASSERT_EQ(tree.Get(missing).IsFound, false);
+    }
+}
+
+TEST(ArtTreeTest, TestDelete)
+{
+    ArtTree tree;
+    auto key_values = GenKeyValues(10);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    for (auto& kv : key_values) {
+        tree.Delete(kv.first);
+        ASSERT_EQ(tree.Get(kv.first).IsDeleted, true);
+        ASSERT_EQ(tree.GetPinned(kv.first).IsDeleted, true);
+        tree.Add(kv.first, kv.second);
+        ASSERT_EQ(tree.Get(kv.first).IsDeleted, false);
+        ASSERT_EQ(tree.Get(kv.first).Value, kv.second);
+    }
+    ASSERT_EQ(tree.GetSize(), 10);
+}
+
+TEST(ArtTreeTest, TestPinnedValue)
+{
+    ArtTree tree;
+    std::string key = "key";
+    std::string value = "value";
+    tree.Add(key, value);
+    auto pinned = tree.GetPinned(key);
+    std::string new_value = "new value";
+    tree.Add(key, new_value);
+    tree.Erase();
+    ASSERT_EQ(pinned.Value.View(), "value");
+    ASSERT_EQ(tree.GetSize(), 0);
+    ASSERT_EQ(tree.Get(key).IsFound, false);
+}
+
+TEST(ArtTreeTest, TestSameAsMap)
+{
+    // Short keys over few bytes share prefixes and are prefixes of each other, all 256 bytes
+    // in the second position make nodes of every size.
+    std::mt19937 gen(42);
+    std::map<std::string, std::pair<std::string, bool>> expected;
+    ArtTree tree;
+    for (size_t i = 0; i < 20000; ++i) {
+        std::string key;
+        size_t len = gen() % 6;
+        for (size_t j = 0; j < len; ++j) {
+            key.push_back(static_cast<char>(j == 1 ? gen() % 256 : 'a' + gen() % 3));
+        }
+        std::string value = std::to_string(i);
+        bool is_deleting = gen() % 5 == 0;
+        if (is_deleting) {
+            tree.Delete(key);
+            expected[key] = { "", true };
+        } else {
+            tree.Add(key, value);
+            expected[key] = { value, false };
+        }
+    }
+    ASSERT_EQ(tree.GetSize(), expected.size());
+
+    auto list = tree.List();
+    ASSERT_EQ(list.size(), expected.size());
+    auto it = expected.begin();
+    for (auto& kvt : list) {
+        ASSERT_EQ(kvt.Key, it->first);
+        ASSERT_EQ(kvt.Tombstone, it->second.second);
+        if (!kvt.Tombstone) {
+            ASSERT_EQ(kvt.Value, it->second.first);
+            ASSERT_EQ(tree.GetPinned(kvt.Key).Value.View(), it->second.first);
+        }
+        ++it;
+    }
+
+    for (size_t i = 0; i < 1000; ++i) {
+        std::string start_key = list[gen() % list.size()].Key;
+        std::string end_key = list[gen() % list.size()].Key + (i % 2 ? "b" : "");
+        if (end_key < start_key) {
+            std::swap(start_key, end_key);
+        }
+        auto result = tree.GetQuery(start_key, end_key);
+        auto first = expected.lower_bound(start_key);
+        auto last = expected.upper_bound(end_key);
+        ASSERT_EQ(result.size(), std::distance(first, last));
+        for (auto& kvt : result) {
+            ASSERT_EQ(kvt.Key, first->first);
+            ++first;
+        }
+    }
+}
+
+TEST(ArtTreeTest, TestGetQuery)
+{
+    ArtTree tree;
+    auto key_values = GenKeyValues(100);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    std::sort(key_values.begin(), key_values.end());
+    auto result = tree.GetQuery(key_values[30].first, key_values[80].first);
+    ASSERT_EQ(result.size(), 51);
+    for (size_t i = 30; i <= 80; ++i) {
+        ASSERT_EQ(result[i - 30].Value, key_values[i].second);
+    }
+    std::string before = "";
+    std::string after = "~";
+    ASSERT_EQ(tree.GetQuery(before, after).size(), 100);
+    ASSERT_EQ(tree.GetQuery(after, after).size(), 0);
+}
+
+TEST(ArtTreeTest, TestCursor)
+{
+    ArtTree tree;
+    ASSERT_FALSE(tree.NewCursor()->IsValid());
+    ASSERT_FALSE(tree.GetMinKey());
+    ASSERT_FALSE(tree.GetMaxKey());
+
+    // Short keys over all bytes fill nodes of every size and end inside the tree.
+    std::mt19937 gen(7);
+    std::map<std::string, std::pair<std::string, bool>> expected;
+    for (size_t i = 0; i < 20000; ++i) {
+        std::string key(1 + gen() % 3, '\0');
+        for (auto& c : key) {
+            c = static_cast<char>(gen() % (i % 2 ? 256 : 8));
+        }
+        std::string value = std::to_string(i);
+        bool is_deleting = gen() % 5 == 0;
+        tree.Add(key, value, is_deleting);
+        expected[key] = { is_deleting ? "" : value, is_deleting };
+    }
+
+    auto it = expected.begin();
+    for (auto cursor = tree.NewCursor(); cursor->IsValid(); cursor->Next()) {
+        ASSERT_NE(it, expected.end());
+        ASSERT_EQ(cursor->Current().Key, it->first);
+        ASSERT_EQ(cursor->Current().Tombstone, it->second.second);
+        if (!it->second.second) {
+            ASSERT_EQ(cursor->Current().Value, it->second.first);
+        }
+        ++it;
+    }
+    ASSERT_EQ(it, expected.end());
+    ASSERT_EQ(*tree.GetMinKey(), expected.begin()->first);
+    ASSERT_EQ(*tree.GetMaxKey(), expected.rbegin()->first);
+}
+
+int main(int argc, char** argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -1,13 +1,17 @@
+#pragma once
+
 #include "../common/common.h"
+#include "../common/memtable.h"
 
 #include <memory>
+#include <optional>
 #include <vector>
 #include <string>
 #include <vector>
 #include <iostream>
 
 
-class BTree {
+class BTree : public Memtable {
 public:
     BTree(size_t min_degree)
         : MinDegree_(min_degree) {
@@ -15,7 +19,7 @@ public:
         Root_->SetIsLeaf(true);
     }
 
-    GetResult Get(K& key) {
+    GetResult Get(K& key) override {
         GetResult result = { false, V(), false };
         if (!Root_) {
             return result;
@@ -27,14 +31,25 @@ public:
         return { tmpResult.IsFound, V(), tmpResult.IsDeleted };
     }
 
-    std::vector<KVTombstone> GetQuery(K& start_key, K& end_key) {
+    PinnedGetResult GetPinned(K& key) override {
+        PinnedGetResult result;
+        auto tmpResult = Root_->Get(key);
+        result.IsFound = tmpResult.IsFound;
+        result.IsDeleted = tmpResult.IsDeleted;
+        if (tmpResult.IsFound && !tmpResult.IsDeleted) {
+            result.Value.Pin(tmpResult.Value, *tmpResult.Value);
+        }
+        return result;
+    }
+
+    std::vector<KVTombstone> GetQuery(K& start_key, K& end_key) override {
         std::vector<KVTombstone> result;
         Root_->GetQuery(start_key, end_key, result);
         return result;
     }
 
-    void Add(K& key, V& value) {
-        if (Root_->Add(key, value)) {
+    void Add(K& key, V& value, bool is_deleting=false) override {
+        if (Root_->Add(key, value, is_deleting)) {
             ++Size_;
         }
 
@@ -53,31 +68,57 @@ public:
         }
     }
 
-    void Delete(K& key) {
+    void Delete(K& key) override {
         V dummy = V();
-        Root_->Add(key, dummy, true);
+        Add(key, dummy, true);
     }
 
-    std::vector<KVTombstone> List() {
+    std::vector<KVTombstone> List() override {
         std::vector<KVTombstone> result;
         Root_->List(result);
         return result;
     }
 
-    void Erase() {
+    std::unique_ptr<KVTSource> NewCursor() override {
+        return std::make_unique<Cursor>(Root_.get());
+    }
+
+    std::optional<K> GetMinKey() override {
+        BTreeNode* node = Root_.get();
+        if (node->Keys_.empty()) {
+            return std::nullopt;
+        }
+        while (!node->IsLeaf_) {
+            node = node->Childs_.front().get();
+        }
+        return node->Keys_.front().Key;
+    }
+
+    std::optional<K> GetMaxKey() override {
+        BTreeNode* node = Root_.get();
+        if (node->Keys_.empty()) {
+            return std::nullopt;
+        }
+        while (!node->IsLeaf_) {
+            node = node->Childs_.back().get();
+        }
+        return node->Keys_.back().Key;
+    }
+
+    void Erase() override {
         Root_ = std::make_shared<BTreeNode>(MinDegree_);
         Root_->SetIsLeaf(true);
         Size_ = 0;
     }
 
-    size_t GetSize() {
+    size_t GetSize() override {
         return Size_;
     }
 
 private:
     struct TmpGetResult {
         bool IsFound = false;
-        V* Value;
+        std::shared_ptr<const V> Value;
         bool IsDeleted = false;
     };
 
@@ -92,7 +133,7 @@ private:
             TmpGetResult badResult = { false, nullptr, false };
             for (size_t i = 0; i < Keys_.size(); ++i) {
                 if (Keys_[i].Key == key) {
-                    return { true, &Values_[i], Keys_[i].Tombstone };
+                    return { true, Values_[i], Keys_[i].Tombstone };
                 }
                 if (Keys_[i].Key > key) {
                     return IsLeaf_ ? badResult : Childs_[i]->Get(key);
@@ -111,7 +152,7 @@ private:
                 if (Keys_[i].Key >= start_key && Keys_[i].Key <= end_key) {
                     result.push_back(KVTombstone());
                     result.back().Key = Keys_[i].Key;
-                    result.back().Value = Values_[i];
+                    result.back().Value = *Values_[i];
                     result.back().Tombstone = Keys_[i].Tombstone;
                 }
             }
@@ -126,7 +167,7 @@ private:
             for (size_t i = 0; i < Keys_.size(); ++i) {
                 if (Keys_[i].Key == key) {
                     Keys_[i].Tombstone = is_deleting;
-                    Values_[i] = value;
+                    Values_[i] = std::make_shared<const V>(value);
                     return false;
                 }
                 if (Keys_[i].Key > key) {
@@ -135,7 +176,7 @@ private:
                             key,
                             is_deleting
                         });
-                        Values_.insert(Values_.begin() + i, value);
+                        Values_.insert(Values_.begin() + i, std::make_shared<const V>(value));
                         return true;
                     }
                     return AddToChild(i, key, value, is_deleting);
@@ -143,7 +184,7 @@ private:
             }
             if (IsLeaf_) {
                 Keys_.push_back({ key, is_deleting });
-                Values_.push_back(value);
+                Values_.push_back(std::make_shared<const V>(value));
                 return true;
             }
             return AddToChild(Keys_.size(), key, value, is_deleting);
@@ -154,7 +195,7 @@ private:
                 if (!IsLeaf_) {
                     Childs_[i]->List(result);
                 }
-                result.emplace_back(Keys_[i].Key, Values_[i], Keys_[i].Tombstone);
+                result.emplace_back(Keys_[i].Key, *Values_[i], Keys_[i].Tombstone);
             }
             if (!IsLeaf_) {
                 Childs_.back()->List(result);
@@ -179,11 +220,11 @@ private:
             IsLeaf_ = value;
         }
 
-        std::pair<KeyWithTombstone&, V&> GetMedian() {
+        std::pair<KeyWithTombstone&, std::shared_ptr<const V>&> GetMedian() {
             return { Keys_[MinDegree_ - 1], Values_[MinDegree_ - 1] };
         }
 
-        void AppendKeyAndValue(KeyWithTombstone& key, V& value) {
+        void AppendKeyAndValue(KeyWithTombstone& key, std::shared_ptr<const V>& value) {
             Keys_.push_back(key);
             Values_.push_back(value);
         }
@@ -226,11 +267,74 @@ private:
         size_t MinDegree_;
         bool IsLeaf_ = false;
         std::vector<KeyWithTombstone> Keys_;
-        std::vector<V> Values_;
+        // Shared with pinned values returned by GetPinned.
+        std::vector<std::shared_ptr<const V>> Values_;
         std::vector<std::shared_ptr<BTreeNode>> Childs_;
         std::shared_ptr<BTreeNode> Parent_;
     };
 
+    // In-order walk with a stack of the nodes on the path to the current key. The key of a frame
+    // is the next one of its node, the child before it is visited first.
+    class Cursor : public KVTSource {
+    public:
+        Cursor(BTreeNode* root) {
+            PushLeftmost(root);
+            Load();
+        }
+
+        bool IsValid() override {
+            return !Stack_.empty();
+        }
+
+        KVTombstone& Current() override {
+            return Current_;
+        }
+
+        void Next() override {
+            auto& top = Stack_.back();
+            ++top.Index;
+            if (!top.Node->IsLeaf_) {
+                PushLeftmost(top.Node->Childs_[top.Index].get());
+            }
+            Load();
+        }
+
+    private:
+        struct Frame {
+            BTreeNode* Node;
+            size_t Index;
+        };
+
+        void PushLeftmost(BTreeNode* node) {
+            while (true) {
+                Stack_.push_back({ node, 0 });
+                if (node->IsLeaf_) {
+                    return;
+                }
+                node = node->Childs_.front().get();
+            }
+        }
+
+        // Pops the nodes with no keys left and copies the entry of the top frame into the buffer,
+        // which keeps the capacity of its strings from the previous entries.
+        void Load() {
+            while (!Stack_.empty() && Stack_.back().Index == Stack_.back().Node->Keys_.size()) {
+                Stack_.pop_back();
+            }
+            if (Stack_.empty()) {
+                return;
+            }
+            auto& frame = Stack_.back();
+            Current_.Key.assign(frame.Node->Keys_[frame.Index].Key);
+            Current_.Value.assign(*frame.Node->Values_[frame.Index]);
+            Current_.Tombstone = frame.Node->Keys_[frame.Index].Tombstone;
+            Current_.IsValuePointer = false;
+        }
+
+        std::vector<Frame> Stack_;
+        KVTombstone Current_;
+    };
+
     std::shared_ptr<BTreeNode> Root_;
     size_t Size_ = 0;
     size_t MinDegree_;
@@ -73,6 +73,21 @@ TEST(BTreeTest, TestDelete)
     }
 }
 
+TEST(BTreeTest, TestDeleteSize)
+{
+    auto tree = BTree(2);
+    auto key_values = GenKeyValues(100);
+    for (auto& kv : key_values) {
+        tree.Delete(kv.first);
+    }
+    ASSERT_EQ(tree.GetSize(), 100);
+    auto list_result = tree.List();
+    ASSERT_EQ(list_result.size(), 100);
+    for (auto& elem : list_result) {
+        ASSERT_EQ(elem.Tombstone, true);
+    }
+}
+
 TEST(BTreeTest, TestGetQuery)
 {
     auto tree = BTree(2);
@@ -112,6 +127,37 @@ TEST(BTreeTest, TestList)
     }
 }
 
+TEST(BTreeTest, TestCursor)
+{
+    for (size_t min_degree : { 2, 3, 16 }) {
+        auto tree = BTree(min_degree);
+        ASSERT_FALSE(tree.NewCursor()->IsValid());
+        ASSERT_FALSE(tree.GetMinKey());
+        ASSERT_FALSE(tree.GetMaxKey());
+
+        auto key_values = GenKeyValues(1000);
+        for (size_t i = 0; i < key_values.size(); ++i) {
+            if (i % 7 == 0) {
+                tree.Delete(key_values[i].first);
+            } else {
+                tree.Add(key_values[i].first, key_values[i].second);
+            }
+        }
+        auto list_result = tree.List();
+        size_t index = 0;
+        for (auto cursor = tree.NewCursor(); cursor->IsValid(); cursor->Next()) {
+            ASSERT_LT(index, list_result.size());
+            ASSERT_EQ(cursor->Current().Key, list_result[index].Key);
+            ASSERT_EQ(cursor->Current().Value, list_result[index].Value);
+            ASSERT_EQ(cursor->Current().Tombstone, list_result[index].Tombstone);
+            ++index;
+        }
+        ASSERT_EQ(index, key_values.size());
+        ASSERT_EQ(*tree.GetMinKey(), list_result.front().Key);
+        ASSERT_EQ(*tree.GetMaxKey(), list_result.back().Key);
+    }
+}
+
 int main(int argc, char** argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
@@ -1,6 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 using K = std::string;
@@ -10,18 +15,216 @@ struct GetResult {
     bool IsFound = false;
     V Value;
     bool IsDeleted = false;
+    // Value holds a pointer into the value log instead of the value itself.
+    bool IsValuePointer = false;
+    // The checksum of the data the answer is in did not match, nothing else is set.
+    bool IsCorrupted = false;
+};
+
+// View of a value which is not copied out of the memtable or a file. The view stays valid while
+// the object is alive, even if the value is overwritten or its file is compacted away.
+class PinnedValue {
+public:
+    void Pin(std::shared_ptr<const void> owner, std::string_view view) {
+        Owner_ = std::move(owner);
+        View_ = view;
+    }
+
+    // Takes the ownership of a value which had to be read into memory.
+    void PinString(V&& value) {
+        auto owner = std::make_shared<const V>(std::move(value));
+        View_ = *owner;
+        Owner_ = std::move(owner);
+    }
+
+    std::string_view View() const {
+        return View_;
+    }
+
+    std::string ToString() const {
+        return std::string(View_);
+    }
+
+    size_t Size() const {
+        return View_.size();
+    }
+
+    bool IsPinned() const {
+        return Owner_ != nullptr;
+    }
+
+    void Reset() {
+        Owner_.reset();
+        View_ = {};
+    }
+
+private:
+    std::shared_ptr<const void> Owner_;
+    std::string_view View_;
+};
+
+struct PinnedGetResult {
+    bool IsFound = false;
+    PinnedValue Value;
+    bool IsDeleted = false;
+    bool IsValuePointer = false;
+    bool IsCorrupted = false;
 };
 
 struct KVTombstone {
     std::string Key = "";
     V Value = V();
     bool Tombstone = false;
+    bool IsValuePointer = false;
 
     KVTombstone() {}
 
-    KVTombstone(std::string& key, V& value, bool tombstone)
+    KVTombstone(const K& key, const V& value, bool tombstone)
         : Key(key)
         , Value(value)
         , Tombstone(tombstone)
     {}
 };
+
+class KVTSource {
+public:
+    virtual ~KVTSource() = default;
+
+    virtual bool IsValid() = 0;
+    virtual KVTombstone& Current() = 0;
+    virtual void Next() = 0;
+};
+
+class VectorSource : public KVTSource {
+public:
+    VectorSource(std::vector<KVTombstone>& data)
+        : Data_(data)
+    {}
+
+    bool IsValid() override {
+        return Index_ < Data_.size();
+    }
+
+    KVTombstone& Current() override {
+        return Data_[Index_];
+    }
+
+    void Next() override {
+        ++Index_;
+    }
+
+private:
+    std::vector<KVTombstone>& Data_;
+    size_t Index_ = 0;
+};
+
+// Source which changes every entry of another source in place once, when the entry becomes current.
+class TransformSource : public KVTSource {
+public:
+    TransformSource(std::unique_ptr<KVTSource> source, std::function<void(KVTombstone&)> transform)
+        : Source_(std::move(source))
+        , Transform_(std::move(transform))
+    {
+        Apply();
+    }
+
+    bool IsValid() override {
+        return Source_->IsValid();
+    }
+
+    KVTombstone& Current() override {
+        return Source_->Current();
+    }
+
+    void Next() override {
+        Source_->Next();
+        Apply();
+    }
+
+private:
+    void Apply() {
+        if (Source_->IsValid()) {
+            Transform_(Source_->Current());
+        }
+    }
+
+    std::unique_ptr<KVTSource> Source_;
+    std::function<void(KVTombstone&)> Transform_;
+};
+
+// Deletes all keys from [Start, End) written before it.
+struct RangeTombstone {
+    K Start = K();
+    K End = K();
+};
+
+class RangeTombstoneSet {
+public:
+    void Add(const RangeTombstone& range_tombstone) {
+        if (!(range_tombstone.Start < range_tombstone.End)) {
+            return;
+        }
+        auto pos = std::upper_bound(Tombstones_.begin(), Tombstones_.end(), range_tombstone.Start,
+            [](const K& key, const RangeTombstone& tombstone) { return key < tombstone.Start; });
+        Tombstones_.insert(pos, range_tombstone);
+
+        MaxEnds_.resize(Tombstones_.size());
+        for (size_t i = 0; i < Tombstones_.size(); ++i) {
+            MaxEnds_[i] = (i == 0 || MaxEnds_[i - 1] < Tombstones_[i].End) ? Tombstones_[i].End : MaxEnds_[i - 1];
+        }
+    }
+
+    void Add(const RangeTombstoneSet& other) {
+        for (auto& tombstone : other.Tombstones_) {
+            Add(tombstone);
+        }
+    }
+
+    bool Covers(const K& key) const {
+        auto pos = std::upper_bound(Tombstones_.begin(), Tombstones_.end(), key,
+            [](const K& key, const RangeTombstone& tombstone) { return key < tombstone.Start; });
+        if (pos == Tombstones_.begin()) {
+            return false;
+        }
+        return key < MaxEnds_[pos - Tombstones_.begin() - 1];
+    }
+
+    // Parts of the tombstones which lie inside [start_key, end_key), unbounded sides are not set.
+    RangeTombstoneSet Clip(const std::optional<K>& start_key, const std::optional<K>& end_key) const {
+        RangeTombstoneSet result;
+        for (auto& tombstone : Tombstones_) {
+            RangeTombstone clipped = tombstone;
+            if (start_key && clipped.Start < *start_key) {
+                clipped.Start = *start_key;
+            }
+            if (end_key && *end_key < clipped.End) {
+                clipped.End = *end_key;
+            }
+            result.Add(clipped);
+        }
+        return result;
+    }
+
+    const std::vector<RangeTombstone>& Get() const {
+        return Tombstones_;
+    }
+
+    size_t Size() const {
+        return Tombstones_.size();
+    }
+
+    bool Empty() const {
+        return Tombstones_.empty();
+    }
+
+    void Clear() {
+        Tombstones_.clear();
+        MaxEnds_.clear();
+    }
+
+private:
+    // Sorted by the start key.
+    std::vector<RangeTombstone> Tombstones_;
+    // Largest end key among the first i + 1 tombstones.
+    std::vector<K> MaxEnds_;
+};
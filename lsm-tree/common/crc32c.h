@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+// CRC32C (Castagnoli polynomial) of byte strings. The crc32 instruction of SSE4.2 is used if
+// the processor has it, otherwise a table, both give the same values. Extend continues
+// a checksum with more bytes, so Extend(Value(a), b) == Value(a + b).
+class Crc32c {
+public:
+    static uint32_t Value(const char* data, size_t size) {
+        return Extend(0, data, size);
+    }
+
+    static uint32_t Extend(uint32_t crc, const char* data, size_t size) {
+#if defined(__x86_64__)
+        if (IsHardwareSupported()) {
+            return ExtendHardware(crc, data, size);
+        }
+#endif
+        return ExtendSoftware(crc, data, size);
+    }
+
+    static bool IsHardwareSupported() {
+#if defined(__x86_64__)
+        static const bool is_supported = __builtin_cpu_supports("sse4.2");
+        return is_supported;
+#else
+        return false;
+#endif
+    }
+
+    static uint32_t ExtendSoftware(uint32_t crc, const char* data, size_t size) {
+        static const auto table = MakeTable();
+        uint32_t result = ~crc;
+        for (size_t i = 0; i < size; ++i) {
+            result = table[(result ^ static_cast<unsigned char>(data[i])) & 0xff] ^ (result >> 8);
+        }
+        return ~result;
+    }
+
+#if defined(__x86_64__)
+    __attribute__((target("sse4.2")))
+    static uint32_t ExtendHardware(uint32_t crc, const char* data, size_t size) {
+        uint64_t result = ~crc;
+        for (; size >= 8; data += 8, size -= 8) {
+            uint64_t word;
+            memcpy(&word, data, sizeof(word));
+            result = _mm_crc32_u64(result, word);
+        }
+        uint32_t tail = static_cast<uint32_t>(result);
+        for (; size > 0; ++data, --size) {
+            tail = _mm_crc32_u8(tail, static_cast<unsigned char>(*data));
+        }
+        return ~tail;
+    }
+#endif
+
+private:
+    static std::array<uint32_t, 256> MakeTable() {
+        std::array<uint32_t, 256> table;
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t value = i;
+            for (size_t bit = 0; bit < 8; ++bit) {
+                value = (value & 1) ? (value >> 1) ^ POLYNOMIAL : value >> 1;
+            }
+            table[i] = value;
+        }
+        return table;
+    }
+
+    // Reversed Castagnoli polynomial.
+    static constexpr uint32_t POLYNOMIAL = 0x82f63b78;
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+// Reads a file in order past the page cache: the file is opened with O_DIRECT and read by aligned
+// windows, reads of any offsets and sizes are served from the current window. Where the file
+// system does not support O_DIRECT the file is read through the page cache and the pages of
+// every window are dropped from it after the window is read.
+class DirectReader {
+public:
+    static constexpr size_t ALIGNMENT = 4096;
+    static constexpr size_t DEFAULT_WINDOW_SIZE = 1024 * 1024;
+
+    DirectReader(const std::string& file_name, size_t window_size = DEFAULT_WINDOW_SIZE)
+        : WindowSize_(std::max((window_size + ALIGNMENT - 1) / ALIGNMENT, size_t(1)) * ALIGNMENT)
+    {
+#ifdef O_DIRECT
+        Fd_ = open(file_name.c_str(), O_RDONLY | O_DIRECT);
+        IsDirect_ = (Fd_ >= 0);
+#endif
+        if (Fd_ < 0) {
+            Fd_ = open(file_name.c_str(), O_RDONLY);
+#ifdef POSIX_FADV_SEQUENTIAL
+            if (Fd_ >= 0) {
+                posix_fadvise(Fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+            }
+#endif
+        }
+        Window_ = static_cast<char*>(std::aligned_alloc(ALIGNMENT, WindowSize_));
+    }
+
+    DirectReader(const DirectReader&) = delete;
+    DirectReader& operator=(const DirectReader&) = delete;
+
+    ~DirectReader() {
+        std::free(Window_);
+        if (Fd_ >= 0) {
+            close(Fd_);
+        }
+    }
+
+    bool IsValid() {
+        return Fd_ >= 0 && Window_;
+    }
+
+    bool IsDirect() {
+        return IsDirect_;
+    }
+
+    // False if the file has less than offset + size bytes.
+    bool Read(size_t offset, size_t size, char* buffer) {
+        while (size > 0) {
+            if (offset < WindowStart_ || offset >= WindowStart_ + WindowBytes_) {
+                if (!Fill(offset)) {
+                    return false;
+                }
+            }
+            size_t from = offset - WindowStart_;
+            size_t count = std::min(size, WindowBytes_ - from);
+            memcpy(buffer, Window_ + from, count);
+            buffer += count;
+            offset += count;
+            size -= count;
+        }
+        return true;
+    }
+
+private:
+    bool Fill(size_t offset) {
+        if (!IsValid()) {
+            return false;
+        }
+        WindowStart_ = offset / ALIGNMENT * ALIGNMENT;
+        ssize_t bytes = pread(Fd_, Window_, WindowSize_, WindowStart_);
+        WindowBytes_ = bytes > 0 ? bytes : 0;
+#ifdef POSIX_FADV_DONTNEED
+        if (!IsDirect_ && WindowBytes_ > 0) {
+            posix_fadvise(Fd_, WindowStart_, WindowBytes_, POSIX_FADV_DONTNEED);
+        }
+#endif
+        return offset < WindowStart_ + WindowBytes_;
+    }
+
+    int Fd_ = -1;
+    bool IsDirect_ = false;
+    size_t WindowSize_;
+    char* Window_ = nullptr;
+    size_t WindowStart_ = 0;
+    size_t WindowBytes_ = 0;
+};
+
+// Space and page cache hints for files written through FILE*.
+class FileHints {
+public:
+    // Reserves bytes for the file, so it is allocated in one piece. Done only where the file
+    // system does it without writing the bytes, false otherwise.
+    static bool Preallocate(FILE* file, size_t bytes) {
+#ifdef __linux__
+        return bytes > 0 && fallocate(fileno(file), 0, 0, bytes) == 0;
+#else
+        return false;
+#endif
+    }
+
+    // Called when everything is written: the part of the preallocated space past the written
+    // bytes is released and with drop_from_cache the written pages are flushed and dropped
+    // from the page cache.
+    static void Finish(FILE* file, bool is_preallocated, bool drop_from_cache) {
+        fflush(file);
+        int fd = fileno(file);
+        if (is_preallocated) {
+            off_t size = ftello(file);
+            if (size >= 0 && ftruncate(fd, size) != 0) {
+                return;
+            }
+        }
+#ifdef POSIX_FADV_DONTNEED
+        if (drop_from_cache) {
+            // Dirty pages are not dropped, so they are written out first.
+            fdatasync(fd);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+#endif
+    }
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only mapping of a whole file. The mapping stays readable after the file is removed.
+class MappedFile {
+public:
+    MappedFile(const std::string& file_name) {
+        int fd = open(file_name.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+            void* data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (data != MAP_FAILED) {
+                Data_ = static_cast<const char*>(data);
+                Size_ = file_stat.st_size;
+            }
+        }
+        close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if (Data_) {
+            munmap(const_cast<char*>(Data_), Size_);
+        }
+    }
+
+    bool IsValid() const {
+        return Data_ != nullptr;
+    }
+
+    const char* GetData() const {
+        return Data_;
+    }
+
+    size_t GetSize() const {
+        return Size_;
+    }
+
+private:
+    const char* Data_ = nullptr;
+    size_t Size_ = 0;
+};
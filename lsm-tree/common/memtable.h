@@ -0,0 +1,42 @@
+#pragma once
+
+#include "common.h"
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+// Sorted in-memory table of the newest writes of the tree. Deletions are kept as tombstones,
+// entries are listed in the order of their keys.
+class Memtable {
+public:
+    virtual ~Memtable() = default;
+
+    virtual GetResult Get(K& key) = 0;
+
+    // Values are shared, so a pinned value is not copied and outlives its key in the table.
+    virtual PinnedGetResult GetPinned(K& key) = 0;
+
+    // Entries with keys from [start_key, end_key], tombstones included.
+    virtual std::vector<KVTombstone> GetQuery(K& start_key, K& end_key) = 0;
+
+    virtual void Add(K& key, V& value, bool is_deleting = false) = 0;
+
+    virtual void Delete(K& key) = 0;
+
+    virtual std::vector<KVTombstone> List() = 0;
+
+    // Entries in the order of their keys, tombstones included, read from the table one at a time
+    // as the cursor moves instead of copied all at once. The table must not change while the
+    // cursor is used.
+    virtual std::unique_ptr<KVTSource> NewCursor() = 0;
+
+    // std::nullopt if the table is empty.
+    virtual std::optional<K> GetMinKey() = 0;
+    virtual std::optional<K> GetMaxKey() = 0;
+
+    virtual void Erase() = 0;
+
+    // Number of distinct keys.
+    virtual size_t GetSize() = 0;
+};
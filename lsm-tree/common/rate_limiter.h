@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+// Token bucket: Request blocks the caller until the requested bytes fit into the rate.
+// Up to burst_bytes may be requested at once without waiting after an idle period.
+class RateLimiter {
+public:
+    RateLimiter(size_t bytes_per_second, size_t burst_bytes = 0)
+        : BytesPerSecond_(std::max<size_t>(bytes_per_second, 1))
+        , BurstBytes_(burst_bytes > 0 ? burst_bytes : std::max<size_t>(BytesPerSecond_ / 10, 1))
+        , Tokens_(BurstBytes_)
+        , LastRefill_(std::chrono::steady_clock::now())
+    {}
+
+    void Request(size_t bytes) {
+        std::chrono::microseconds wait(0);
+        {
+            std::lock_guard<std::mutex> lock(Mutex_);
+            Refill();
+            RequestedBytes_ += bytes;
+            // Tokens may go below zero, the caller then waits until the debt is paid off.
+            Tokens_ -= static_cast<double>(bytes);
+            if (Tokens_ < 0) {
+                wait = std::chrono::microseconds(static_cast<long long>(-Tokens_ * 1e6 / BytesPerSecond_));
+                WaitMicros_ += wait.count();
+                ++Waits_;
+            }
+        }
+        if (wait.count() > 0) {
+            std::this_thread::sleep_for(wait);
+        }
+    }
+
+    size_t GetBytesPerSecond() const {
+        return BytesPerSecond_;
+    }
+
+    size_t GetRequestedBytes() {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        return RequestedBytes_;
+    }
+
+    // Total time callers were put to sleep and number of requests which had to wait.
+    size_t GetWaitMicros() {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        return WaitMicros_;
+    }
+
+    size_t GetWaits() {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        return Waits_;
+    }
+
+private:
+    void Refill() {
+        auto now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - LastRefill_).count();
+        LastRefill_ = now;
+        Tokens_ = std::min<double>(Tokens_ + seconds * BytesPerSecond_, BurstBytes_);
+    }
+
+    std::mutex Mutex_;
+    size_t BytesPerSecond_;
+    size_t BurstBytes_;
+    double Tokens_;
+    std::chrono::steady_clock::time_point LastRefill_;
+    size_t RequestedBytes_ = 0;
+    size_t WaitMicros_ = 0;
+    size_t Waits_ = 0;
+};
@@ -0,0 +1,244 @@
+#pragma once
+
+#include "thread_pool.h"
+
+#include <cerrno>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+// Macros of linux/fs.h, which io_uring.h includes, named as common constants.
+#undef BLOCK_SIZE
+#undef BLOCK_SIZE_BITS
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define LSM_HAS_IO_URING 1
+#endif
+
+// A read of Size bytes at Offset of the file into Buffer.
+struct ReadRequest {
+    int Fd = -1;
+    size_t Offset = 0;
+    size_t Size = 0;
+    char* Buffer = nullptr;
+};
+
+// Issues many reads at once instead of one blocking read after another, so the device
+// works on all of them together.
+class ReadEngine {
+public:
+    virtual ~ReadEngine() = default;
+
+    // Waits for all the reads, false if one of them failed or was short.
+    virtual bool ReadAll(std::vector<ReadRequest>& requests) = 0;
+
+    // Number of reads worth issuing together.
+    virtual size_t GetQueueDepth() = 0;
+
+    // io_uring if the kernel allows it, otherwise a pool of queue_depth threads.
+    static std::shared_ptr<ReadEngine> Create(size_t queue_depth);
+};
+
+class ThreadPoolReadEngine : public ReadEngine {
+public:
+    ThreadPoolReadEngine(size_t threads_count)
+        : Pool_(threads_count)
+    {}
+
+    bool ReadAll(std::vector<ReadRequest>& requests) override {
+        std::vector<std::future<void>> results;
+        std::vector<char> is_read(requests.size(), false);
+        for (size_t i = 0; i < requests.size(); ++i) {
+            results.push_back(Pool_.Submit([&requests, &is_read, i] {
+                auto& request = requests[i];
+                is_read[i] = pread(request.Fd, request.Buffer, request.Size, request.Offset) == static_cast<ssize_t>(request.Size);
+            }));
+        }
+        for (auto& result : results) {
+            result.get();
+        }
+        for (char read : is_read) {
+            if (!read) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    size_t GetQueueDepth() override {
+        return Pool_.GetThreadsCount();
+    }
+
+private:
+    ThreadPool Pool_;
+};
+
+#ifdef LSM_HAS_IO_URING
+
+// Reads through an io_uring ring set up with raw system calls: up to the size of the submission
+// queue reads are in flight at once, completions are reaped as they arrive. Calls of ReadAll
+// from several threads share the ring one after another.
+class IoUringReadEngine : public ReadEngine {
+public:
+    IoUringReadEngine(unsigned entries) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        RingFd_ = syscall(__NR_io_uring_setup, entries, &params);
+        if (RingFd_ < 0) {
+            return;
+        }
+        Entries_ = params.sq_entries;
+        SqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        CqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool is_single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (is_single_mmap) {
+            SqRingSize_ = CqRingSize_ = std::max(SqRingSize_, CqRingSize_);
+        }
+        SqRing_ = mmap(nullptr, SqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, RingFd_, IORING_OFF_SQ_RING);
+        CqRing_ = is_single_mmap ? SqRing_
+            : mmap(nullptr, CqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, RingFd_, IORING_OFF_CQ_RING);
+        SqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+        Sqes_ = static_cast<io_uring_sqe*>(mmap(nullptr, SqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, RingFd_, IORING_OFF_SQES));
+        if (SqRing_ == MAP_FAILED || CqRing_ == MAP_FAILED || Sqes_ == MAP_FAILED) {
+            Close();
+            return;
+        }
+        char* sq = static_cast<char*>(SqRing_);
+        SqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        SqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        SqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        char* cq = static_cast<char*>(CqRing_);
+        CqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        CqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        CqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        Cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    IoUringReadEngine(const IoUringReadEngine&) = delete;
+    IoUringReadEngine& operator=(const IoUringReadEngine&) = delete;
+
+    ~IoUringReadEngine() {
+        Close();
+    }
+
+    bool IsValid() {
+        return RingFd_ >= 0;
+    }
+
+    bool ReadAll(std::vector<ReadRequest>& requests) override {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        std::vector<iovec> vectors(requests.size());
+        std::vector<int> results(requests.size(), -1);
+        size_t submitted = 0;
+        size_t completed = 0;
+        bool is_failed = false;
+        while (completed < submitted || (submitted < requests.size() && !is_failed)) {
+            unsigned tail = *SqTail_;
+            unsigned to_submit = 0;
+            while (!is_failed && submitted < requests.size() && submitted - completed < Entries_) {
+                auto& request = requests[submitted];
+                vectors[submitted] = { request.Buffer, request.Size };
+                unsigned index = tail & SqMask_;
+                io_uring_sqe* sqe = &Sqes_[index];
+                memset(sqe, 0, sizeof(*sqe));
+                sqe->opcode = IORING_OP_READV;
+                sqe->fd = request.Fd;
+                sqe->addr = reinterpret_cast<uint64_t>(&vectors[submitted]);
+                sqe->len = 1;
+                sqe->off = request.Offset;
+                sqe->user_data = submitted;
+                SqArray_[index] = index;
+                ++tail;
+                ++submitted;
+                ++to_submit;
+            }
+            __atomic_store_n(SqTail_, tail, __ATOMIC_RELEASE);
+            int entered = syscall(__NR_io_uring_enter, RingFd_, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (entered < 0 && errno != EINTR) {
+                // Reads already in flight still complete into the buffers, so they are waited for.
+                is_failed = true;
+                if (to_submit > 0 && completed == submitted - to_submit) {
+                    break;
+                }
+            }
+            unsigned head = *CqHead_;
+            unsigned cq_tail = __atomic_load_n(CqTail_, __ATOMIC_ACQUIRE);
+            for (; head != cq_tail; ++head) {
+                auto& cqe = Cqes_[head & CqMask_];
+                results[cqe.user_data] = cqe.res;
+                ++completed;
+            }
+            __atomic_store_n(CqHead_, head, __ATOMIC_RELEASE);
+        }
+        if (is_failed) {
+            return false;
+        }
+        for (size_t i = 0; i < requests.size(); ++i) {
+            if (results[i] != static_cast<int>(requests[i].Size)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    size_t GetQueueDepth() override {
+        return Entries_;
+    }
+
+private:
+    void Close() {
+        if (Sqes_ && Sqes_ != MAP_FAILED) {
+            munmap(Sqes_, SqesSize_);
+        }
+        if (CqRing_ && CqRing_ != MAP_FAILED && CqRing_ != SqRing_) {
+            munmap(CqRing_, CqRingSize_);
+        }
+        if (SqRing_ && SqRing_ != MAP_FAILED) {
+            munmap(SqRing_, SqRingSize_);
+        }
+        Sqes_ = nullptr;
+        CqRing_ = nullptr;
+        SqRing_ = nullptr;
+        if (RingFd_ >= 0) {
+            close(RingFd_);
+            RingFd_ = -1;
+        }
+    }
+
+    int RingFd_ = -1;
+    unsigned Entries_ = 0;
+    void* SqRing_ = nullptr;
+    void* CqRing_ = nullptr;
+    size_t SqRingSize_ = 0;
+    size_t CqRingSize_ = 0;
+    io_uring_sqe* Sqes_ = nullptr;
+    size_t SqesSize_ = 0;
+    unsigned* SqTail_ = nullptr;
+    unsigned SqMask_ = 0;
+    unsigned* SqArray_ = nullptr;
+    unsigned* CqHead_ = nullptr;
+    unsigned* CqTail_ = nullptr;
+    unsigned CqMask_ = 0;
+    io_uring_cqe* Cqes_ = nullptr;
+    std::mutex Mutex_;
+};
+
+#endif
+
+inline std::shared_ptr<ReadEngine> ReadEngine::Create(size_t queue_depth) {
+#ifdef LSM_HAS_IO_URING
+    auto io_uring = std::make_shared<IoUringReadEngine>(queue_depth);
+    if (io_uring->IsValid()) {
+        return io_uring;
+    }
+#endif
+    return std::make_shared<ThreadPoolReadEngine>(queue_depth);
+}
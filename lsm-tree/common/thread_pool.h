@@ -0,0 +1,67 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    ThreadPool(size_t threads_count) {
+        for (size_t i = 0; i < threads_count; ++i) {
+            Threads_.emplace_back([this] { Run(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(Mutex_);
+            IsStopped_ = true;
+        }
+        HasTasks_.notify_all();
+        for (auto& thread : Threads_) {
+            thread.join();
+        }
+    }
+
+    std::future<void> Submit(std::function<void()> function) {
+        std::packaged_task<void()> task(std::move(function));
+        auto result = task.get_future();
+        {
+            std::lock_guard<std::mutex> lock(Mutex_);
+            Tasks_.push(std::move(task));
+        }
+        HasTasks_.notify_one();
+        return result;
+    }
+
+    size_t GetThreadsCount() {
+        return Threads_.size();
+    }
+
+private:
+    void Run() {
+        while (true) {
+            std::packaged_task<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(Mutex_);
+                HasTasks_.wait(lock, [this] { return IsStopped_ || !Tasks_.empty(); });
+                if (Tasks_.empty()) {
+                    return;
+                }
+                task = std::move(Tasks_.front());
+                Tasks_.pop();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> Threads_;
+    std::queue<std::packaged_task<void()>> Tasks_;
+    std::mutex Mutex_;
+    std::condition_variable HasTasks_;
+    bool IsStopped_ = false;
+};
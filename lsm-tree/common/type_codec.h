@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Codecs between typed keys and values and the bytes the tree keeps. The tree orders keys by
+// their bytes, so a key codec keeps the order of its type in the order of the bytes. SIZE is the
+// size of every encoded value, or zero if it varies, so fixed sizes are known at compile time.
+// Encode writes into a string which keeps its capacity between calls, values of up to 15 bytes
+// fit into the string itself and are not allocated.
+
+// Trivially copyable type stored as its bytes, keys are ordered as their bytes (memcmp). Suits
+// char arrays and structs of them, integers should use UInt32Codec to be ordered by their values.
+template <typename T>
+class FixedSizeCodec {
+public:
+    static_assert(std::is_trivially_copyable_v<T>, "FixedSizeCodec needs a trivially copyable type");
+
+    using Type = T;
+    static constexpr size_t SIZE = sizeof(T);
+
+    static void Encode(const T& value, std::string& bytes) {
+        bytes.assign(reinterpret_cast<const char*>(&value), SIZE);
+    }
+
+    // bytes must be SIZE long.
+    static T Decode(std::string_view bytes) {
+        T value;
+        memcpy(&value, bytes.data(), SIZE);
+        return value;
+    }
+};
+
+// Big-endian, so the order of the bytes is the order of the numbers.
+class UInt32Codec {
+public:
+    using Type = uint32_t;
+    static constexpr size_t SIZE = sizeof(uint32_t);
+
+    static void Encode(uint32_t value, std::string& bytes) {
+        char buffer[SIZE];
+        for (size_t i = 0; i < SIZE; ++i) {
+            buffer[i] = static_cast<char>(value >> (8 * (SIZE - 1 - i)));
+        }
+        bytes.assign(buffer, SIZE);
+    }
+
+    static uint32_t Decode(std::string_view bytes) {
+        uint32_t value = 0;
+        for (size_t i = 0; i < SIZE; ++i) {
+            value = (value << 8) | static_cast<unsigned char>(bytes[i]);
+        }
+        return value;
+    }
+};
+
+class StringCodec {
+public:
+    using Type = std::string;
+    static constexpr size_t SIZE = 0;
+
+    static void Encode(const std::string& value, std::string& bytes) {
+        bytes.assign(value);
+    }
+
+    static std::string Decode(std::string_view bytes) {
+        return std::string(bytes);
+    }
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "../common/common.h"
+
+#include <cstddef>
+
+// User hook called for every live entry written by a compaction or a flush.
+// One filter is shared by the whole tree: with MaxSubcompactions greater than one
+// the subcompactions of a merge call it from several threads at once, so an
+// implementation must be thread safe (guard any state it keeps).
+class CompactionFilter {
+public:
+    virtual ~CompactionFilter() = default;
+
+    // Returns true if the entry has to be removed. The value may be rewritten in place.
+    // A removed entry is written as a tombstone unless tombstones can be dropped.
+    // May be called concurrently for different keys, see the class comment.
+    virtual bool Filter(size_t output_level, const K& key, V& value) = 0;
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "../common/common.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Merges several sorted sources into one sorted stream without duplicate keys.
+// Sources must be ordered from the newest to the oldest one: for equal keys
+// only the entry of the newest source is returned. Entries covered by a range
+// tombstone of a newer source are skipped.
+class MergeIterator : public KVTSource {
+public:
+    // drop_callback is called for every entry which is not returned: older versions of a key
+    // and range deleted entries.
+    MergeIterator(std::vector<std::unique_ptr<KVTSource>> sources, std::vector<RangeTombstoneSet> range_tombstones = {},
+                  std::function<void(KVTombstone&)> drop_callback = nullptr)
+        : Sources_(std::move(sources))
+        , RangeTombstones_(std::move(range_tombstones))
+        , DropCallback_(std::move(drop_callback))
+    {
+        RangeTombstones_.resize(Sources_.size());
+        FindCurrent();
+    }
+
+    bool IsValid() override {
+        return Current_ < Sources_.size();
+    }
+
+    KVTombstone& Current() override {
+        return Sources_[Current_]->Current();
+    }
+
+    void Next() override {
+        Skip();
+        FindCurrent();
+    }
+
+    // Number of entries skipped because of range tombstones.
+    size_t GetRangeDeletedCount() {
+        return RangeDeletedCount_;
+    }
+
+private:
+    void Skip(bool is_current_dropped=false) {
+        K key = Current().Key;
+        for (size_t i = 0; i < Sources_.size(); ++i) {
+            auto& source = Sources_[i];
+            if (source->IsValid() && source->Current().Key == key) {
+                if (DropCallback_ && (i != Current_ || is_current_dropped)) {
+                    DropCallback_(source->Current());
+                }
+                source->Next();
+            }
+        }
+    }
+
+    void FindCurrent() {
+        while (true) {
+            Current_ = Sources_.size();
+            for (size_t i = 0; i < Sources_.size(); ++i) {
+                if (!Sources_[i]->IsValid()) {
+                    continue;
+                }
+                if (Current_ == Sources_.size() || Sources_[i]->Current().Key < Sources_[Current_]->Current().Key) {
+                    Current_ = i;
+                }
+            }
+            if (!IsValid() || !IsRangeDeleted()) {
+                return;
+            }
+            ++RangeDeletedCount_;
+            Skip(true);
+        }
+    }
+
+    bool IsRangeDeleted() {
+        for (size_t i = 0; i < Current_; ++i) {
+            if (RangeTombstones_[i].Covers(Current().Key)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<KVTSource>> Sources_;
+    // Range tombstones of every source, they cover entries of older sources only.
+    std::vector<RangeTombstoneSet> RangeTombstones_;
+    std::function<void(KVTombstone&)> DropCallback_;
+    size_t Current_ = 0;
+    size_t RangeDeletedCount_ = 0;
+};
+
+// Reads sources with disjoint key ranges one after another, e.g. the files of one sorted run.
+class ConcatSource : public KVTSource {
+public:
+    ConcatSource(std::vector<std::unique_ptr<KVTSource>> sources)
+        : Sources_(std::move(sources))
+    {
+        SkipEmpty();
+    }
+
+    bool IsValid() override {
+        return Current_ < Sources_.size();
+    }
+
+    KVTombstone& Current() override {
+        return Sources_[Current_]->Current();
+    }
+
+    void Next() override {
+        Sources_[Current_]->Next();
+        SkipEmpty();
+    }
+
+private:
+    void SkipEmpty() {
+        while (Current_ < Sources_.size() && !Sources_[Current_]->IsValid()) {
+            ++Current_;
+        }
+    }
+
+    std::vector<std::unique_ptr<KVTSource>> Sources_;
+    size_t Current_ = 0;
+};
@@ -0,0 +1,3 @@
+#include "filter.h"
+#include "policy.h"
+#include "merge_iterator.h"
@@ -0,0 +1,218 @@
+#pragma once
+
+#include "../common/common.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct FileShape {
+    size_t Size = 0;
+    K MinKey = K();
+    K MaxKey = K();
+};
+
+// Files of a sorted run are ordered by key and have disjoint key ranges.
+using RunShape = std::vector<FileShape>;
+
+// Sorted runs of every level, the newest run goes first.
+using LevelsShape = std::vector<std::vector<RunShape>>;
+
+struct CompactionInput {
+    size_t Level = 0;
+    size_t Run = 0;
+    std::vector<size_t> Files;
+};
+
+// Input files are merged together and the result is written into OutputLevel.
+// Inputs must be ordered from the newest to the oldest one.
+struct CompactionTask {
+    std::vector<CompactionInput> Inputs;
+    size_t OutputLevel = 0;
+    // If set, the output files replace the input files of this run of OutputLevel,
+    // otherwise they form a new run in front of OutputLevel.
+    std::optional<size_t> OutputRun;
+};
+
+inline size_t GetRunSize(const RunShape& run) {
+    size_t result = 0;
+    for (auto& file : run) {
+        result += file.Size;
+    }
+    return result;
+}
+
+// Indexes of the files of the run whose key ranges intersect [min_key, max_key].
+inline std::vector<size_t> GetOverlappingFiles(const RunShape& run, const K& min_key, const K& max_key) {
+    std::vector<size_t> result;
+    for (size_t i = 0; i < run.size(); ++i) {
+        if (run[i].MaxKey >= min_key && run[i].MinKey <= max_key) {
+            result.push_back(i);
+        }
+    }
+    return result;
+}
+
+class CompactionPolicy {
+public:
+    virtual ~CompactionPolicy() = default;
+
+    // If true, the flushed memtable is merged with the overlapping files of the first
+    // level run, otherwise it becomes a new run of the first level.
+    virtual bool MergeOnFlush() = 0;
+
+    virtual std::optional<CompactionTask> PickCompaction(LevelsShape& levels) = 0;
+
+    // Estimated number of entries compactions have to rewrite to bring the levels into shape.
+    virtual size_t GetCompactionDebt(LevelsShape& /*levels*/) {
+        return 0;
+    }
+
+    virtual std::string GetName() = 0;
+
+    // New policy with the same settings and without the state of this one, for trees which
+    // share options but compact independently (e.g. the shards of ShardedLSMTree).
+    virtual std::shared_ptr<CompactionPolicy> Clone() = 0;
+};
+
+// Every level is one sorted run. Level i overflows when it holds more than
+// multiplier ^ (i + 2) entries; then one of its files is merged with the overlapping
+// files of level i + 1. Files are picked round-robin over the key space.
+class LeveledCompactionPolicy : public CompactionPolicy {
+public:
+    LeveledCompactionPolicy(size_t component_size_multiplier)
+        : ComponentSizeMultiplier_(component_size_multiplier)
+    {}
+
+    bool MergeOnFlush() override {
+        return true;
+    }
+
+    std::optional<CompactionTask> PickCompaction(LevelsShape& levels) override {
+        Cursors_.resize(levels.size());
+        size_t cur_component_max_size = ComponentSizeMultiplier_ * ComponentSizeMultiplier_;
+        for (size_t i = 0; i + 1 < levels.size(); ++i) {
+            size_t level_size = 0;
+            for (auto& run : levels[i]) {
+                level_size += GetRunSize(run);
+            }
+            if (level_size > cur_component_max_size) {
+                return PickFile(levels, i);
+            }
+            cur_component_max_size *= ComponentSizeMultiplier_;
+        }
+        return std::nullopt;
+    }
+
+    size_t GetCompactionDebt(LevelsShape& levels) override {
+        size_t debt = 0;
+        size_t cur_component_max_size = ComponentSizeMultiplier_ * ComponentSizeMultiplier_;
+        for (size_t i = 0; i + 1 < levels.size(); ++i) {
+            size_t level_size = 0;
+            for (auto& run : levels[i]) {
+                level_size += GetRunSize(run);
+            }
+            if (level_size > cur_component_max_size) {
+                debt += level_size - cur_component_max_size;
+            }
+            cur_component_max_size *= ComponentSizeMultiplier_;
+        }
+        return debt;
+    }
+
+    std::string GetName() override {
+        return "leveled";
+    }
+
+    std::shared_ptr<CompactionPolicy> Clone() override {
+        return std::make_shared<LeveledCompactionPolicy>(ComponentSizeMultiplier_);
+    }
+
+private:
+    CompactionTask PickFile(LevelsShape& levels, size_t level) {
+        auto& run = levels[level][0];
+        size_t file_index = 0;
+        if (Cursors_[level]) {
+            while (file_index < run.size() && run[file_index].MinKey <= *Cursors_[level]) {
+                ++file_index;
+            }
+            if (file_index == run.size()) {
+                file_index = 0;
+            }
+        }
+        auto& file = run[file_index];
+        Cursors_[level] = file.MaxKey;
+
+        CompactionTask task;
+        task.Inputs.push_back({ level, 0, { file_index } });
+        task.OutputLevel = level + 1;
+        if (!levels[level + 1].empty()) {
+            auto overlapping = GetOverlappingFiles(levels[level + 1][0], file.MinKey, file.MaxKey);
+            if (!overlapping.empty()) {
+                task.Inputs.push_back({ level + 1, 0, std::move(overlapping) });
+            }
+            task.OutputRun = 0;
+        }
+        return task;
+    }
+
+    size_t ComponentSizeMultiplier_;
+    // Largest key of the last file compacted from every level.
+    std::vector<std::optional<K>> Cursors_;
+};
+
+// Every level holds up to max_runs overlapping runs. When a level is full all its runs
+// are merged together into one new run of the next level (or of the same level for the last one).
+class TieredCompactionPolicy : public CompactionPolicy {
+public:
+    TieredCompactionPolicy(size_t max_runs)
+        : MaxRuns_(std::max<size_t>(max_runs, 2))
+    {}
+
+    bool MergeOnFlush() override {
+        return false;
+    }
+
+    std::optional<CompactionTask> PickCompaction(LevelsShape& levels) override {
+        for (size_t i = 0; i < levels.size(); ++i) {
+            if (levels[i].size() >= MaxRuns_) {
+                CompactionTask task;
+                for (size_t run = 0; run < levels[i].size(); ++run) {
+                    task.Inputs.push_back({ i, run, {} });
+                    for (size_t file = 0; file < levels[i][run].size(); ++file) {
+                        task.Inputs.back().Files.push_back(file);
+                    }
+                }
+                task.OutputLevel = std::min(i + 1, levels.size() - 1);
+                return task;
+            }
+        }
+        return std::nullopt;
+    }
+
+    size_t GetCompactionDebt(LevelsShape& levels) override {
+        size_t debt = 0;
+        for (auto& level : levels) {
+            if (level.size() >= MaxRuns_) {
+                for (auto& run : level) {
+                    debt += GetRunSize(run);
+                }
+            }
+        }
+        return debt;
+    }
+
+    std::string GetName() override {
+        return "tiered";
+    }
+
+    std::shared_ptr<CompactionPolicy> Clone() override {
+        return std::make_shared<TieredCompactionPolicy>(MaxRuns_);
+    }
+
+private:
+    size_t MaxRuns_;
+};
@@ -0,0 +1,101 @@
+#include "../policy.h"
+#include "../merge_iterator.h"
+
+#include <gtest/gtest.h>
+
+FileShape MakeFile(size_t size, std::string min_key, std::string max_key) {
+    return { size, min_key, max_key };
+}
+
+TEST(CompactionPolicyTest, TestLeveled)
+{
+    LeveledCompactionPolicy policy(10);
+    LevelsShape levels = {
+        { { MakeFile(50, "a", "f"), MakeFile(50, "g", "m") } },
+        { { MakeFile(500, "a", "k"), MakeFile(500, "l", "z") } },
+        {},
+    };
+    ASSERT_EQ(policy.PickCompaction(levels).has_value(), false);
+    ASSERT_EQ(policy.GetCompactionDebt(levels), 0);
+
+    levels[0][0][1].Size = 51;
+    ASSERT_EQ(policy.GetCompactionDebt(levels), 1);
+    auto task = policy.PickCompaction(levels);
+    ASSERT_EQ(task.has_value(), true);
+    ASSERT_EQ(task->Inputs.size(), 2);
+    ASSERT_EQ(task->Inputs[0].Level, 0);
+    ASSERT_EQ(task->Inputs[0].Files, std::vector<size_t>({ 0 }));
+    ASSERT_EQ(task->Inputs[1].Level, 1);
+    ASSERT_EQ(task->Inputs[1].Files, std::vector<size_t>({ 0 }));
+    ASSERT_EQ(task->OutputLevel, 1);
+    ASSERT_EQ(task->OutputRun, 0);
+
+    // The next file is picked round-robin and overlaps both files of the next level.
+    task = policy.PickCompaction(levels);
+    ASSERT_EQ(task->Inputs[0].Files, std::vector<size_t>({ 1 }));
+    ASSERT_EQ(task->Inputs[1].Files, std::vector<size_t>({ 0, 1 }));
+
+    // Nothing overlaps and the next level is empty: the file is moved.
+    levels = { {}, { { MakeFile(1001, "a", "z") } }, {} };
+    task = policy.PickCompaction(levels);
+    ASSERT_EQ(task->Inputs.size(), 1);
+    ASSERT_EQ(task->Inputs[0].Level, 1);
+    ASSERT_EQ(task->OutputLevel, 2);
+    ASSERT_EQ(task->OutputRun.has_value(), false);
+}
+
+TEST(CompactionPolicyTest, TestTiered)
+{
+    TieredCompactionPolicy policy(3);
+    RunShape run = { MakeFile(10, "a", "z") };
+    LevelsShape levels = { { run, run }, { run, run }, {} };
+    ASSERT_EQ(policy.PickCompaction(levels).has_value(), false);
+    ASSERT_EQ(policy.GetCompactionDebt(levels), 0);
+
+    levels[0].push_back(run);
+    ASSERT_EQ(policy.GetCompactionDebt(levels), 30);
+    auto task = policy.PickCompaction(levels);
+    ASSERT_EQ(task.has_value(), true);
+    ASSERT_EQ(task->Inputs.size(), 3);
+    ASSERT_EQ(task->Inputs[2].Run, 2);
+    ASSERT_EQ(task->OutputLevel, 1);
+    ASSERT_EQ(task->OutputRun.has_value(), false);
+
+    levels = { {}, {}, { run, run, run } };
+    task = policy.PickCompaction(levels);
+    ASSERT_EQ(task->Inputs[0].Level, 2);
+    ASSERT_EQ(task->OutputLevel, 2);
+}
+
+TEST(CompactionPolicyTest, TestOverlappingFiles)
+{
+    RunShape run = { MakeFile(1, "b", "d"), MakeFile(1, "f", "h"), MakeFile(1, "j", "l") };
+    ASSERT_EQ(GetOverlappingFiles(run, "a", "a"), std::vector<size_t>());
+    ASSERT_EQ(GetOverlappingFiles(run, "d", "f"), std::vector<size_t>({ 0, 1 }));
+    ASSERT_EQ(GetOverlappingFiles(run, "i", "z"), std::vector<size_t>({ 2 }));
+}
+
+TEST(MergeIteratorTest, TestNewestWins)
+{
+    std::vector<KVTombstone> newer = { { "b", "new", false }, { "d", "", true } };
+    std::vector<KVTombstone> older = { { "a", "1", false }, { "b", "old", false }, { "d", "4", false } };
+    std::vector<std::unique_ptr<KVTSource>> sources;
+    sources.push_back(std::make_unique<VectorSource>(newer));
+    sources.push_back(std::make_unique<VectorSource>(older));
+
+    MergeIterator it(std::move(sources));
+    std::vector<KVTombstone> result;
+    for (; it.IsValid(); it.Next()) {
+        result.push_back(it.Current());
+    }
+    ASSERT_EQ(result.size(), 3);
+    ASSERT_EQ(result[0].Key, "a");
+    ASSERT_EQ(result[1].Value, "new");
+    ASSERT_EQ(result[2].Tombstone, true);
+}
+
+int main(int argc, char** argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
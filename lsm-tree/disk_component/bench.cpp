@@ -0,0 +1,113 @@
+#include "component.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <random>
+
+std::string GenString(size_t len, std::mt19937& g) {
+    std::string result;
+    for (size_t i = 0; i < len; ++i) {
+        result += 'a' + g() % 26;
+    }
+    return result;
+}
+
+// Writes the same entries into components with binary search, with the learned index and with
+// the hash index and compares the time and the number of file reads of point lookups. Then compares lookups
+// in a compressed copy reading the block of every key on its own with lookups reading
+// the blocks of many keys together through the read engine.
+static constexpr size_t BATCH_SIZE = 32;
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cout << "usage: component_bench <entries> <max_error>" << std::endl;
+        return 1;
+    }
+    size_t size = atoi(argv[1]);
+    size_t max_error = atoi(argv[2]);
+
+    std::mt19937 g(42);
+    std::set<std::string> keys;
+    while (keys.size() < size) {
+        keys.insert(GenString(16, g));
+    }
+
+    DiskComponent binary("bench_binary.txt");
+    DiskComponent learned("bench_learned.txt");
+    DiskComponent hashed("bench_hashed.txt");
+    learned.EnableLearnedIndex(max_error);
+    hashed.EnableHashIndex();
+    for (auto* component : { &binary, &learned, &hashed }) {
+        FILE* file = fopen(component->GetFileName().c_str(), "wb");
+        for (auto& key : keys) {
+            KVTombstone kvt(key, GenString(32, g), false);
+            component->WriteToFile(kvt, file);
+        }
+        component->FinishFile(file);
+        fclose(file);
+    }
+
+    std::vector<std::string> lookups(keys.begin(), keys.end());
+    std::shuffle(lookups.begin(), lookups.end(), g);
+    for (auto [name, component] : { std::make_pair("BINARY SEARCH", &binary), std::make_pair("LEARNED INDEX", &learned),
+                                   std::make_pair("HASH INDEX", &hashed) }) {
+        size_t reads = component->GetDiskReads();
+        clock_t timestamp_start = clock();
+        for (auto& key : lookups) {
+            component->Get(key);
+        }
+        clock_t delta = clock() - timestamp_start;
+        std::cout << name << " GET TIME: " << (double) delta / CLOCKS_PER_SEC << " sec, "
+            << (double) (component->GetDiskReads() - reads) / lookups.size() << " reads per get, "
+            << component->GetIndexMemoryUsage() << " index bytes" << std::endl;
+    }
+
+    DiskComponent compressed("bench_compressed.txt");
+    compressed.SetCodec(std::make_shared<LZCodec>());
+    FILE* file = fopen(compressed.GetFileName().c_str(), "wb");
+    for (auto& key : keys) {
+        KVTombstone kvt(key, GenString(32, g), false);
+        compressed.WriteToFile(kvt, file);
+    }
+    compressed.FinishFile(file);
+    fclose(file);
+    auto engine = ReadEngine::Create(BATCH_SIZE);
+    file = fopen(compressed.GetFileName().c_str(), "rb");
+    for (bool is_batched : { false, true }) {
+        auto timestamp_start = std::chrono::steady_clock::now();
+        std::string block;
+        std::vector<std::string> data(BATCH_SIZE);
+        size_t found = 0;
+        for (size_t first = 0; first < lookups.size(); first += BATCH_SIZE) {
+            size_t count = std::min(BATCH_SIZE, lookups.size() - first);
+            std::vector<ReadRequest> requests;
+            for (size_t i = 0; is_batched && i < count; ++i) {
+                requests.push_back(compressed.PrepareBlockRead(*compressed.FindBlock(lookups[first + i]), file, data[i]));
+            }
+            if (is_batched) {
+                engine->ReadAll(requests);
+            }
+            for (size_t i = 0; i < count; ++i) {
+                auto& key = lookups[first + i];
+                size_t block_index = *compressed.FindBlock(key);
+                if (is_batched) {
+                    compressed.DecodeBlock(block_index, data[i], block, true);
+                } else {
+                    compressed.ReadBlock(block_index, file, block);
+                }
+                found += compressed.GetFromBlock(key, block_index, block).IsFound;
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - timestamp_start).count();
+        std::cout << (is_batched ? "BATCHED" : "ONE BY ONE") << " COMPRESSED GET TIME: " << seconds << " sec, "
+            << found << " found" << std::endl;
+    }
+    fclose(file);
+    binary.Remove();
+    learned.Remove();
+    hashed.Remove();
+    compressed.Remove();
+    return 0;
+}
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Sizes of an entry of a block, the entry takes [1][key][value] bytes.
+struct BlockEntrySize {
+    size_t KeySize;
+    size_t ValueSize;
+};
+
+// Compression of the blocks of a component file. Every block is written with the identifier
+// of its codec, so a file is read back whatever codecs its blocks were written with.
+// Codecs besides the built-in ones take identifiers from 128 and are added to
+// BlockCodecRegistry before files written with them are read.
+class BlockCodec {
+public:
+    virtual ~BlockCodec() = default;
+
+    virtual uint8_t GetId() const = 0;
+
+    // entries are the sizes of the entries the block consists of, in order.
+    virtual void Compress(const std::string& block, const std::vector<BlockEntrySize>& entries, std::string& output) const = 0;
+
+    // False if the data is malformed.
+    virtual bool Decompress(const char* data, size_t size, std::string& block) const = 0;
+
+    static void PutVarint(uint64_t value, std::string& output) {
+        while (value >= 0x80) {
+            output.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        output.push_back(static_cast<char>(value));
+    }
+
+    static bool GetVarint(const char*& data, const char* end, uint64_t& value) {
+        value = 0;
+        for (size_t shift = 0; shift < 64 && data < end; shift += 7) {
+            uint64_t byte = static_cast<unsigned char>(*data++);
+            value |= (byte & 0x7f) << shift;
+            if (byte < 0x80) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// Blocks which the codec of the file did not make smaller are stored as they are.
+class StoredCodec : public BlockCodec {
+public:
+    static constexpr uint8_t ID = 0;
+
+    uint8_t GetId() const override {
+        return ID;
+    }
+
+    void Compress(const std::string& block, const std::vector<BlockEntrySize>&, std::string& output) const override {
+        output = block;
+    }
+
+    bool Decompress(const char* data, size_t size, std::string& block) const override {
+        block.assign(data, size);
+        return true;
+    }
+};
+
+// LZ77 in the manner of LZ4: repeats of at least MIN_MATCH bytes are found through a hash table
+// of the last position of every 4 bytes and replaced by their length and distance. The block is
+// a sequence of [literals count][literals][match length - MIN_MATCH][distance], all numbers
+// varints, the last sequence has literals only.
+class LZCodec : public BlockCodec {
+public:
+    static constexpr uint8_t ID = 1;
+
+    uint8_t GetId() const override {
+        return ID;
+    }
+
+    void Compress(const std::string& block, const std::vector<BlockEntrySize>&, std::string& output) const override {
+        output.clear();
+        std::array<uint32_t, HASH_TABLE_SIZE> last_positions;
+        last_positions.fill(NO_POSITION);
+        const char* data = block.data();
+        size_t size = block.size();
+        size_t anchor = 0;
+        size_t i = 0;
+        while (i + MIN_MATCH <= size) {
+            uint32_t hash = Hash(data + i);
+            uint32_t candidate = last_positions[hash];
+            last_positions[hash] = i;
+            if (candidate == NO_POSITION || i - candidate > MAX_DISTANCE || memcmp(data + candidate, data + i, MIN_MATCH) != 0) {
+                ++i;
+                continue;
+            }
+            size_t length = MIN_MATCH;
+            while (i + length < size && data[candidate + length] == data[i + length]) {
+                ++length;
+            }
+            PutVarint(i - anchor, output);
+            output.append(data + anchor, i - anchor);
+            PutVarint(length - MIN_MATCH, output);
+            PutVarint(i - candidate, output);
+            i += length;
+            anchor = i;
+        }
+        PutVarint(size - anchor, output);
+        output.append(data + anchor, size - anchor);
+    }
+
+    bool Decompress(const char* data, size_t size, std::string& block) const override {
+        block.clear();
+        const char* end = data + size;
+        while (data < end) {
+            uint64_t literals = 0;
+            if (!GetVarint(data, end, literals) || literals > static_cast<uint64_t>(end - data)) {
+                return false;
+            }
+            block.append(data, literals);
+            data += literals;
+            if (data == end) {
+                break;
+            }
+            uint64_t length = 0;
+            uint64_t distance = 0;
+            if (!GetVarint(data, end, length) || !GetVarint(data, end, distance) || distance == 0 || distance > block.size()) {
+                return false;
+            }
+            length += MIN_MATCH;
+            // The match may overlap the bytes it produces, so it is copied byte by byte.
+            size_t from = block.size() - distance;
+            for (size_t i = 0; i < length; ++i) {
+                block.push_back(block[from + i]);
+            }
+        }
+        return true;
+    }
+
+private:
+    static uint32_t Hash(const char* data) {
+        uint32_t word;
+        memcpy(&word, data, sizeof(word));
+        return (word * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    static constexpr size_t MIN_MATCH = 4;
+    static constexpr size_t MAX_DISTANCE = 64 * 1024;
+    static constexpr size_t HASH_BITS = 12;
+    static constexpr size_t HASH_TABLE_SIZE = 1 << HASH_BITS;
+    static constexpr uint32_t NO_POSITION = UINT32_MAX;
+};
+
+// Every key is stored as the difference from the previous key of the block: the length of
+// their common prefix and the rest of the key, lengths are varints. Sorted integer keys written
+// big-endian differ from the previous key in their last bytes only, so they take a few bytes.
+// An entry is [flag][common prefix][key rest size][key rest][value size][value].
+class DeltaVarintCodec : public BlockCodec {
+public:
+    static constexpr uint8_t ID = 2;
+
+    uint8_t GetId() const override {
+        return ID;
+    }
+
+    void Compress(const std::string& block, const std::vector<BlockEntrySize>& entries, std::string& output) const override {
+        output.clear();
+        const char* data = block.data();
+        const char* previous_key = nullptr;
+        size_t previous_key_size = 0;
+        for (auto& entry : entries) {
+            const char* key = data + 1;
+            size_t prefix = 0;
+            while (prefix < entry.KeySize && prefix < previous_key_size && key[prefix] == previous_key[prefix]) {
+                ++prefix;
+            }
+            output.push_back(data[0]);
+            PutVarint(prefix, output);
+            PutVarint(entry.KeySize - prefix, output);
+            output.append(key + prefix, entry.KeySize - prefix);
+            PutVarint(entry.ValueSize, output);
+            output.append(key + entry.KeySize, entry.ValueSize);
+            previous_key = key;
+            previous_key_size = entry.KeySize;
+            data += 1 + entry.KeySize + entry.ValueSize;
+        }
+    }
+
+    bool Decompress(const char* data, size_t size, std::string& block) const override {
+        block.clear();
+        const char* end = data + size;
+        std::string key;
+        while (data < end) {
+            char flag = *data++;
+            uint64_t prefix = 0;
+            uint64_t rest = 0;
+            uint64_t value_size = 0;
+            if (!GetVarint(data, end, prefix) || prefix > key.size() || !GetVarint(data, end, rest)
+                    || rest > static_cast<uint64_t>(end - data)) {
+                return false;
+            }
+            key.resize(prefix);
+            key.append(data, rest);
+            data += rest;
+            if (!GetVarint(data, end, value_size) || value_size > static_cast<uint64_t>(end - data)) {
+                return false;
+            }
+            block.push_back(flag);
+            block.append(key);
+            block.append(data, value_size);
+            data += value_size;
+        }
+        return true;
+    }
+};
+
+// Codecs by their identifiers, the built-in ones are always there.
+class BlockCodecRegistry {
+public:
+    static const BlockCodec* Get(uint8_t id) {
+        return GetCodecs()[id].get();
+    }
+
+    // Not synchronized with reads, codecs are registered before trees are opened.
+    static void Register(std::shared_ptr<BlockCodec> codec) {
+        GetCodecs()[codec->GetId()] = std::move(codec);
+    }
+
+private:
+    static std::array<std::shared_ptr<BlockCodec>, 256>& GetCodecs() {
+        static std::array<std::shared_ptr<BlockCodec>, 256> codecs = [] {
+            std::array<std::shared_ptr<BlockCodec>, 256> result;
+            result[StoredCodec::ID] = std::make_shared<StoredCodec>();
+            result[LZCodec::ID] = std::make_shared<LZCodec>();
+            result[DeltaVarintCodec::ID] = std::make_shared<DeltaVarintCodec>();
+            return result;
+        }();
+        return codecs;
+    }
+};
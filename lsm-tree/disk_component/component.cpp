@@ -1 +1,2 @@
 #include "component.h"
+#include "writer.h"
@@ -1,5 +1,16 @@
+#pragma once
+
 #include "../common/common.h"
+#include "../common/crc32c.h"
+#include "../common/direct_io.h"
+#include "../common/mapped_file.h"
+#include "../common/read_engine.h"
+#include "codec.h"
+#include "hash_index.h"
+#include "learned_index.h"
+#include "offset_index.h"
 
+#include <atomic>
 #include <fstream>
 #include <string>
 #include <vector>
@@ -7,9 +18,17 @@
 #include <iostream>
 #include <random>
 #include <bitset>
+#include <cstdio>
+#include <cstring>
+#include <optional>
 
 class DiskComponent {
 public:
+    // Appended to the name of the data file to get the name of its saved metadata.
+    static constexpr const char* METADATA_SUFFIX = ".meta";
+    // Entries are checksummed in blocks of this many, a block is checked as a whole.
+    static constexpr size_t CHECKSUM_BLOCK_SIZE = 64;
+
     DiskComponent(std::string file_name)
         : DataFileName_(file_name)
     {
@@ -25,57 +44,155 @@ public:
         const char* val_bytes = kvt.Value.c_str();
         size_t val_bytes_size = kvt.Value.size();
         if (!is_tmp) {
-            KVTSizes_.emplace_back(kvt.Key.size(), val_bytes_size);
-            KVTSizesPrefixSum_.push_back(KVTSizesPrefixSum_.back() + kvt.Key.size() + val_bytes_size + 1);
+            if (Index_.Size() == 0 && RangeTombstones_.Empty()) {
+                MinKey_ = kvt.Key;
+            }
+            MaxKey_ = kvt.Key;
+            if (Learned_) {
+                Learned_->Add(kvt.Key, Index_.Size());
+            }
+            if (Hash_) {
+                Hash_->Add(kvt.Key);
+            }
+            AddChecksum(BlockChecksums_, Index_.Size(), kvt);
+            Index_.Add(kvt.Key.size(), val_bytes_size);
             AddKey(kvt.Key);
+            Size_ = Index_.Size();
+            TombstonesCount_ += kvt.Tombstone;
         } else {
-            KVTSizesTmp_.emplace_back(kvt.Key.size(), val_bytes_size);
-            KVTSizesPrefixSumTmp_.push_back(KVTSizesPrefixSumTmp_.back() + kvt.Key.size() + val_bytes_size + 1);
+            if (IndexTmp_.Size() == 0) {
+                MinKeyTmp_ = kvt.Key;
+            }
+            MaxKeyTmp_ = kvt.Key;
+            AddChecksum(BlockChecksumsTmp_, IndexTmp_.Size(), kvt);
+            IndexTmp_.Add(kvt.Key.size(), val_bytes_size);
             AddKeyTmp(kvt.Key);
         }
+        if (!is_tmp && IsBlockLayout_) {
+            if (PendingEntries_.empty()) {
+                BlockFirstKeys_.push_back(kvt.Key);
+            }
+            PendingBlock_.push_back(GetFlag(kvt));
+            PendingBlock_.append(kvt.Key);
+            PendingBlock_.append(kvt.Value);
+            PendingEntries_.push_back({ kvt.Key.size(), val_bytes_size });
+            if (PendingEntries_.size() == CHECKSUM_BLOCK_SIZE) {
+                WritePendingBlock(file);
+            }
+            return;
+        }
         char buffer[2];
-        buffer[0] = kvt.Tombstone ? '1' : '0';
+        buffer[0] = GetFlag(kvt);
         fwrite(&buffer, sizeof(char), 1, file);
         fwrite(kvt.Key.c_str(), sizeof(char), kvt.Key.size(), file);
         fwrite(val_bytes, sizeof(char), val_bytes_size, file);
     }
 
-    void ReadKeyFromFile(size_t index, KVTombstone& result, FILE* file) {
-        size_t pos = KVTSizesPrefixSum_[index];
-        auto kvt_size = KVTSizes_[index];
+    // Blocks of the entries written after the call are compressed by the codec, the last block
+    // is written by FinishFile. Must be called before the first entry. Files without a codec
+    // are written as they are and read in place, compressed ones are read by whole blocks.
+    void SetCodec(std::shared_ptr<BlockCodec> codec) {
+        Codec_ = std::move(codec);
+        IsBlockLayout_ = (Codec_ != nullptr);
+    }
+
+    // Also builds the hash index, which needs the number of entries.
+    void FinishFile(FILE* file) {
+        if (!PendingEntries_.empty()) {
+            WritePendingBlock(file);
+        }
+        if (Hash_) {
+            Hash_->Finish();
+        }
+    }
+
+    bool IsCompressed() {
+        return IsBlockLayout_;
+    }
+
+    // False if the entry could not be read whole (e.g. the file is shorter than its index).
+    bool ReadKeyFromFile(size_t index, KVTombstone& result, FILE* file) {
+        if (IsBlockLayout_) {
+            return ReadFromFile(index, result, file);
+        }
+        size_t pos = Index_.GetOffset(index);
+        size_t key_size = Index_.GetKeySize(index);
         fseek(file, pos, SEEK_SET);
+        ++DiskReads_;
 
-        char tmp_buffer[2];
-        fread(tmp_buffer, sizeof(char), 1, file);
+        char tmp_buffer[2] = {};
+        bool is_read = fread(tmp_buffer, sizeof(char), 1, file) == 1;
         result.Tombstone = (tmp_buffer[0] == '1');
+        result.IsValuePointer = (tmp_buffer[0] == '2');
 
-        char* buffer = new char[kvt_size.KeySize + 1];
-        fread(buffer, sizeof(char), kvt_size.KeySize, file);
-        result.Key = std::string(buffer, kvt_size.KeySize);
+        char* buffer = new char[key_size + 1];
+        is_read = fread(buffer, sizeof(char), key_size, file) == key_size && is_read;
+        result.Key = std::string(buffer, key_size);
         delete[] buffer;
+        return is_read;
     }
 
-    void ReadFromFile(size_t index, KVTombstone& result, FILE* file) {
-        size_t pos = KVTSizesPrefixSum_[index];
-        auto kvt_size = KVTSizes_[index];
-        ReadKeyFromFile(index, result, file);
-        char* buffer = new char[kvt_size.ValueSize + 1];
-        fread(buffer, sizeof(char), kvt_size.ValueSize, file);
-        result.Value = std::string(buffer, kvt_size.ValueSize);
+    bool ReadFromFile(size_t index, KVTombstone& result, FILE* file) {
+        if (IsBlockLayout_) {
+            std::string block;
+            if (!ReadBlock(index / CHECKSUM_BLOCK_SIZE, file, block, false)) {
+                result = KVTombstone();
+                return false;
+            }
+            ParseEntry(index, block, result);
+            return true;
+        }
+        size_t value_size = Index_.GetValueSize(index);
+        bool is_read = ReadKeyFromFile(index, result, file);
+        char* buffer = new char[value_size + 1];
+        is_read = fread(buffer, sizeof(char), value_size, file) == value_size && is_read;
+        result.Value = std::string(buffer, value_size);
         delete[] buffer;
+        return is_read;
     }
 
-    GetResult Get(std::string& key) {
+    // With verify the block of the found entry is read whole and checked against its checksum.
+    GetResult Get(std::string& key, bool verify = false) {
         if (!CheckKey(key)) {
             return { false, V(), false };
         }
-        if (KVTSizes_.size() == 0) {
+        if (Index_.Size() == 0) {
             return { false, V(), false };
         }
         FILE* file = fopen(DataFileName_.c_str(), "rb");
-        size_t index = GetIndex(key, true, file);
+        if (IsBlockLayout_) {
+            auto result = GetFromFileBlock(key, file, verify);
+            fclose(file);
+            return result;
+        }
+        size_t index = 0;
+        if (HasHashIndex()) {
+            KVTombstone candidate;
+            auto found = Hash_->Find(key, [&](size_t i) {
+                ReadKeyFromFile(i, candidate, file);
+                return candidate.Key == key;
+            });
+            if (!found) {
+                fclose(file);
+                return { false, V(), false };
+            }
+            index = *found;
+        } else {
+            index = GetIndex(key, true, file);
+        }
         KVTombstone kvt;
-        ReadFromFile(index, kvt, file);
+        if (verify) {
+            std::string block;
+            if (!ReadBlock(index / CHECKSUM_BLOCK_SIZE, file, block)) {
+                fclose(file);
+                GetResult result;
+                result.IsCorrupted = true;
+                return result;
+            }
+            ParseEntry(index, block, kvt);
+        } else {
+            ReadFromFile(index, kvt, file);
+        }
         fclose(file);
         if (kvt.Key != key) {
             return { false, V(), false };
@@ -84,12 +201,90 @@ public:
             return { true, V(), true };
         }
 
-        return { true, std::move(kvt.Value), false };
+        return { true, std::move(kvt.Value), false, kvt.IsValuePointer };
     }
 
-    void GetQuery(std::string& start_key, std::string& end_key, std::vector<KVTombstone>& result_values) {
-        if (KVTSizes_.size() == 0) {
-            return;
+    // False if the filter guarantees the key is not in the component.
+    bool MayContain(std::string& key) {
+        return CheckKey(key);
+    }
+
+    // Same as Get, but the value is a view into the mapped file instead of a copy.
+    // The filter is not checked, callers check MayContain first.
+    PinnedGetResult GetPinned(std::string& key, bool verify = false) {
+        PinnedGetResult result;
+        if (Index_.Size() == 0) {
+            return result;
+        }
+        if (!IsBlockLayout_ && (!Mapping_ || Mapping_->GetSize() < Index_.GetBytes())) {
+            Mapping_ = std::make_shared<MappedFile>(DataFileName_);
+        }
+        if (IsBlockLayout_ || !Mapping_->IsValid() || Mapping_->GetSize() < Index_.GetBytes()) {
+            auto get_result = Get(key, verify);
+            result.IsFound = get_result.IsFound;
+            result.IsDeleted = get_result.IsDeleted;
+            result.IsValuePointer = get_result.IsValuePointer;
+            result.IsCorrupted = get_result.IsCorrupted;
+            result.Value.PinString(std::move(get_result.Value));
+            return result;
+        }
+
+        const char* data = Mapping_->GetData();
+        auto key_at = [&](size_t index) {
+            return std::string_view(data + Index_.GetOffset(index) + 1, Index_.GetKeySize(index));
+        };
+        size_t L = 0;
+        size_t R = Index_.Size();
+        if (HasHashIndex()) {
+            auto found = Hash_->Find(key, [&](size_t i) { return key_at(i) == key; });
+            if (!found) {
+                return result;
+            }
+            L = R = *found;
+        } else if (Learned_) {
+            auto [first, last] = Learned_->GetRange(key, Index_.Size());
+            if ((first == 0 || key_at(first - 1) < key) && (last + 1 == Index_.Size() || !(key_at(last + 1) < key))) {
+                L = first;
+                R = last + 1;
+            }
+        }
+        while (L < R) {
+            size_t M = (L + R) / 2;
+            if (key_at(M) < key) {
+                L = M + 1;
+            } else {
+                R = M;
+            }
+        }
+        if (verify) {
+            size_t block = std::min(L, Index_.Size() - 1) / CHECKSUM_BLOCK_SIZE;
+            size_t start = GetBlockStart(block);
+            if (Crc32c::Value(data + start, GetBlockStart(block + 1) - start) != BlockChecksums_[block]) {
+                result.IsCorrupted = true;
+                return result;
+            }
+        }
+        if (L == Index_.Size() || key_at(L) != key) {
+            return result;
+        }
+
+        const char* entry = data + Index_.GetOffset(L);
+        result.IsFound = true;
+        result.IsDeleted = (entry[0] == '1');
+        result.IsValuePointer = (entry[0] == '2');
+        if (!result.IsDeleted) {
+            result.Value.Pin(Mapping_, std::string_view(entry + 1 + Index_.GetKeySize(L), Index_.GetValueSize(L)));
+        }
+        return result;
+    }
+
+    // With verify every block the entries are read from is checked, false if one of them does not
+    // match its checksum (the entries of the blocks before it are added). With an engine the entries
+    // are read by blocks, as many blocks at once as the engine takes.
+    bool GetQuery(std::string& start_key, std::string& end_key, std::vector<KVTombstone>& result_values, bool verify = false,
+                  ReadEngine* engine = nullptr) {
+        if (Index_.Size() == 0) {
+            return true;
         }
         FILE* file = fopen(DataFileName_.c_str(), "rb");
         size_t start_index = GetIndex(start_key, true, file);
@@ -98,13 +293,41 @@ public:
         ReadKeyFromFile(start_index, kvt, file);
         if (kvt.Key < start_key || kvt.Key > end_key) {
             fclose(file);
-            return;
+            return true;
         }
+        size_t batch_size = engine ? std::max<size_t>(engine->GetQueueDepth(), 1) : 1;
+        std::vector<std::string> blocks;
+        size_t first_block = 0;
         for (size_t i = start_index; i < end_index + 1; ++i) {
-            ReadFromFile(i, kvt, file);
+            if (!verify && !IsBlockLayout_ && !engine) {
+                ReadFromFile(i, kvt, file);
+            } else {
+                size_t block = i / CHECKSUM_BLOCK_SIZE;
+                if (blocks.empty() || block >= first_block + blocks.size()) {
+                    first_block = block;
+                    blocks.resize(std::min(batch_size, end_index / CHECKSUM_BLOCK_SIZE - block + 1));
+                    if (!ReadBlocks(first_block, blocks, file, engine, verify)) {
+                        fclose(file);
+                        return false;
+                    }
+                }
+                ParseEntry(i, blocks[block - first_block], kvt);
+            }
             result_values.push_back(kvt);
         }
         fclose(file);
+        return true;
+    }
+
+    // Index of the first entry with a key not less than the given one.
+    size_t LowerBound(std::string& key, FILE* file) {
+        if (Index_.Size() == 0) {
+            return 0;
+        }
+        size_t index = GetIndex(key, true, file);
+        KVTombstone kvt;
+        ReadKeyFromFile(index, kvt, file);
+        return kvt.Key < key ? Index_.Size() : index;
     }
 
     void Delete(std::string& key) {
@@ -133,41 +356,439 @@ public:
         ++Size_;
     }
 
+    // Range tombstones of a component delete keys of older components only, so they must be
+    // added after all the entries and inside the key range the component owns in its run.
+    void AddRangeTombstone(const RangeTombstone& range_tombstone) {
+        if (!(range_tombstone.Start < range_tombstone.End)) {
+            return;
+        }
+        if (Index_.Size() == 0 && RangeTombstones_.Empty()) {
+            MinKey_ = range_tombstone.Start;
+            MaxKey_ = range_tombstone.End;
+        } else {
+            MinKey_ = std::min(MinKey_, range_tombstone.Start);
+            MaxKey_ = std::max(MaxKey_, range_tombstone.End);
+        }
+        RangeTombstones_.Add(range_tombstone);
+    }
+
+    const RangeTombstoneSet& GetRangeTombstones() {
+        return RangeTombstones_;
+    }
+
+    bool IsRangeDeleted(const K& key) {
+        return RangeTombstones_.Covers(key);
+    }
+
+    size_t GetTombstonesCount() {
+        return TombstonesCount_;
+    }
+
+    // Size of the data file, smaller than the size of the entries if the file is compressed.
+    size_t GetBytes() {
+        return IsBlockLayout_ ? FileBytes_ : Index_.GetBytes();
+    }
+
+    // Memory taken by the positions of the entries.
+    size_t GetIndexMemoryUsage() {
+        size_t usage = Index_.GetMemoryUsage() + IndexTmp_.GetMemoryUsage() + (Learned_ ? Learned_->GetMemoryUsage() : 0);
+        usage += BlockOffsets_.capacity() * sizeof(size_t) + (Hash_ ? Hash_->GetMemoryUsage() : 0);
+        for (auto& key : BlockFirstKeys_) {
+            usage += sizeof(K) + key.capacity();
+        }
+        return usage;
+    }
+
+    // Builds a learned index over the keys written after the call, lookups then read only
+    // the entries around the predicted position. Must be called before the first entry.
+    // The model is not saved with the metadata, loaded components use binary search.
+    void EnableLearnedIndex(size_t max_error) {
+        Learned_.emplace(max_error);
+    }
+
+    bool HasLearnedIndex() {
+        return Learned_ && Learned_->GetSegmentsCount() > 0;
+    }
+
+    // Builds a hash index over the keys written after the call, point lookups then find their
+    // entry without a search (range queries still search). Must be called before the first entry,
+    // the index is built by FinishFile and saved with the metadata. A key the index does not have
+    // is not found without reading the file, so its block is not checked against the checksum.
+    void EnableHashIndex() {
+        Hash_.emplace();
+    }
+
+    bool HasHashIndex() {
+        return Hash_ && Hash_->IsBuilt();
+    }
+
+    bool VerifyBlock(size_t block, FILE* file) {
+        std::string buffer;
+        return ReadBlock(block, file, buffer);
+    }
+
+    // Reads all the entries of a block (decompressed), false if they can not be read or
+    // with verify do not match the checksum of the block.
+    bool ReadBlock(size_t block, FILE* file, std::string& buffer, bool verify = true) {
+        auto [start, end] = GetBlockRange(block);
+        std::string data(end - start, '\0');
+        ++DiskReads_;
+        fseek(file, start, SEEK_SET);
+        if (fread(data.data(), sizeof(char), data.size(), file) != data.size()) {
+            return false;
+        }
+        return DecodeBlock(block, data, buffer, verify);
+    }
+
+    // Same as ReadBlock for the blocks [first, first + buffers.size()), the reads are issued
+    // together through the engine. Without an engine the blocks are read one by one.
+    bool ReadBlocks(size_t first, std::vector<std::string>& buffers, FILE* file, ReadEngine* engine, bool verify = true) {
+        if (!engine) {
+            for (size_t i = 0; i < buffers.size(); ++i) {
+                if (!ReadBlock(first + i, file, buffers[i], verify)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        std::vector<std::string> data(buffers.size());
+        std::vector<ReadRequest> requests;
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            requests.push_back(PrepareBlockRead(first + i, file, data[i]));
+        }
+        if (!engine->ReadAll(requests)) {
+            return false;
+        }
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            if (!DecodeBlock(first + i, data[i], buffers[i], verify)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Request for the bytes of a block, the caller issues it and turns data into the entries
+    // of the block by DecodeBlock. Lets reads of blocks of different files go together.
+    ReadRequest PrepareBlockRead(size_t block, FILE* file, std::string& data) {
+        auto [start, end] = GetBlockRange(block);
+        data.resize(end - start);
+        ++DiskReads_;
+        return { fileno(file), start, end - start, data.data() };
+    }
+
+    // Entries of a block from the bytes of its range, which are decompressed for compressed files.
+    bool DecodeBlock(size_t block, std::string& data, std::string& buffer, bool verify) {
+        if (!IsBlockLayout_) {
+            buffer.swap(data);
+        } else {
+            uint32_t data_size = 0;
+            if (data.size() < BLOCK_HEADER_SIZE) {
+                return false;
+            }
+            memcpy(&data_size, data.data() + 1, sizeof(data_size));
+            const BlockCodec* codec = BlockCodecRegistry::Get(static_cast<uint8_t>(data[0]));
+            if (!codec || data_size != data.size() - BLOCK_HEADER_SIZE
+                    || !codec->Decompress(data.data() + BLOCK_HEADER_SIZE, data_size, buffer)
+                    || buffer.size() != GetBlockStart(block + 1) - GetBlockStart(block)) {
+                return false;
+            }
+        }
+        return !verify || Crc32c::Value(buffer.data(), buffer.size()) == BlockChecksums_[block];
+    }
+
+    size_t GetBlocksCount() {
+        return (Index_.Size() + CHECKSUM_BLOCK_SIZE - 1) / CHECKSUM_BLOCK_SIZE;
+    }
+
+    // Block which holds the key if the file has it. The block is known without reading the file
+    // for compressed files only (by the first keys of the blocks), std::nullopt for the others.
+    std::optional<size_t> FindBlock(const K& key) {
+        if (!IsBlockLayout_ || Index_.Size() == 0) {
+            return std::nullopt;
+        }
+        auto it = std::upper_bound(BlockFirstKeys_.begin(), BlockFirstKeys_.end(), key);
+        return it == BlockFirstKeys_.begin() ? 0 : it - BlockFirstKeys_.begin() - 1;
+    }
+
+    // Same as Get for the entries of a block read by ReadBlock or ReadBlocks.
+    GetResult GetFromBlock(const K& key, size_t block, const std::string& buffer) {
+        size_t first = block * CHECKSUM_BLOCK_SIZE;
+        size_t last = std::min(first + CHECKSUM_BLOCK_SIZE, Index_.Size());
+        size_t block_start = GetBlockStart(block);
+        auto key_at = [&](size_t index) {
+            return std::string_view(buffer.data() + Index_.GetOffset(index) - block_start + 1, Index_.GetKeySize(index));
+        };
+        auto L = first;
+        auto R = last;
+        if (HasHashIndex()) {
+            auto found = Hash_->Find(key, [&](size_t i) { return i >= first && i < last && key_at(i) == key; });
+            if (!found) {
+                return { false, V(), false };
+            }
+            L = R = *found;
+        }
+        while (L < R) {
+            size_t M = (L + R) / 2;
+            if (key_at(M) < key) {
+                L = M + 1;
+            } else {
+                R = M;
+            }
+        }
+        if (L == last || key_at(L) != key) {
+            return { false, V(), false };
+        }
+        KVTombstone kvt;
+        ParseEntry(L, buffer, kvt);
+        if (kvt.Tombstone) {
+            return { true, V(), true };
+        }
+        return { true, std::move(kvt.Value), false, kvt.IsValuePointer };
+    }
+
+    // Entry from the bytes of its block read by ReadBlock.
+    void ParseEntry(size_t index, const std::string& block, KVTombstone& result) {
+        const char* entry = block.data() + Index_.GetOffset(index) - GetBlockStart(index / CHECKSUM_BLOCK_SIZE);
+        size_t key_size = Index_.GetKeySize(index);
+        result.Tombstone = (entry[0] == '1');
+        result.IsValuePointer = (entry[0] == '2');
+        result.Key.assign(entry + 1, key_size);
+        result.Value.assign(entry + 1 + key_size, Index_.GetValueSize(index));
+    }
+
+    // Checks all the blocks of the data file.
+    bool VerifyChecksums(FILE* file) {
+        for (size_t block = 0; block < BlockChecksums_.size(); ++block) {
+            if (!VerifyBlock(block, file)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Reads from the data file done by lookups, for comparing the search methods.
+    size_t GetDiskReads() {
+        return DiskReads_.Get();
+    }
+
+    const K& GetMinKey() {
+        return MinKey_;
+    }
+
+    const K& GetMaxKey() {
+        return MaxKey_;
+    }
+
+    const std::string& GetFileName() {
+        return DataFileName_;
+    }
+
+    // The data file has no sizes of its entries, so everything needed to read it without
+    // the tree (sizes, key range, range tombstones and the filter) is saved separately.
+    bool SaveMetadata(const std::string& file_name) {
+        FILE* file = fopen(file_name.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        WriteNumber(Index_.Size(), file);
+        for (size_t i = 0; i < Index_.Size(); ++i) {
+            WriteNumber(Index_.GetKeySize(i), file);
+            WriteNumber(Index_.GetValueSize(i), file);
+        }
+        WriteNumber(TombstonesCount_, file);
+        WriteString(MinKey_, file);
+        WriteString(MaxKey_, file);
+        WriteNumber(RangeTombstones_.Size(), file);
+        for (auto& tombstone : RangeTombstones_.Get()) {
+            WriteString(tombstone.Start, file);
+            WriteString(tombstone.End, file);
+        }
+        fwrite(HashSeeds_.data(), sizeof(int), HASHES_LIST_LEN, file);
+        std::vector<unsigned char> filter_bytes(FILTER_BITS_LEN / 8, 0);
+        for (size_t i = 0; i < FILTER_BITS_LEN; ++i) {
+            filter_bytes[i / 8] |= FilterBits_[i] << (i % 8);
+        }
+        fwrite(filter_bytes.data(), sizeof(unsigned char), filter_bytes.size(), file);
+        WriteNumber(BlockChecksums_.size(), file);
+        fwrite(BlockChecksums_.data(), sizeof(uint32_t), BlockChecksums_.size(), file);
+        WriteNumber(IsBlockLayout_, file);
+        if (IsBlockLayout_) {
+            WriteNumber(FileBytes_, file);
+            for (size_t i = 0; i < BlockOffsets_.size(); ++i) {
+                WriteNumber(BlockOffsets_[i], file);
+                WriteString(BlockFirstKeys_[i], file);
+            }
+        }
+        WriteNumber(HasHashIndex(), file);
+        if (HasHashIndex()) {
+            Hash_->Save(file);
+        }
+        bool is_written = !ferror(file);
+        return fclose(file) == 0 && is_written;
+    }
+
+    bool LoadMetadata(const std::string& file_name) {
+        FILE* file = fopen(file_name.c_str(), "rb");
+        if (!file) {
+            return false;
+        }
+        Erase();
+        bool is_read = true;
+        size_t entries_count = 0;
+        is_read = is_read && ReadNumber(entries_count, file);
+        for (size_t i = 0; is_read && i < entries_count; ++i) {
+            size_t key_size = 0;
+            size_t value_size = 0;
+            is_read = ReadNumber(key_size, file) && ReadNumber(value_size, file);
+            Index_.Add(key_size, value_size);
+        }
+        size_t range_tombstones_count = 0;
+        is_read = is_read && ReadNumber(TombstonesCount_, file) && ReadString(MinKey_, file)
+            && ReadString(MaxKey_, file) && ReadNumber(range_tombstones_count, file);
+        for (size_t i = 0; is_read && i < range_tombstones_count; ++i) {
+            RangeTombstone tombstone;
+            is_read = ReadString(tombstone.Start, file) && ReadString(tombstone.End, file);
+            RangeTombstones_.Add(tombstone);
+        }
+        std::vector<unsigned char> filter_bytes(FILTER_BITS_LEN / 8, 0);
+        is_read = is_read && fread(HashSeeds_.data(), sizeof(int), HASHES_LIST_LEN, file) == HASHES_LIST_LEN
+            && fread(filter_bytes.data(), sizeof(unsigned char), filter_bytes.size(), file) == filter_bytes.size();
+        size_t checksums_count = 0;
+        is_read = is_read && ReadNumber(checksums_count, file)
+            && checksums_count == (entries_count + CHECKSUM_BLOCK_SIZE - 1) / CHECKSUM_BLOCK_SIZE;
+        if (is_read) {
+            BlockChecksums_.resize(checksums_count);
+            is_read = fread(BlockChecksums_.data(), sizeof(uint32_t), checksums_count, file) == checksums_count;
+        }
+        size_t is_block_layout = 0;
+        is_read = is_read && ReadNumber(is_block_layout, file);
+        IsBlockLayout_ = (is_block_layout != 0);
+        if (is_read && IsBlockLayout_) {
+            is_read = ReadNumber(FileBytes_, file);
+            BlockOffsets_.resize(checksums_count);
+            BlockFirstKeys_.resize(checksums_count);
+            for (size_t i = 0; is_read && i < checksums_count; ++i) {
+                is_read = ReadNumber(BlockOffsets_[i], file) && ReadString(BlockFirstKeys_[i], file);
+            }
+        }
+        size_t has_hash_index = 0;
+        is_read = is_read && ReadNumber(has_hash_index, file);
+        if (is_read && has_hash_index) {
+            Hash_.emplace();
+            is_read = Hash_->Load(file) && Hash_->IsBuilt();
+        }
+        fclose(file);
+        if (!is_read) {
+            Erase();
+            return false;
+        }
+        for (size_t i = 0; i < FILTER_BITS_LEN; ++i) {
+            FilterBits_[i] = (filter_bytes[i / 8] >> (i % 8)) & 1;
+        }
+        Size_ = Index_.Size();
+        return true;
+    }
+
+    void Remove() {
+        std::remove(DataFileName_.c_str());
+        Erase();
+    }
+
     void Erase() {
-        KVTSizes_ = {};
-        KVTSizesPrefixSum_ = { 0 };
-        KVTSizesTmp_ = {};
-        KVTSizesPrefixSumTmp_ = { 0 };
+        Mapping_.reset();
+        if (Learned_) {
+            Learned_->Clear();
+        }
+        if (Hash_) {
+            Hash_->Clear();
+        }
+        Index_.Clear();
+        IndexTmp_.Clear();
+        BlockChecksums_.clear();
+        BlockChecksumsTmp_.clear();
+        IsBlockLayout_ = (Codec_ != nullptr);
+        BlockOffsets_.clear();
+        BlockFirstKeys_.clear();
+        FileBytes_ = 0;
+        PendingBlock_.clear();
+        PendingEntries_.clear();
         Size_ = 0;
+        TombstonesCount_ = 0;
+        RangeTombstones_.Clear();
         FilterBits_ &= 0;
         FilterBitsTmp_ &= 0;
     }
 
     void SwapTmp() {
-        KVTSizes_ = KVTSizesTmp_;
-        KVTSizesPrefixSum_ = KVTSizesPrefixSumTmp_;
-        KVTSizesTmp_ = {};
-        KVTSizesPrefixSumTmp_ = { 0 };
-        Size_ = KVTSizes_.size();
+        Mapping_.reset();
+        Learned_.reset();
+        Hash_.reset();
+        Index_ = std::move(IndexTmp_);
+        IndexTmp_.Clear();
+        BlockChecksums_ = std::move(BlockChecksumsTmp_);
+        BlockChecksumsTmp_.clear();
+        // Temporary files are never compressed.
+        IsBlockLayout_ = false;
+        BlockOffsets_.clear();
+        BlockFirstKeys_.clear();
+        MinKey_ = std::move(MinKeyTmp_);
+        MaxKey_ = std::move(MaxKeyTmp_);
+        Size_ = Index_.Size();
         FilterBits_ = FilterBitsTmp_;
         FilterBitsTmp_ &= 0;
     }
 
 private:
-    struct KVTSize {
-        size_t KeySize;
-        size_t ValueSize;
-        size_t TmbSize = 1;
-
-        KVTSize(size_t key_size, size_t value_size)
-            : KeySize(key_size)
-            , ValueSize(value_size)
+    // Counter which is incremented from several threads and copied and moved with the component.
+    class RelaxedCounter {
+    public:
+        RelaxedCounter() = default;
+
+        RelaxedCounter(const RelaxedCounter& other)
+            : Value_(other.Get())
         {}
+
+        RelaxedCounter& operator=(const RelaxedCounter& other) {
+            Value_.store(other.Get(), std::memory_order_relaxed);
+            return *this;
+        }
+
+        RelaxedCounter& operator++() {
+            Value_.fetch_add(1, std::memory_order_relaxed);
+            return *this;
+        }
+
+        size_t Get() const {
+            return Value_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<size_t> Value_{0};
     };
 
+    // Get for a compressed file: the block of the key is known from the first keys of the blocks,
+    // so it is read once and searched in memory.
+    GetResult GetFromFileBlock(std::string& key, FILE* file, bool verify) {
+        size_t block_index = *FindBlock(key);
+        std::string block;
+        if (!ReadBlock(block_index, file, block, verify)) {
+            GetResult result;
+            result.IsCorrupted = verify;
+            return result;
+        }
+        return GetFromBlock(key, block_index, block);
+    }
+
     size_t GetIndex(std::string& key, bool is_first, FILE* file) {
+        if (IsBlockLayout_) {
+            return GetIndexInBlocks(key, is_first, file);
+        }
+        size_t index = 0;
+        if (HasLearnedIndex() && GetIndexLearned(key, is_first, file, index)) {
+            return index;
+        }
         long long L = is_first ? -1 : 0;
-        long long R = is_first ? KVTSizes_.size() - 1 : KVTSizes_.size();
+        long long R = is_first ? Index_.Size() - 1 : Index_.Size();
         bool exists = false;
         while (R - L > 1) {
             size_t M = (L + R) / 2;
@@ -190,16 +811,153 @@ private:
         return is_first ? R : L;
     }
 
+    // Same as GetIndex, but the keys around the position predicted by the learned index are
+    // read at once and searched in memory. False if the answer may be outside of them.
+    bool GetIndexLearned(std::string& key, bool is_first, FILE* file, size_t& result) {
+        size_t size = Index_.Size();
+        auto [first, last] = Learned_->GetRange(key, size);
+        size_t start = Index_.GetOffset(first);
+        std::string buffer(Index_.GetOffset(last + 1) - start, '\0');
+        fseek(file, start, SEEK_SET);
+        ++DiskReads_;
+        if (fread(buffer.data(), sizeof(char), buffer.size(), file) != buffer.size()) {
+            return false;
+        }
+        auto key_at = [&](size_t index) {
+            return std::string_view(buffer.data() + Index_.GetOffset(index) - start + 1, Index_.GetKeySize(index));
+        };
+        if (is_first) {
+            if (!(key_at(first) < key)) {
+                result = 0;
+                return first == 0;
+            }
+            for (size_t i = first + 1; i <= last; ++i) {
+                if (!(key_at(i) < key)) {
+                    result = i;
+                    return true;
+                }
+            }
+            result = size - 1;
+            return last == size - 1;
+        }
+        if (key_at(last) <= key) {
+            result = size - 1;
+            return last == size - 1;
+        }
+        for (size_t i = last; i-- > first;) {
+            if (key_at(i) <= key) {
+                result = i;
+                return true;
+            }
+        }
+        result = 0;
+        return first == 0;
+    }
+
+    // Same as GetIndex for a compressed file: the block is found by the first keys of the blocks
+    // and searched after it is read.
+    size_t GetIndexInBlocks(std::string& key, bool is_first, FILE* file) {
+        auto it = is_first ? std::lower_bound(BlockFirstKeys_.begin(), BlockFirstKeys_.end(), key)
+                           : std::upper_bound(BlockFirstKeys_.begin(), BlockFirstKeys_.end(), key);
+        size_t block_index = (it == BlockFirstKeys_.begin()) ? 0 : it - BlockFirstKeys_.begin() - 1;
+        size_t first = block_index * CHECKSUM_BLOCK_SIZE;
+        size_t last = std::min(first + CHECKSUM_BLOCK_SIZE, Index_.Size()) - 1;
+        std::string block;
+        if (!ReadBlock(block_index, file, block, false)) {
+            return first;
+        }
+        auto key_at = [&](size_t index) {
+            return std::string_view(block.data() + Index_.GetOffset(index) - GetBlockStart(block_index) + 1, Index_.GetKeySize(index));
+        };
+        if (is_first) {
+            for (size_t i = first; i <= last; ++i) {
+                if (!(key_at(i) < key)) {
+                    return i;
+                }
+            }
+            return std::min(last + 1, Index_.Size() - 1);
+        }
+        for (size_t i = last + 1; i-- > first;) {
+            if (key_at(i) <= key) {
+                return i;
+            }
+        }
+        return 0;
+    }
+
+    // Compresses the entries of the block collected by WriteToFile and writes them as
+    // [codec id][data size][data]. A block the codec does not make smaller is stored as it is.
+    void WritePendingBlock(FILE* file) {
+        std::string compressed;
+        Codec_->Compress(PendingBlock_, PendingEntries_, compressed);
+        uint8_t codec_id = Codec_->GetId();
+        const std::string* data = &compressed;
+        if (compressed.size() >= PendingBlock_.size()) {
+            codec_id = StoredCodec::ID;
+            data = &PendingBlock_;
+        }
+        char header[BLOCK_HEADER_SIZE];
+        header[0] = static_cast<char>(codec_id);
+        uint32_t data_size = data->size();
+        memcpy(header + 1, &data_size, sizeof(data_size));
+        fwrite(header, sizeof(char), BLOCK_HEADER_SIZE, file);
+        fwrite(data->data(), sizeof(char), data->size(), file);
+        BlockOffsets_.push_back(FileBytes_);
+        FileBytes_ += BLOCK_HEADER_SIZE + data->size();
+        PendingBlock_.clear();
+        PendingEntries_.clear();
+    }
+
+    // Range [start, end) of the bytes of a block in the data file.
+    std::pair<size_t, size_t> GetBlockRange(size_t block) {
+        if (!IsBlockLayout_) {
+            return { GetBlockStart(block), GetBlockStart(block + 1) };
+        }
+        size_t end = block + 1 < BlockOffsets_.size() ? BlockOffsets_[block + 1] : FileBytes_;
+        return { BlockOffsets_[block], std::max(end, BlockOffsets_[block]) };
+    }
+
+    // The checksum of the block is updated only if the block matched it before the change,
+    // so the change does not hide a corruption. Compressed files are not changed in place.
     void WriteTombstoneToFile(size_t index) {
+        if (IsBlockLayout_) {
+            return;
+        }
         FILE* file = fopen(DataFileName_.c_str(), "rb+");
-        size_t pos = KVTSizesPrefixSum_[index];
-        auto kvt_size = KVTSizes_[index];
+        size_t block_index = index / CHECKSUM_BLOCK_SIZE;
+        std::string block;
+        bool is_valid = ReadBlock(block_index, file, block);
+        size_t pos = Index_.GetOffset(index);
         fseek(file, pos, SEEK_SET);
 
         char buffer[2];
         buffer[0] = '1';
         fwrite(&buffer, sizeof(char), 1, file);
         fclose(file);
+        if (is_valid) {
+            block[pos - GetBlockStart(block_index)] = '1';
+            BlockChecksums_[block_index] = Crc32c::Value(block.data(), block.size());
+        }
+    }
+
+    // Offset of the first entry of a block, the size of the file for the block after the last one.
+    size_t GetBlockStart(size_t block) {
+        return Index_.GetOffset(std::min(block * CHECKSUM_BLOCK_SIZE, Index_.Size()));
+    }
+
+    static char GetFlag(const KVTombstone& kvt) {
+        return kvt.Tombstone ? '1' : (kvt.IsValuePointer ? '2' : '0');
+    }
+
+    // Continues the checksum of the block of the entry with the bytes written for it.
+    static void AddChecksum(std::vector<uint32_t>& checksums, size_t index, const KVTombstone& kvt) {
+        if (index % CHECKSUM_BLOCK_SIZE == 0) {
+            checksums.push_back(0);
+        }
+        char flag = GetFlag(kvt);
+        uint32_t checksum = Crc32c::Extend(checksums.back(), &flag, 1);
+        checksum = Crc32c::Extend(checksum, kvt.Key.data(), kvt.Key.size());
+        checksums.back() = Crc32c::Extend(checksum, kvt.Value.data(), kvt.Value.size());
     }
 
     void AddKey(std::string& key) {
@@ -226,17 +984,175 @@ private:
         return true;
     }
 
-    const size_t HASHES_LIST_LEN = 10;
-    const size_t FILTER_BITS_LEN = 32 * 1024;
+    static void WriteNumber(size_t number, FILE* file) {
+        fwrite(&number, sizeof(size_t), 1, file);
+    }
+
+    static bool ReadNumber(size_t& number, FILE* file) {
+        return fread(&number, sizeof(size_t), 1, file) == 1;
+    }
+
+    static void WriteString(const std::string& str, FILE* file) {
+        WriteNumber(str.size(), file);
+        fwrite(str.data(), sizeof(char), str.size(), file);
+    }
+
+    static bool ReadString(std::string& str, FILE* file) {
+        size_t size = 0;
+        if (!ReadNumber(size, file)) {
+            return false;
+        }
+        str.resize(size);
+        return fread(str.data(), sizeof(char), size, file) == size;
+    }
+
+    // Codec id and data size.
+    static constexpr size_t BLOCK_HEADER_SIZE = 5;
+    static constexpr size_t HASHES_LIST_LEN = 10;
+    static constexpr size_t FILTER_BITS_LEN = 32 * 1024;
 
     size_t Size_ = 0;
+    size_t TombstonesCount_ = 0;
+    RangeTombstoneSet RangeTombstones_;
     std::string DataFileName_;
-    std::vector<KVTSize> KVTSizes_;
-    std::vector<size_t> KVTSizesPrefixSum_ = { 0 };
-    std::vector<KVTSize> KVTSizesTmp_;
-    std::vector<size_t> KVTSizesPrefixSumTmp_ = { 0 };
+    OffsetIndex Index_;
+    OffsetIndex IndexTmp_;
+    std::vector<uint32_t> BlockChecksums_;
+    std::vector<uint32_t> BlockChecksumsTmp_;
+
+    // Compression of the file: the codec it is written with, file offsets and first keys
+    // of the written blocks and the entries of the block being collected.
+    std::shared_ptr<BlockCodec> Codec_;
+    bool IsBlockLayout_ = false;
+    std::vector<size_t> BlockOffsets_;
+    std::vector<K> BlockFirstKeys_;
+    size_t FileBytes_ = 0;
+    std::string PendingBlock_;
+    std::vector<BlockEntrySize> PendingEntries_;
+    std::optional<LearnedIndex> Learned_;
+    std::optional<HashIndex> Hash_;
+    // Subcompactions of a file which spans their bounds read it at the same time.
+    RelaxedCounter DiskReads_;
+    K MinKey_;
+    K MaxKey_;
+    K MinKeyTmp_;
+    K MaxKeyTmp_;
+
+    // Mapping of the data file for GetPinned, created on the first pinned read.
+    std::shared_ptr<MappedFile> Mapping_;
 
     std::vector<int> HashSeeds_;
     std::bitset<32 * 1024> FilterBits_;
     std::bitset<32 * 1024> FilterBitsTmp_;
 };
+
+// Reads the entries of a component in order. If bounds are set, only keys
+// from [start_key, end_key) are returned.
+class ComponentSource : public KVTSource {
+public:
+    // Entries or blocks which can not be read or decoded end the source and are counted in
+    // read_errors, so that a merge can tell a failed input from a finished one. With
+    // verify_checksums entries are read by whole blocks (as entries of compressed files always
+    // are) and a block which does not match its checksum is counted the same way. With an engine
+    // entries are read by blocks too, and the blocks ahead of the current one are read together
+    // with it. With bypass_cache the blocks are read in order by a DirectReader, which does not
+    // fill the page cache.
+    ComponentSource(DiskComponent& component, std::optional<K> start_key = std::nullopt, std::optional<K> end_key = std::nullopt,
+                    size_t* read_errors = nullptr, bool verify_checksums = false, ReadEngine* engine = nullptr, bool bypass_cache = false)
+        : Component_(component)
+        , File_(fopen(component.GetFileName().c_str(), "rb"))
+        , EndKey_(std::move(end_key))
+        , ReadErrors_(read_errors)
+        , VerifyChecksums_(verify_checksums)
+        , Engine_(engine)
+    {
+        if (bypass_cache) {
+            Reader_ = std::make_unique<DirectReader>(component.GetFileName());
+        }
+        if (!File_) {
+            Fail();
+            return;
+        }
+        if (start_key) {
+            Index_ = Component_.LowerBound(*start_key, File_);
+        }
+        Read();
+    }
+
+    ~ComponentSource() {
+        if (File_) {
+            fclose(File_);
+        }
+    }
+
+    bool IsValid() override {
+        return Index_ < Component_.GetSize();
+    }
+
+    KVTombstone& Current() override {
+        return Current_;
+    }
+
+    void Next() override {
+        ++Index_;
+        Read();
+    }
+
+private:
+    void Read() {
+        if (!IsValid()) {
+            return;
+        }
+        if (!VerifyChecksums_ && !Component_.IsCompressed() && !Engine_ && !Reader_) {
+            if (!Component_.ReadFromFile(Index_, Current_, File_)) {
+                Fail();
+                return;
+            }
+        } else {
+            size_t block = Index_ / DiskComponent::CHECKSUM_BLOCK_SIZE;
+            if (Reader_ && (Blocks_.empty() || block != FirstBlock_)) {
+                Blocks_.resize(1);
+                FirstBlock_ = block;
+                std::string data;
+                auto request = Component_.PrepareBlockRead(block, File_, data);
+                if (!Reader_->Read(request.Offset, request.Size, request.Buffer)
+                        || !Component_.DecodeBlock(block, data, Blocks_[0], VerifyChecksums_)) {
+                    Fail();
+                    return;
+                }
+            } else if (Blocks_.empty() || block < FirstBlock_ || block >= FirstBlock_ + Blocks_.size()) {
+                size_t batch_size = Engine_ ? std::max<size_t>(Engine_->GetQueueDepth(), 1) : 1;
+                FirstBlock_ = block;
+                Blocks_.resize(std::min(batch_size, Component_.GetBlocksCount() - block));
+                if (!Component_.ReadBlocks(block, Blocks_, File_, Engine_, VerifyChecksums_)) {
+                    Fail();
+                    return;
+                }
+            }
+            Component_.ParseEntry(Index_, Blocks_[block - FirstBlock_], Current_);
+        }
+        if (EndKey_ && Current_.Key >= *EndKey_) {
+            Index_ = Component_.GetSize();
+        }
+    }
+
+    void Fail() {
+        if (ReadErrors_) {
+            ++*ReadErrors_;
+        }
+        Index_ = Component_.GetSize();
+    }
+
+    DiskComponent& Component_;
+    FILE* File_;
+    std::optional<K> EndKey_;
+    size_t* ReadErrors_;
+    bool VerifyChecksums_;
+    ReadEngine* Engine_;
+    std::unique_ptr<DirectReader> Reader_;
+    size_t Index_ = 0;
+    KVTombstone Current_;
+    // Bytes of the blocks from FirstBlock_ on if the entries are read by blocks.
+    std::vector<std::string> Blocks_;
+    size_t FirstBlock_ = 0;
+};
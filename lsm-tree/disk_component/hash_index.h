@@ -0,0 +1,113 @@
+#pragma once
+
+#include "../common/common.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// Hash table from the keys of a component to the indexes of their entries, point lookups find
+// the entry without a search. Open addressing with linear probing over at least twice as many
+// slots as keys: a slot keeps the index of its entry + 1 (0 for an empty slot) and 8 more bits
+// of the hash of its key, so other keys of the same probe sequence are mostly skipped without
+// reading them. Keys are added while the file is written and the table is built by Finish,
+// when their number is known.
+class HashIndex {
+public:
+    // Keys must be added in the order of their entries.
+    void Add(const K& key) {
+        Hashes_.push_back(Hash(key));
+    }
+
+    void Finish() {
+        size_t slots_count = 1;
+        while (slots_count < 2 * Hashes_.size()) {
+            slots_count <<= 1;
+        }
+        Slots_.assign(slots_count, 0);
+        Tags_.assign(slots_count, 0);
+        for (size_t i = 0; i < Hashes_.size(); ++i) {
+            size_t slot = Hashes_[i] & (slots_count - 1);
+            while (Slots_[slot] != 0) {
+                slot = (slot + 1) & (slots_count - 1);
+            }
+            Slots_[slot] = i + 1;
+            Tags_[slot] = GetTag(Hashes_[i]);
+        }
+        Hashes_.clear();
+        Hashes_.shrink_to_fit();
+    }
+
+    bool IsBuilt() const {
+        return !Slots_.empty();
+    }
+
+    // Index of the entry of the key, is_key(index) tells whether the entry at index has the key.
+    // std::nullopt if the component does not have the key.
+    template <typename IsKey>
+    std::optional<size_t> Find(std::string_view key, IsKey&& is_key) const {
+        uint64_t hash = Hash(key);
+        uint8_t tag = GetTag(hash);
+        size_t mask = Slots_.size() - 1;
+        for (size_t slot = hash & mask; Slots_[slot] != 0; slot = (slot + 1) & mask) {
+            if (Tags_[slot] == tag && is_key(Slots_[slot] - 1)) {
+                return Slots_[slot] - 1;
+            }
+        }
+        return std::nullopt;
+    }
+
+    size_t GetMemoryUsage() const {
+        return sizeof(HashIndex) + Hashes_.capacity() * sizeof(uint64_t)
+            + Slots_.capacity() * sizeof(uint32_t) + Tags_.capacity() * sizeof(uint8_t);
+    }
+
+    void Clear() {
+        Hashes_.clear();
+        Slots_.clear();
+        Tags_.clear();
+    }
+
+    void Save(FILE* file) const {
+        size_t slots_count = Slots_.size();
+        fwrite(&slots_count, sizeof(size_t), 1, file);
+        fwrite(Slots_.data(), sizeof(uint32_t), slots_count, file);
+        fwrite(Tags_.data(), sizeof(uint8_t), slots_count, file);
+    }
+
+    // False if the file ends before the table or the table is malformed.
+    bool Load(FILE* file) {
+        size_t slots_count = 0;
+        if (fread(&slots_count, sizeof(size_t), 1, file) != 1 || (slots_count & (slots_count - 1)) != 0) {
+            return false;
+        }
+        Slots_.resize(slots_count);
+        Tags_.resize(slots_count);
+        return fread(Slots_.data(), sizeof(uint32_t), slots_count, file) == slots_count
+            && fread(Tags_.data(), sizeof(uint8_t), slots_count, file) == slots_count;
+    }
+
+    // FNV-1a with a final mix, so the low bits which pick the slot depend on every byte.
+    static uint64_t Hash(std::string_view key) {
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : key) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        }
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+private:
+    static uint8_t GetTag(uint64_t hash) {
+        return hash >> 56;
+    }
+
+    // Hashes of the added keys until the table is built.
+    std::vector<uint64_t> Hashes_;
+    std::vector<uint32_t> Slots_;
+    std::vector<uint8_t> Tags_;
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "../common/common.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// Piecewise linear model from the keys of a component to their positions. Keys are mapped to
+// numbers by their first 8 bytes, which keeps their order (keys with a common prefix of 8 bytes
+// get the same number and the position of the first of them). Segments are built in one pass
+// over the sorted keys: a segment is extended while some slope keeps every position it predicts
+// within max_error of the real one (the shrinking cone).
+class LearnedIndex {
+public:
+    LearnedIndex(size_t max_error)
+        : MaxError_(max_error)
+    {}
+
+    // Keys must be added in increasing order, positions are their indexes in the component.
+    void Add(const K& key, size_t position) {
+        uint64_t number = ToNumber(key);
+        if (!Segments_.empty() && number == LastNumber_) {
+            return;
+        }
+        LastNumber_ = number;
+        if (Segments_.empty()) {
+            StartSegment(number, position);
+            return;
+        }
+        auto& segment = Segments_.back();
+        double dx = static_cast<double>(number - segment.StartKey);
+        double dy = static_cast<double>(position) - static_cast<double>(segment.StartPosition);
+        double min_slope = std::max(MinSlope_, (dy - MaxError_) / dx);
+        double max_slope = std::min(MaxSlope_, (dy + MaxError_) / dx);
+        if (min_slope > max_slope) {
+            StartSegment(number, position);
+            return;
+        }
+        MinSlope_ = min_slope;
+        MaxSlope_ = max_slope;
+        segment.Slope = (MinSlope_ + MaxSlope_) / 2;
+    }
+
+    // Range of indexes [first, last] around the predicted position of the key, the first index
+    // with a key not less than the given one is expected strictly inside it.
+    std::pair<size_t, size_t> GetRange(const K& key, size_t size) const {
+        uint64_t number = ToNumber(key);
+        auto it = std::upper_bound(Segments_.begin(), Segments_.end(), number,
+            [](uint64_t number, const Segment& segment) { return number < segment.StartKey; });
+        if (it == Segments_.begin()) {
+            return { 0, std::min(size - 1, MaxError_ + 2) };
+        }
+        double predicted = std::prev(it)->StartPosition + std::prev(it)->Slope * static_cast<double>(number - std::prev(it)->StartKey);
+        if (it != Segments_.end()) {
+            predicted = std::min(predicted, static_cast<double>(it->StartPosition));
+        }
+        double first = std::floor(predicted) - MaxError_ - 2;
+        double last = std::ceil(predicted) + MaxError_ + 2;
+        size_t first_index = first <= 0 ? 0 : std::min(static_cast<size_t>(first), size - 1);
+        size_t last_index = std::min(static_cast<size_t>(std::max(last, 0.0)), size - 1);
+        return { first_index, last_index };
+    }
+
+    size_t GetSegmentsCount() const {
+        return Segments_.size();
+    }
+
+    size_t GetMaxError() const {
+        return MaxError_;
+    }
+
+    size_t GetMemoryUsage() const {
+        return sizeof(LearnedIndex) + Segments_.capacity() * sizeof(Segment);
+    }
+
+    void Clear() {
+        Segments_.clear();
+    }
+
+private:
+    struct Segment {
+        uint64_t StartKey;
+        size_t StartPosition;
+        double Slope = 0;
+    };
+
+    void StartSegment(uint64_t number, size_t position) {
+        Segments_.push_back({ number, position });
+        MinSlope_ = 0;
+        MaxSlope_ = std::numeric_limits<double>::infinity();
+    }
+
+    static uint64_t ToNumber(const K& key) {
+        uint64_t result = 0;
+        for (size_t i = 0; i < 8; ++i) {
+            result <<= 8;
+            if (i < key.size()) {
+                result |= static_cast<unsigned char>(key[i]);
+            }
+        }
+        return result;
+    }
+
+    size_t MaxError_;
+    std::vector<Segment> Segments_;
+    uint64_t LastNumber_ = 0;
+    double MinSlope_ = 0;
+    double MaxSlope_ = 0;
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Positions of the entries of a component file, every entry takes [1][key][value] bytes.
+// Entries are grouped into blocks of BLOCK_SIZE: a block keeps the offset of its first entry
+// and the smallest key size, the offsets and key sizes of its entries are bit-packed as
+// differences from them with as many bits as the block needs. Value sizes are not stored,
+// they follow from the offsets of neighbouring entries. Entries are added one by one into
+// an unpacked tail which is packed once it holds a whole block.
+// While all entries have the same key and value sizes (fixed-size keys and values) nothing is
+// stored per entry, offsets are computed from the index. The first entry of another size
+// switches the index to blocks.
+class OffsetIndex {
+public:
+    void Add(size_t key_size, size_t value_size) {
+        if (Size_ == 0) {
+            FixedKeySize_ = key_size;
+            FixedValueSize_ = value_size;
+        }
+        if (IsFixed_ && (key_size != FixedKeySize_ || value_size != FixedValueSize_)) {
+            Unfix();
+        }
+        if (IsFixed_) {
+            Bytes_ += 1 + key_size + value_size;
+            ++Size_;
+            return;
+        }
+        TailOffsets_.push_back(Bytes_);
+        TailKeySizes_.push_back(key_size);
+        Bytes_ += 1 + key_size + value_size;
+        ++Size_;
+        if (TailOffsets_.size() == BLOCK_SIZE) {
+            PackTail();
+        }
+    }
+
+    size_t Size() const {
+        return Size_;
+    }
+
+    // Total size of the entries, also the offset of the entry after the last one.
+    size_t GetBytes() const {
+        return Bytes_;
+    }
+
+    // All entries have the same size and their offsets are not stored.
+    bool IsFixed() const {
+        return IsFixed_;
+    }
+
+    size_t GetOffset(size_t index) const {
+        if (IsFixed_) {
+            return index * (1 + FixedKeySize_ + FixedValueSize_);
+        }
+        if (index == Size_) {
+            return Bytes_;
+        }
+        size_t block = index / BLOCK_SIZE;
+        if (block == Blocks_.size()) {
+            return TailOffsets_[index % BLOCK_SIZE];
+        }
+        auto& header = Blocks_[block];
+        size_t position = header.BitPosition + (index % BLOCK_SIZE) * header.OffsetBits;
+        return header.FirstOffset + ReadBits(position, header.OffsetBits);
+    }
+
+    size_t GetKeySize(size_t index) const {
+        if (IsFixed_) {
+            return FixedKeySize_;
+        }
+        size_t block = index / BLOCK_SIZE;
+        if (block == Blocks_.size()) {
+            return TailKeySizes_[index % BLOCK_SIZE];
+        }
+        auto& header = Blocks_[block];
+        size_t position = header.BitPosition + BLOCK_SIZE * header.OffsetBits + (index % BLOCK_SIZE) * header.KeySizeBits;
+        return header.MinKeySize + ReadBits(position, header.KeySizeBits);
+    }
+
+    size_t GetValueSize(size_t index) const {
+        if (IsFixed_) {
+            return FixedValueSize_;
+        }
+        return GetOffset(index + 1) - GetOffset(index) - 1 - GetKeySize(index);
+    }
+
+    // Bytes of memory taken by the index.
+    size_t GetMemoryUsage() const {
+        return sizeof(OffsetIndex) + Blocks_.capacity() * sizeof(BlockHeader) + Bits_.capacity() * sizeof(uint64_t)
+            + TailOffsets_.capacity() * sizeof(uint64_t) + TailKeySizes_.capacity() * sizeof(uint32_t);
+    }
+
+    void Clear() {
+        *this = OffsetIndex();
+    }
+
+private:
+    struct BlockHeader {
+        uint64_t FirstOffset;
+        uint64_t BitPosition;
+        uint32_t MinKeySize;
+        uint8_t OffsetBits;
+        uint8_t KeySizeBits;
+    };
+
+    // Adds the entries so far as stored ones.
+    void Unfix() {
+        size_t size = Size_;
+        IsFixed_ = false;
+        Size_ = 0;
+        Bytes_ = 0;
+        for (size_t i = 0; i < size; ++i) {
+            Add(FixedKeySize_, FixedValueSize_);
+        }
+    }
+
+    void PackTail() {
+        BlockHeader header;
+        header.FirstOffset = TailOffsets_.front();
+        header.BitPosition = BitsCount_;
+        header.MinKeySize = *std::min_element(TailKeySizes_.begin(), TailKeySizes_.end());
+        header.OffsetBits = GetBitWidth(TailOffsets_.back() - header.FirstOffset);
+        header.KeySizeBits = GetBitWidth(*std::max_element(TailKeySizes_.begin(), TailKeySizes_.end()) - header.MinKeySize);
+        for (auto offset : TailOffsets_) {
+            WriteBits(offset - header.FirstOffset, header.OffsetBits);
+        }
+        for (auto key_size : TailKeySizes_) {
+            WriteBits(key_size - header.MinKeySize, header.KeySizeBits);
+        }
+        Blocks_.push_back(header);
+        TailOffsets_.clear();
+        TailKeySizes_.clear();
+    }
+
+    static uint8_t GetBitWidth(uint64_t value) {
+        return value == 0 ? 0 : 64 - __builtin_clzll(value);
+    }
+
+    void WriteBits(uint64_t value, size_t width) {
+        if (width == 0) {
+            return;
+        }
+        size_t word = BitsCount_ / 64;
+        size_t shift = BitsCount_ % 64;
+        Bits_.resize((BitsCount_ + width + 63) / 64, 0);
+        Bits_[word] |= value << shift;
+        if (shift + width > 64) {
+            Bits_[word + 1] |= value >> (64 - shift);
+        }
+        BitsCount_ += width;
+    }
+
+    uint64_t ReadBits(size_t position, size_t width) const {
+        if (width == 0) {
+            return 0;
+        }
+        size_t word = position / 64;
+        size_t shift = position % 64;
+        uint64_t value = Bits_[word] >> shift;
+        if (shift + width > 64) {
+            value |= Bits_[word + 1] << (64 - shift);
+        }
+        return width == 64 ? value : value & ((uint64_t(1) << width) - 1);
+    }
+
+    static constexpr size_t BLOCK_SIZE = 64;
+
+    size_t Size_ = 0;
+    size_t Bytes_ = 0;
+    bool IsFixed_ = true;
+    size_t FixedKeySize_ = 0;
+    size_t FixedValueSize_ = 0;
+    std::vector<BlockHeader> Blocks_;
+    std::vector<uint64_t> Bits_;
+    size_t BitsCount_ = 0;
+    std::vector<uint64_t> TailOffsets_;
+    std::vector<uint32_t> TailKeySizes_;
+};
@@ -1,7 +1,9 @@
 #include "../component.h"
+#include "../writer.h"
 
 #include <gtest/gtest.h>
 #include <algorithm>
+#include <filesystem>
 #include <random>
 
 std::string GenString(size_t len) {
@@ -145,6 +147,559 @@ TEST(DiskComponentTest, TestQuery)
     }
 }
 
+TEST(DiskComponentTest, TestOffsetIndex)
+{
+    std::mt19937 g(42);
+    std::vector<std::pair<size_t, size_t>> sizes;
+    OffsetIndex index;
+    for (size_t i = 0; i < 10000; ++i) {
+        sizes.emplace_back(8 + g() % 8, g() % 100);
+        index.Add(sizes.back().first, sizes.back().second);
+    }
+    size_t offset = 0;
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        ASSERT_EQ(index.GetOffset(i), offset);
+        ASSERT_EQ(index.GetKeySize(i), sizes[i].first);
+        ASSERT_EQ(index.GetValueSize(i), sizes[i].second);
+        offset += 1 + sizes[i].first + sizes[i].second;
+    }
+    ASSERT_EQ(index.GetBytes(), offset);
+    ASSERT_EQ(index.GetOffset(sizes.size()), offset);
+    // 13 bits of offset and 3 bits of key size per entry, plus the block headers.
+    ASSERT_LT(index.GetMemoryUsage(), 4 * sizes.size());
+}
+
+TEST(DiskComponentTest, TestFixedOffsetIndex)
+{
+    OffsetIndex index;
+    for (size_t i = 0; i < 1000; ++i) {
+        index.Add(10, 10);
+    }
+    ASSERT_TRUE(index.IsFixed());
+    ASSERT_EQ(index.GetMemoryUsage(), sizeof(OffsetIndex));
+    ASSERT_EQ(index.GetOffset(999), 999 * 21);
+    ASSERT_EQ(index.GetOffset(1000), index.GetBytes());
+    ASSERT_EQ(index.GetValueSize(500), 10);
+
+    // A tombstone without a value switches the index to blocks.
+    index.Add(10, 0);
+    index.Add(10, 10);
+    ASSERT_FALSE(index.IsFixed());
+    ASSERT_EQ(index.Size(), 1002);
+    ASSERT_EQ(index.GetOffset(999), 999 * 21);
+    ASSERT_EQ(index.GetValueSize(999), 10);
+    ASSERT_EQ(index.GetValueSize(1000), 0);
+    ASSERT_EQ(index.GetOffset(1001), 1000 * 21 + 11);
+    ASSERT_EQ(index.GetBytes(), 1001 * 21 + 11);
+}
+
+TEST(DiskComponentTest, TestWriter)
+{
+    auto key_values = GenKeyValues(100);
+    sort(key_values.begin(), key_values.end());
+    ComponentWriter writer("writer.txt");
+    for (size_t i = 0; i < key_values.size(); ++i) {
+        if (i == 10) {
+            ASSERT_EQ(writer.Delete(key_values[i].first), true);
+        } else {
+            ASSERT_EQ(writer.Put(key_values[i].first, key_values[i].second), true);
+        }
+    }
+    ASSERT_EQ(writer.Put(key_values[0].first, key_values[0].second), false);
+    ASSERT_EQ(writer.Finish(), true);
+
+    DiskComponent cmp("writer.txt");
+    ASSERT_EQ(cmp.LoadMetadata(std::string("writer.txt") + DiskComponent::METADATA_SUFFIX), true);
+    ASSERT_EQ(cmp.GetSize(), key_values.size());
+    ASSERT_EQ(cmp.GetTombstonesCount(), 1);
+    ASSERT_EQ(cmp.GetMinKey(), key_values.front().first);
+    ASSERT_EQ(cmp.GetMaxKey(), key_values.back().first);
+    ASSERT_EQ(cmp.Get(key_values[10].first).IsDeleted, true);
+    for (size_t i = 11; i < key_values.size(); ++i) {
+        auto result = cmp.Get(key_values[i].first);
+        ASSERT_EQ(result.IsFound, true);
+        ASSERT_EQ(result.Value, key_values[i].second);
+    }
+}
+
+TEST(DiskComponentTest, TestLearnedIndex)
+{
+    auto key_values = GenKeyValues(5000);
+    sort(key_values.begin(), key_values.end());
+    DiskComponent cmp("learned.txt");
+    cmp.EnableLearnedIndex(4);
+    FILE* file = fopen("learned.txt", "wb");
+    for (size_t i = 0; i < key_values.size(); i += 2) {
+        KVTombstone kvt(key_values[i].first, key_values[i].second, false);
+        cmp.WriteToFile(kvt, file);
+    }
+    fclose(file);
+    ASSERT_EQ(cmp.HasLearnedIndex(), true);
+
+    size_t reads = cmp.GetDiskReads();
+    for (size_t i = 0; i < key_values.size(); i += 2) {
+        auto result = cmp.Get(key_values[i].first);
+        ASSERT_EQ(result.IsFound, true);
+        ASSERT_EQ(result.Value, key_values[i].second);
+        ASSERT_EQ(cmp.GetPinned(key_values[i].first).Value.View(), key_values[i].second);
+    }
+    // One read of the predicted range and one of the entry, instead of 12 reads of binary search.
+    ASSERT_LE(cmp.GetDiskReads() - reads, 2 * (key_values.size() / 2) + 100);
+    for (size_t i = 1; i < key_values.size(); i += 2) {
+        ASSERT_EQ(cmp.MayContain(key_values[i].first) && cmp.Get(key_values[i].first).IsFound, false);
+        ASSERT_EQ(cmp.GetPinned(key_values[i].first).IsFound, false);
+    }
+    std::string before_all = "";
+    std::string after_all = "~";
+    ASSERT_EQ(cmp.GetPinned(before_all).IsFound, false);
+    ASSERT_EQ(cmp.GetPinned(after_all).IsFound, false);
+
+    std::vector<KVTombstone> result;
+    cmp.GetQuery(key_values[101].first, key_values[201].first, result);
+    ASSERT_EQ(result.size(), 50);
+    ASSERT_EQ(result.front().Key, key_values[102].first);
+    ASSERT_EQ(result.back().Key, key_values[200].first);
+    result.clear();
+    cmp.GetQuery(before_all, after_all, result);
+    ASSERT_EQ(result.size(), key_values.size() / 2);
+}
+
+TEST(DiskComponentTest, TestCrc32c)
+{
+    std::string data = "123456789";
+    ASSERT_EQ(Crc32c::Value(data.data(), data.size()), 0xe3069283);
+    ASSERT_EQ(Crc32c::ExtendSoftware(0, data.data(), data.size()), 0xe3069283);
+    ASSERT_EQ(Crc32c::Extend(Crc32c::Value(data.data(), 4), data.data() + 4, 5), 0xe3069283);
+    std::string zeros(32, '\0');
+    ASSERT_EQ(Crc32c::Value(zeros.data(), zeros.size()), 0x8a9136aa);
+
+    auto text = GenString(1000);
+    ASSERT_EQ(Crc32c::Value(text.data(), text.size()), Crc32c::ExtendSoftware(0, text.data(), text.size()));
+}
+
+TEST(DiskComponentTest, TestChecksums)
+{
+    // Every entry takes 1 + 10 + 10 bytes.
+    auto key_values = GenKeyValues(500);
+    sort(key_values.begin(), key_values.end());
+    DiskComponent cmp("checksums.txt");
+    FILE* file = fopen("checksums.txt", "wb");
+    for (auto& kv : key_values) {
+        KVTombstone kvt(kv.first, kv.second, false);
+        cmp.WriteToFile(kvt, file);
+    }
+    fclose(file);
+    for (auto& kv : key_values) {
+        auto result = cmp.Get(kv.first, true);
+        ASSERT_EQ(result.IsCorrupted, false);
+        ASSERT_EQ(result.Value, kv.second);
+    }
+    cmp.Delete(key_values[5].first);
+    ASSERT_EQ(cmp.Get(key_values[5].first, true).IsDeleted, true);
+
+    file = fopen("checksums.txt", "rb+");
+    fseek(file, 200 * 21 + 15, SEEK_SET);
+    fputc('#', file);
+    fclose(file);
+    ASSERT_EQ(cmp.Get(key_values[200].first, true).IsCorrupted, true);
+    ASSERT_EQ(cmp.Get(key_values[200].first).IsFound, true);
+    ASSERT_EQ(cmp.GetPinned(key_values[210].first, true).IsCorrupted, true);
+    ASSERT_EQ(cmp.Get(key_values[100].first, true).Value, key_values[100].second);
+
+    std::vector<KVTombstone> result;
+    ASSERT_EQ(cmp.GetQuery(key_values[0].first, key_values[150].first, result, true), true);
+    ASSERT_EQ(result.size(), 151);
+    ASSERT_EQ(cmp.GetQuery(key_values[0].first, key_values[499].first, result, true), false);
+
+    size_t checksum_mismatches = 0;
+    size_t entries = 0;
+    for (ComponentSource source(cmp, std::nullopt, std::nullopt, &checksum_mismatches, true); source.IsValid(); source.Next()) {
+        ++entries;
+    }
+    ASSERT_EQ(checksum_mismatches, 1);
+    ASSERT_EQ(entries, 192);
+    ComponentSource source(cmp, key_values[195].first, std::nullopt, &checksum_mismatches, true);
+    ASSERT_EQ(source.IsValid(), false);
+    ASSERT_EQ(checksum_mismatches, 2);
+
+    ASSERT_EQ(cmp.SaveMetadata("checksums.meta"), true);
+    DiskComponent loaded("checksums.txt");
+    ASSERT_EQ(loaded.LoadMetadata("checksums.meta"), true);
+    ASSERT_EQ(loaded.Get(key_values[200].first, true).IsCorrupted, true);
+    ASSERT_EQ(loaded.Get(key_values[300].first, true).Value, key_values[300].second);
+}
+
+TEST(DiskComponentTest, TestCodecs)
+{
+    std::vector<BlockEntrySize> entries;
+    std::string block;
+    for (size_t i = 0; i < 64; ++i) {
+        std::string key = "key_" + std::to_string(100000 + i);
+        std::string value = i % 2 ? "value_value_value" : GenString(i);
+        block += (i % 3 ? '0' : '1') + key + value;
+        entries.push_back({ key.size(), value.size() });
+    }
+    LZCodec lz;
+    DeltaVarintCodec delta_varint;
+    for (BlockCodec* codec : std::vector<BlockCodec*>{ &lz, &delta_varint }) {
+        std::string compressed;
+        codec->Compress(block, entries, compressed);
+        ASSERT_LT(compressed.size(), block.size());
+        std::string decompressed;
+        ASSERT_EQ(codec->Decompress(compressed.data(), compressed.size(), decompressed), true);
+        ASSERT_EQ(decompressed, block);
+        ASSERT_EQ(BlockCodecRegistry::Get(codec->GetId()), BlockCodecRegistry::Get(codec->GetId()));
+    }
+
+    std::string text = GenString(1000);
+    std::string compressed;
+    lz.Compress(text, {}, compressed);
+    std::string decompressed;
+    ASSERT_EQ(lz.Decompress(compressed.data(), compressed.size(), decompressed), true);
+    ASSERT_EQ(decompressed, text);
+    std::string malformed = "\x05" "ab";
+    ASSERT_EQ(lz.Decompress(malformed.data(), malformed.size(), decompressed), false);
+    ASSERT_EQ(BlockCodecRegistry::Get(200), nullptr);
+}
+
+TEST(DiskComponentTest, TestCompressedComponent)
+{
+    std::vector<std::pair<std::string, std::string>> key_values;
+    for (size_t i = 0; i < 1000; ++i) {
+        key_values.emplace_back("key_" + std::to_string(100000 + i * 2), "value_" + std::to_string(i % 10) + "_value");
+    }
+    ComponentWriter writer("compressed.txt", std::make_shared<LZCodec>());
+    for (size_t i = 0; i < key_values.size(); ++i) {
+        if (i == 500) {
+            ASSERT_EQ(writer.Delete(key_values[i].first), true);
+        } else {
+            ASSERT_EQ(writer.Put(key_values[i].first, key_values[i].second), true);
+        }
+    }
+    ASSERT_EQ(writer.Finish(), true);
+
+    DiskComponent cmp("compressed.txt");
+    ASSERT_EQ(cmp.LoadMetadata(std::string("compressed.txt") + DiskComponent::METADATA_SUFFIX), true);
+    ASSERT_EQ(cmp.IsCompressed(), true);
+    // Every entry takes 1 + 10 + 13 bytes uncompressed.
+    ASSERT_LT(cmp.GetBytes(), key_values.size() * 24 / 2);
+    for (size_t i = 0; i < key_values.size(); ++i) {
+        auto result = cmp.Get(key_values[i].first, i % 2);
+        ASSERT_EQ(result.IsFound, true);
+        ASSERT_EQ(result.IsDeleted, i == 500);
+        if (i != 500) {
+            ASSERT_EQ(result.Value, key_values[i].second);
+            ASSERT_EQ(cmp.GetPinned(key_values[i].first, true).Value.View(), key_values[i].second);
+        }
+        std::string missing = key_values[i].first + "0";
+        ASSERT_EQ(cmp.Get(missing).IsFound, false);
+    }
+    std::string before_all = "a";
+    std::string after_all = "z";
+    ASSERT_EQ(cmp.GetPinned(before_all).IsFound, false);
+    ASSERT_EQ(cmp.GetPinned(after_all).IsFound, false);
+
+    std::vector<KVTombstone> result;
+    ASSERT_EQ(cmp.GetQuery(key_values[60].first, key_values[200].first, result), true);
+    ASSERT_EQ(result.size(), 141);
+    ASSERT_EQ(result.back().Value, key_values[200].second);
+
+    size_t checksum_mismatches = 0;
+    size_t entries = 0;
+    for (ComponentSource source(cmp, key_values[100].first, std::nullopt, &checksum_mismatches, true); source.IsValid(); source.Next()) {
+        ASSERT_EQ(source.Current().Key, key_values[100 + entries].first);
+        ++entries;
+    }
+    ASSERT_EQ(entries, 900);
+    ASSERT_EQ(checksum_mismatches, 0);
+}
+
+TEST(DiskComponentTest, TestReadEngine)
+{
+    std::string content = GenString(100000);
+    FILE* file = fopen("engine.txt", "wb");
+    fwrite(content.data(), sizeof(char), content.size(), file);
+    fclose(file);
+
+    std::vector<std::shared_ptr<ReadEngine>> engines = { std::make_shared<ThreadPoolReadEngine>(4), ReadEngine::Create(8) };
+#ifdef LSM_HAS_IO_URING
+    auto io_uring = std::make_shared<IoUringReadEngine>(8);
+    if (io_uring->IsValid()) {
+        ASSERT_EQ(io_uring->GetQueueDepth(), 8);
+        engines.push_back(io_uring);
+    }
+#endif
+    std::mt19937 gen(42);
+    file = fopen("engine.txt", "rb");
+    for (auto& engine : engines) {
+        // More reads than the queue takes at once.
+        std::vector<std::string> buffers(100);
+        std::vector<ReadRequest> requests;
+        for (auto& buffer : buffers) {
+            size_t offset = gen() % (content.size() - 1000);
+            buffer.resize(gen() % 1000 + 1);
+            requests.push_back({ fileno(file), offset, buffer.size(), buffer.data() });
+        }
+        ASSERT_EQ(engine->ReadAll(requests), true);
+        for (auto& request : requests) {
+            ASSERT_EQ(std::string(request.Buffer, request.Size), content.substr(request.Offset, request.Size));
+        }
+
+        std::string buffer(100, '\0');
+        std::vector<ReadRequest> past_end = { { fileno(file), content.size() - 10, buffer.size(), buffer.data() } };
+        ASSERT_EQ(engine->ReadAll(past_end), false);
+    }
+    fclose(file);
+}
+
+TEST(DiskComponentTest, TestBatchedReads)
+{
+    std::vector<std::pair<std::string, std::string>> key_values;
+    for (size_t i = 0; i < 1000; ++i) {
+        key_values.emplace_back("key_" + std::to_string(100000 + i * 2), "value_" + std::to_string(i));
+    }
+    auto engine = ReadEngine::Create(4);
+    for (auto codec : { std::shared_ptr<BlockCodec>(), std::shared_ptr<BlockCodec>(std::make_shared<LZCodec>()) }) {
+        ComponentWriter writer("batched.txt", codec);
+        for (auto& kv : key_values) {
+            ASSERT_EQ(writer.Put(kv.first, kv.second), true);
+        }
+        ASSERT_EQ(writer.Finish(), true);
+        DiskComponent cmp("batched.txt");
+        ASSERT_EQ(cmp.LoadMetadata(std::string("batched.txt") + DiskComponent::METADATA_SUFFIX), true);
+        ASSERT_EQ(cmp.GetBlocksCount(), 16);
+
+        std::vector<KVTombstone> result;
+        ASSERT_EQ(cmp.GetQuery(key_values[60].first, key_values[700].first, result, true, engine.get()), true);
+        ASSERT_EQ(result.size(), 641);
+        for (size_t i = 0; i < result.size(); ++i) {
+            ASSERT_EQ(result[i].Key, key_values[60 + i].first);
+            ASSERT_EQ(result[i].Value, key_values[60 + i].second);
+        }
+
+        size_t entries = 0;
+        for (ComponentSource source(cmp, key_values[100].first, key_values[900].first, nullptr, false, engine.get()); source.IsValid(); source.Next()) {
+            ASSERT_EQ(source.Current().Value, key_values[100 + entries].second);
+            ++entries;
+        }
+        ASSERT_EQ(entries, 800);
+
+        ASSERT_EQ(cmp.FindBlock(key_values[500].first).has_value(), codec != nullptr);
+        if (codec) {
+            FILE* file = fopen("batched.txt", "rb");
+            std::string block;
+            for (size_t i : { 0, 63, 64, 500, 999 }) {
+                size_t block_index = *cmp.FindBlock(key_values[i].first);
+                ASSERT_EQ(block_index, i / DiskComponent::CHECKSUM_BLOCK_SIZE);
+                ASSERT_EQ(cmp.ReadBlock(block_index, file, block), true);
+                ASSERT_EQ(cmp.GetFromBlock(key_values[i].first, block_index, block).Value, key_values[i].second);
+                std::string missing = key_values[i].first + "0";
+                ASSERT_EQ(cmp.GetFromBlock(missing, *cmp.FindBlock(missing), block).IsFound, false);
+            }
+            fclose(file);
+        }
+    }
+}
+
+TEST(DiskComponentTest, TestDirectReader)
+{
+    std::string content = GenString(300000);
+    FILE* file = fopen("direct.txt", "wb");
+    fwrite(content.data(), sizeof(char), content.size(), file);
+    fclose(file);
+
+    DirectReader reader("direct.txt", 10000);
+    ASSERT_EQ(reader.IsValid(), true);
+    std::mt19937 gen(42);
+    std::string buffer;
+    for (size_t offset = 0; offset < content.size();) {
+        buffer.resize(std::min<size_t>(gen() % 30000 + 1, content.size() - offset));
+        ASSERT_EQ(reader.Read(offset, buffer.size(), buffer.data()), true);
+        ASSERT_EQ(buffer, content.substr(offset, buffer.size()));
+        offset += buffer.size();
+    }
+    for (size_t i = 0; i < 100; ++i) {
+        size_t offset = gen() % content.size();
+        buffer.resize(std::min<size_t>(gen() % 100 + 1, content.size() - offset));
+        ASSERT_EQ(reader.Read(offset, buffer.size(), buffer.data()), true);
+        ASSERT_EQ(buffer, content.substr(offset, buffer.size()));
+    }
+    buffer.resize(100);
+    ASSERT_EQ(reader.Read(content.size() - 10, buffer.size(), buffer.data()), false);
+
+    auto key_values = GenKeyValues(1000);
+    std::sort(key_values.begin(), key_values.end());
+    for (auto codec : { std::shared_ptr<BlockCodec>(), std::shared_ptr<BlockCodec>(std::make_shared<LZCodec>()) }) {
+        ComponentWriter writer("direct_component.txt", codec);
+        for (auto& kv : key_values) {
+            ASSERT_EQ(writer.Put(kv.first, kv.second), true);
+        }
+        ASSERT_EQ(writer.Finish(), true);
+        DiskComponent cmp("direct_component.txt");
+        ASSERT_EQ(cmp.LoadMetadata(std::string("direct_component.txt") + DiskComponent::METADATA_SUFFIX), true);
+        size_t checksum_mismatches = 0;
+        size_t entries = 0;
+        for (ComponentSource source(cmp, key_values[10].first, std::nullopt, &checksum_mismatches, true, nullptr, true); source.IsValid(); source.Next()) {
+            ASSERT_EQ(source.Current().Key, key_values[10 + entries].first);
+            ASSERT_EQ(source.Current().Value, key_values[10 + entries].second);
+            ++entries;
+        }
+        ASSERT_EQ(entries, 990);
+        ASSERT_EQ(checksum_mismatches, 0);
+    }
+}
+
+// A source which can not read its file ends and counts the error without checksum verification.
+void CheckTruncatedSource(std::shared_ptr<BlockCodec> codec, ReadEngine* engine, bool bypass_cache) {
+    auto key_values = GenKeyValues(1000);
+    std::sort(key_values.begin(), key_values.end());
+    ComponentWriter writer("read_errors.txt", codec);
+    for (auto& kv : key_values) {
+        ASSERT_EQ(writer.Put(kv.first, kv.second), true);
+    }
+    ASSERT_EQ(writer.Finish(), true);
+    DiskComponent cmp("read_errors.txt");
+    ASSERT_EQ(cmp.LoadMetadata(std::string("read_errors.txt") + DiskComponent::METADATA_SUFFIX), true);
+    std::filesystem::resize_file("read_errors.txt", std::filesystem::file_size("read_errors.txt") * 3 / 4);
+
+    size_t read_errors = 0;
+    size_t entries = 0;
+    for (ComponentSource source(cmp, std::nullopt, std::nullopt, &read_errors, false, engine, bypass_cache); source.IsValid(); source.Next()) {
+        ASSERT_EQ(source.Current().Key, key_values[entries].first);
+        ++entries;
+    }
+    ASSERT_EQ(read_errors, 1);
+    ASSERT_GT(entries, 0);
+    ASSERT_LT(entries, key_values.size());
+}
+
+TEST(DiskComponentTest, TestSourceReadErrors)
+{
+    CheckTruncatedSource(nullptr, nullptr, false);
+    CheckTruncatedSource(std::make_shared<LZCodec>(), nullptr, false);
+    std::vector<std::shared_ptr<ReadEngine>> engines = { std::make_shared<ThreadPoolReadEngine>(4) };
+#ifdef LSM_HAS_IO_URING
+    auto io_uring = std::make_shared<IoUringReadEngine>(8);
+    if (io_uring->IsValid()) {
+        engines.push_back(io_uring);
+    }
+#endif
+    for (auto& engine : engines) {
+        CheckTruncatedSource(nullptr, engine.get(), false);
+        CheckTruncatedSource(std::make_shared<LZCodec>(), engine.get(), false);
+    }
+    CheckTruncatedSource(nullptr, nullptr, true);
+    CheckTruncatedSource(std::make_shared<LZCodec>(), nullptr, true);
+
+    // A compressed block which can not be decoded.
+    auto key_values = GenKeyValues(1000);
+    std::sort(key_values.begin(), key_values.end());
+    ComponentWriter writer("read_errors.txt", std::make_shared<LZCodec>());
+    for (auto& kv : key_values) {
+        ASSERT_EQ(writer.Put(kv.first, kv.second), true);
+    }
+    ASSERT_EQ(writer.Finish(), true);
+    DiskComponent cmp("read_errors.txt");
+    ASSERT_EQ(cmp.LoadMetadata(std::string("read_errors.txt") + DiskComponent::METADATA_SUFFIX), true);
+    FILE* file = fopen("read_errors.txt", "rb+");
+    std::string data;
+    auto request = cmp.PrepareBlockRead(3, file, data);
+    fseek(file, request.Offset, SEEK_SET);
+    fputc(0xff, file);
+    fclose(file);
+    size_t read_errors = 0;
+    size_t entries = 0;
+    for (ComponentSource source(cmp, std::nullopt, std::nullopt, &read_errors); source.IsValid(); source.Next()) {
+        ++entries;
+    }
+    ASSERT_EQ(read_errors, 1);
+    ASSERT_EQ(entries, 3 * DiskComponent::CHECKSUM_BLOCK_SIZE);
+}
+
+TEST(DiskComponentTest, TestPreallocate)
+{
+    FILE* file = fopen("preallocated.txt", "wb");
+    bool is_preallocated = FileHints::Preallocate(file, 1 << 20);
+    std::string content = GenString(5000);
+    fwrite(content.data(), sizeof(char), content.size(), file);
+    FileHints::Finish(file, is_preallocated, true);
+    fclose(file);
+    ASSERT_EQ(std::filesystem::file_size("preallocated.txt"), content.size());
+}
+
+TEST(DiskComponentTest, TestHashIndex)
+{
+    auto key_values = GenKeyValues(1000);
+    HashIndex index;
+    for (auto& kv : key_values) {
+        index.Add(kv.first);
+    }
+    index.Finish();
+    ASSERT_EQ(index.IsBuilt(), true);
+    for (size_t i = 0; i < key_values.size(); ++i) {
+        auto found = index.Find(key_values[i].first, [&](size_t j) { return key_values[j].first == key_values[i].first; });
+        ASSERT_EQ(found.has_value(), true);
+        ASSERT_EQ(*found, i);
+        std::string missing = key_values[i].first + "0";
+        ASSERT_EQ(index.Find(missing, [&](size_t j) { return key_values[j].first == missing; }).has_value(), false);
+    }
+
+    std::sort(key_values.begin(), key_values.end());
+    for (auto codec : { std::shared_ptr<BlockCodec>(), std::shared_ptr<BlockCodec>(std::make_shared<DeltaVarintCodec>()) }) {
+        DiskComponent binary("hash_binary.txt");
+        DiskComponent hashed("hash_index.txt");
+        hashed.EnableHashIndex();
+        for (auto* cmp : { &binary, &hashed }) {
+            cmp->SetCodec(codec);
+            FILE* file = fopen(cmp->GetFileName().c_str(), "wb");
+            for (size_t i = 0; i < key_values.size(); ++i) {
+                KVTombstone kvt(key_values[i].first, i == 500 ? "" : key_values[i].second, i == 500);
+                cmp->WriteToFile(kvt, file);
+            }
+            cmp->FinishFile(file);
+            fclose(file);
+        }
+        ASSERT_EQ(hashed.HasHashIndex(), true);
+        ASSERT_GT(hashed.GetIndexMemoryUsage(), binary.GetIndexMemoryUsage());
+        ASSERT_EQ(hashed.SaveMetadata(std::string("hash_index.txt") + DiskComponent::METADATA_SUFFIX), true);
+        DiskComponent loaded("hash_index.txt");
+        ASSERT_EQ(loaded.LoadMetadata(std::string("hash_index.txt") + DiskComponent::METADATA_SUFFIX), true);
+        ASSERT_EQ(loaded.HasHashIndex(), true);
+
+        for (auto* cmp : { &hashed, &loaded }) {
+            for (size_t i = 0; i < key_values.size(); ++i) {
+                auto result = cmp->Get(key_values[i].first, i % 2);
+                ASSERT_EQ(result.IsFound, true);
+                ASSERT_EQ(result.IsDeleted, i == 500);
+                auto pinned = cmp->GetPinned(key_values[i].first, true);
+                ASSERT_EQ(pinned.IsFound, true);
+                if (i != 500) {
+                    ASSERT_EQ(result.Value, key_values[i].second);
+                    ASSERT_EQ(pinned.Value.View(), key_values[i].second);
+                }
+                std::string missing = key_values[i].first + "0";
+                ASSERT_EQ(cmp->Get(missing).IsFound, false);
+                ASSERT_EQ(cmp->GetPinned(missing).IsFound, false);
+            }
+            std::vector<KVTombstone> result;
+            ASSERT_EQ(cmp->GetQuery(key_values[100].first, key_values[199].first, result), true);
+            ASSERT_EQ(result.size(), 100);
+        }
+        if (!codec) {
+            // A hash lookup reads the key of the entry and then the entry, a binary search reads about log2(1000) keys.
+            size_t reads = hashed.GetDiskReads();
+            size_t binary_reads = binary.GetDiskReads();
+            for (auto& kv : key_values) {
+                hashed.Get(kv.first);
+                binary.Get(kv.first);
+            }
+            ASSERT_LT(hashed.GetDiskReads() - reads, (binary.GetDiskReads() - binary_reads) / 3);
+        }
+        binary.Remove();
+        hashed.Remove();
+    }
+}
+
 int main(int argc, char** argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "component.h"
+
+#include <cstdio>
+#include <string>
+
+// Writes a component file in the format of the tree from entries added in increasing
+// order of keys, e.g. to build a dataset offline and pass it to LSMTree::IngestExternalFiles.
+// Finish saves the metadata of the component next to it.
+class ComponentWriter {
+public:
+    // An existing file is unlinked instead of truncated, it may be ingested into a tree already.
+    // The blocks of the file are compressed by the codec if it is set.
+    ComponentWriter(std::string file_name, std::shared_ptr<BlockCodec> codec = nullptr)
+        : Component_(std::move(file_name))
+        , File_(nullptr)
+    {
+        Component_.SetCodec(std::move(codec));
+        std::remove(Component_.GetFileName().c_str());
+        File_ = fopen(Component_.GetFileName().c_str(), "wb");
+    }
+
+    ComponentWriter(const ComponentWriter&) = delete;
+    ComponentWriter& operator=(const ComponentWriter&) = delete;
+
+    ~ComponentWriter() {
+        if (File_) {
+            fclose(File_);
+        }
+    }
+
+    // Both return false if the key is not greater than the previous one.
+    bool Put(const K& key, const V& value) {
+        KVTombstone kvt(key, value, false);
+        return Write(kvt);
+    }
+
+    bool Delete(const K& key) {
+        KVTombstone kvt(key, V(), true);
+        return Write(kvt);
+    }
+
+    bool Finish() {
+        if (!File_) {
+            return false;
+        }
+        Component_.FinishFile(File_);
+        bool is_written = !ferror(File_);
+        is_written = fclose(File_) == 0 && is_written;
+        File_ = nullptr;
+        return is_written && Component_.SaveMetadata(Component_.GetFileName() + DiskComponent::METADATA_SUFFIX);
+    }
+
+    size_t GetSize() {
+        return Component_.GetSize();
+    }
+
+private:
+    bool Write(KVTombstone& kvt) {
+        if (!File_ || (Component_.GetSize() > 0 && !(Component_.GetMaxKey() < kvt.Key))) {
+            return false;
+        }
+        Component_.WriteToFile(kvt, File_);
+        return true;
+    }
+
+    DiskComponent Component_;
+    FILE* File_;
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "../common/instrumentation.h"
+#include "../disk_component/codec.h"
+#include "../compaction/filter.h"
+#include "../compaction/policy.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Which reads check the blocks of files against their checksums.
+enum class EChecksumVerification {
+    Always,
+    CompactionOnly,
+    Never,
+};
+
+// Structure of the memtable.
+enum class EMemtableType {
+    BTree,
+    // Adaptive radix tree, lookups take O(key length) and do not depend on MinDegree.
+    AdaptiveRadixTree,
+};
+
+struct LSMOptions {
+    // Branching of the memtable B-tree.
+    size_t MinDegree = 2;
+    // Number of levels on disk, all entries stay in the memtable if zero.
+    size_t MaxComponents = 1;
+    // Size ratio of neighbouring levels, also the memtable size in entries.
+    size_t ComponentSizeMultiplier = 10;
+    // Leveled compaction with ComponentSizeMultiplier if not set.
+    std::shared_ptr<CompactionPolicy> Policy;
+    // Maximal number of entries in one file, ComponentSizeMultiplier ^ 2 if zero.
+    size_t MaxFileSize = 0;
+    // Number of threads a large compaction is split between.
+    size_t MaxSubcompactions = 1;
+    // Called for every live entry written by flushes and compactions (except trivial moves).
+    // Must be thread safe if MaxSubcompactions is greater than one.
+    std::shared_ptr<CompactionFilter> Filter;
+    // Values of at least this size are moved to the value log on flush and the LSM keeps
+    // only pointers to them. Disabled if zero.
+    size_t ValueLogThreshold = 0;
+    // Size in bytes after which a new value log file is started.
+    size_t ValueLogFileSize = 64 * 1024 * 1024;
+    // A value log file is collected when this share of its bytes was dropped by compactions.
+    double ValueLogGarbageRatio = 0.5;
+    // Capacity in bytes of the cache of values found on disk by Get. Disabled if zero.
+    size_t RowCacheSize = 0;
+    // Number of independently locked parts of the row cache.
+    size_t RowCacheShards = 16;
+    // Bytes per second compactions may write, unlimited if zero. Flushes are not limited.
+    size_t CompactionRateLimit = 0;
+    // Compactions run after one flush, the rest is left to the next flushes. Unlimited if zero.
+    size_t MaxCompactionsPerFlush = 0;
+    // Compaction debt (entries compactions have to rewrite) from which writes are limited
+    // to DelayedWriteRate bytes per second, and from which a writer has to wait for compactions.
+    // Disabled if zero.
+    size_t SlowdownCompactionDebt = 0;
+    size_t StopCompactionDebt = 0;
+    size_t DelayedWriteRate = 16 * 1024 * 1024;
+    // Latency histograms and trace events of operations, flushes and compactions. Disabled if not set.
+    std::shared_ptr<::Instrumentation> Instrumentation;
+    // Lookups check the block of the entry they read, merges and ingestion check every block
+    // they read. On a mismatch a lookup finds nothing and a merge is abandoned.
+    EChecksumVerification ChecksumVerification = EChecksumVerification::Always;
+    // Codecs compressing the blocks of files written by flushes and compactions to each level,
+    // Codecs[i] for level i and the last one for the levels below. Files are not compressed if
+    // the codec of their level is not set, e.g. { nullptr, nullptr, std::make_shared<LZCodec>() }.
+    std::vector<std::shared_ptr<BlockCodec>> Codecs;
+    // Maximal error in entries of the learned index built for every file written by flushes and
+    // compactions, lookups in a file then read about 2 * LearnedIndexError entries at once instead
+    // of a binary search over the file. Disabled if zero.
+    size_t LearnedIndexError = 0;
+    // Hash index of the keys of every file written by flushes and compactions, point lookups find
+    // their entry in a file without a binary search. Takes 10 to 20 bytes of memory per entry.
+    bool HashIndex = false;
+    // Block reads issued at once by MultiGet, range scans and compactions, through io_uring or
+    // a pool of this many threads where io_uring is not available. Reads are one by one if zero.
+    size_t ReadQueueDepth = 0;
+    // Compactions read their inputs with O_DIRECT (through the page cache, dropping what they read,
+    // where the file system does not support it) and drop the files they write from the page cache,
+    // so merges do not evict the blocks lookups use. Flushes keep their files in the cache.
+    bool CompactionBypassCache = false;
+    // Files written by compactions are preallocated with fallocate for MaxFileSize entries
+    // of the average size of the inputs, the unused part is released when the file is finished.
+    bool CompactionPreallocate = false;
+    EMemtableType MemtableType = EMemtableType::BTree;
+    // Size of every value, if all values have one size (TypedLSMTree sets it from a fixed-size
+    // value codec). Tombstones then get values of this many zero bytes, so the entries of
+    // a file keep one size and its offset index stores nothing per entry. Not used if zero.
+    size_t FixedValueSize = 0;
+    // Directory for the files of the tree, created if missing. The working directory if empty.
+    std::string Directory;
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "../common/common.h"
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Key to value LRU cache for point lookups. Keys are split between shards with their own locks,
+// every shard gets an equal part of the capacity in bytes.
+class RowCache {
+public:
+    RowCache(size_t capacity, size_t shards_count)
+        : ShardCapacity_(capacity / std::max<size_t>(shards_count, 1))
+    {
+        for (size_t i = 0; i < std::max<size_t>(shards_count, 1); ++i) {
+            Shards_.push_back(std::make_unique<Shard>());
+        }
+    }
+
+    bool Lookup(const K& key, PinnedValue& result_value) {
+        auto& shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.Mutex);
+        auto it = shard.Index.find(key);
+        if (it == shard.Index.end()) {
+            ++Misses_;
+            return false;
+        }
+        shard.Entries.splice(shard.Entries.begin(), shard.Entries, it->second);
+        result_value.Pin(it->second->Value, *it->second->Value);
+        ++Hits_;
+        return true;
+    }
+
+    void Insert(const K& key, std::shared_ptr<const V> value) {
+        size_t charge = GetCharge(key, *value);
+        if (charge > ShardCapacity_) {
+            return;
+        }
+        auto& shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.Mutex);
+        EraseFromShard(shard, key);
+        shard.Entries.push_front({ key, std::move(value), charge });
+        shard.Index[key] = shard.Entries.begin();
+        shard.Usage += charge;
+        while (shard.Usage > ShardCapacity_) {
+            EraseFromShard(shard, shard.Entries.back().Key);
+        }
+    }
+
+    void Erase(const K& key) {
+        auto& shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.Mutex);
+        EraseFromShard(shard, key);
+    }
+
+    void Clear() {
+        for (auto& shard : Shards_) {
+            std::lock_guard<std::mutex> lock(shard->Mutex);
+            shard->Entries.clear();
+            shard->Index.clear();
+            shard->Usage = 0;
+        }
+    }
+
+    size_t GetUsage() {
+        size_t usage = 0;
+        for (auto& shard : Shards_) {
+            std::lock_guard<std::mutex> lock(shard->Mutex);
+            usage += shard->Usage;
+        }
+        return usage;
+    }
+
+    size_t GetHits() const {
+        return Hits_;
+    }
+
+    size_t GetMisses() const {
+        return Misses_;
+    }
+
+private:
+    struct Entry {
+        K Key;
+        std::shared_ptr<const V> Value;
+        size_t Charge;
+    };
+
+    struct Shard {
+        std::mutex Mutex;
+        // Most recently used entries go first.
+        std::list<Entry> Entries;
+        std::unordered_map<K, std::list<Entry>::iterator> Index;
+        size_t Usage = 0;
+    };
+
+    // Bytes of the key and the value plus the bookkeeping of an entry.
+    static size_t GetCharge(const K& key, const V& value) {
+        return key.size() + value.size() + sizeof(Entry) + ENTRY_OVERHEAD;
+    }
+
+    Shard& GetShard(const K& key) {
+        return *Shards_[std::hash<K>{}(key) % Shards_.size()];
+    }
+
+    void EraseFromShard(Shard& shard, const K& key) {
+        auto it = shard.Index.find(key);
+        if (it == shard.Index.end()) {
+            return;
+        }
+        shard.Usage -= it->second->Charge;
+        shard.Entries.erase(it->second);
+        shard.Index.erase(it);
+    }
+
+    static constexpr size_t ENTRY_OVERHEAD = 64;
+
+    size_t ShardCapacity_;
+    std::vector<std::unique_ptr<Shard>> Shards_;
+    std::atomic<size_t> Hits_ = 0;
+    std::atomic<size_t> Misses_ = 0;
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "tree.h"
+
+#include <functional>
+#include <iterator>
+#include <mutex>
+
+// Independent trees with keys split between them by hash. Every shard has its own lock,
+// memtable and directory, so writes to different shards (and the flushes and compactions
+// they trigger) run in parallel.
+class ShardedLSMTree {
+public:
+    ShardedLSMTree(size_t shards_count, LSMOptions options = LSMOptions()) {
+        std::string directory = options.Directory;
+        if (!directory.empty() && directory.back() != '/') {
+            directory += '/';
+        }
+        std::shared_ptr<CompactionPolicy> policy = options.Policy;
+        for (size_t i = 0; i < std::max<size_t>(shards_count, 1); ++i) {
+            options.Directory = directory + "shard_" + std::to_string(i);
+            // Policies keep state between compactions, so every shard gets its own.
+            if (policy) {
+                options.Policy = policy->Clone();
+            }
+            Shards_.push_back(std::make_unique<Shard>(options));
+        }
+    }
+
+    bool Get(std::string& key, std::string& result_value) {
+        auto& shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.Mutex);
+        return shard.Tree.Get(key, result_value);
+    }
+
+    bool GetPinned(std::string& key, PinnedValue& result_value) {
+        auto& shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.Mutex);
+        return shard.Tree.GetPinned(key, result_value);
+    }
+
+    // Keys of the shards are disjoint, so their sorted results are merged. All shards are
+    // locked for the whole scan, so it never sees a part of a batch.
+    std::vector<std::pair<std::string, V>> GetQuery(std::string& start_key, std::string& end_key) {
+        auto locks = LockShards(std::vector<bool>(Shards_.size(), true));
+        std::vector<std::pair<std::string, V>> result;
+        for (auto& shard : Shards_) {
+            auto shard_result = shard->Tree.GetQuery(start_key, end_key);
+            size_t middle = result.size();
+            std::move(shard_result.begin(), shard_result.end(), std::back_inserter(result));
+            std::inplace_merge(result.begin(), result.begin() + middle, result.end());
+        }
+        return result;
+    }
+
+    void Add(std::string& key, std::string& value) {
+        auto& shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.Mutex);
+        shard.Tree.Add(key, value);
+    }
+
+    void Delete(std::string& key) {
+        auto& shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.Mutex);
+        shard.Tree.Delete(key);
+    }
+
+    // Every shard may have keys of the range, so the range is deleted in all of them
+    // under all their locks.
+    void DeleteRange(std::string& start_key, std::string& end_key) {
+        auto locks = LockShards(std::vector<bool>(Shards_.size(), true));
+        for (auto& shard : Shards_) {
+            shard->Tree.DeleteRange(start_key, end_key);
+        }
+    }
+
+    // Splits the batch between the shards and applies the parts while holding the locks of
+    // all touched shards, so readers see either the whole batch or none of it.
+    void Write(WriteBatch& batch) {
+        std::vector<WriteBatch> shard_batches(Shards_.size());
+        for (auto& operation : batch.GetOperations()) {
+            switch (operation.Type) {
+                case WriteBatch::EOperationType::Put:
+                    shard_batches[GetShardIndex(operation.Key)].Put(operation.Key, operation.Value);
+                    break;
+                case WriteBatch::EOperationType::Delete:
+                    shard_batches[GetShardIndex(operation.Key)].Delete(operation.Key);
+                    break;
+                case WriteBatch::EOperationType::DeleteRange:
+                    for (auto& shard_batch : shard_batches) {
+                        shard_batch.DeleteRange(operation.Key, operation.Value);
+                    }
+                    break;
+            }
+        }
+        std::vector<bool> touched(Shards_.size());
+        for (size_t i = 0; i < Shards_.size(); ++i) {
+            touched[i] = !shard_batches[i].Empty();
+        }
+        auto locks = LockShards(touched);
+        for (size_t i = 0; i < Shards_.size(); ++i) {
+            if (touched[i]) {
+                Shards_[i]->Tree.Write(shard_batches[i]);
+            }
+        }
+    }
+
+    LSMStats GetStats(size_t shard_index) {
+        std::lock_guard<std::mutex> lock(Shards_[shard_index]->Mutex);
+        return Shards_[shard_index]->Tree.GetStats();
+    }
+
+    size_t GetShardsCount() {
+        return Shards_.size();
+    }
+
+    size_t GetShardIndex(const K& key) {
+        return std::hash<K>{}(key) % Shards_.size();
+    }
+
+private:
+    struct Shard {
+        std::mutex Mutex;
+        LSMTree Tree;
+
+        Shard(LSMOptions options)
+            : Tree(std::move(options))
+        {}
+    };
+
+    Shard& GetShard(const K& key) {
+        return *Shards_[GetShardIndex(key)];
+    }
+
+    // Locks are always taken in the order of the shards, so operations over several shards
+    // never deadlock.
+    std::vector<std::unique_lock<std::mutex>> LockShards(const std::vector<bool>& shards) {
+        std::vector<std::unique_lock<std::mutex>> locks;
+        for (size_t i = 0; i < Shards_.size(); ++i) {
+            if (shards[i]) {
+                locks.emplace_back(Shards_[i]->Mutex);
+            }
+        }
+        return locks;
+    }
+
+    std::vector<std::unique_ptr<Shard>> Shards_;
+};
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstddef>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct LevelStats {
+    size_t Runs = 0;
+    size_t Files = 0;
+    size_t Entries = 0;
+    size_t Bytes = 0;
+    // Memory taken by the offset indexes of the files.
+    size_t IndexMemory = 0;
+};
+
+struct LSMStats {
+    // Shape of the tree at the moment the stats were taken.
+    size_t MemtableEntries = 0;
+    std::vector<LevelStats> Levels;
+    // Bytes of keys and values passed to Add and Delete.
+    size_t UserBytes = 0;
+    // Bytes written to disk by memtable flushes and by compactions.
+    size_t FlushBytes = 0;
+    size_t CompactionBytes = 0;
+    size_t Flushes = 0;
+    size_t Compactions = 0;
+    // Compactions which moved files to the next level without rewriting them.
+    size_t TrivialMoves = 0;
+    // Compactions split into several key ranges merged in parallel.
+    size_t ParallelCompactions = 0;
+    // Tombstones discarded by merges into the bottom of the tree.
+    size_t DroppedTombstones = 0;
+    // Entries removed by the compaction filter.
+    size_t FilteredEntries = 0;
+    // DeleteRange calls and entries physically removed by merges because of range tombstones.
+    size_t RangeDeletes = 0;
+    size_t RangeDeletedEntries = 0;
+    // Bytes appended to the value log (including garbage collection) and number of collected files.
+    size_t ValueLogBytes = 0;
+    size_t ValueLogCollections = 0;
+    // Batches applied by LSMTree::Write.
+    size_t WriteBatches = 0;
+    // Checkpoints created by LSMTree::CreateCheckpoint.
+    size_t Checkpoints = 0;
+    // Files added by LSMTree::IngestExternalFiles and the part of them which overlapped
+    // the first level and had to be merged into it.
+    size_t IngestedFiles = 0;
+    size_t IngestedFilesMerged = 0;
+    // Blocks found by lookups which could not be read or did not match their checksums.
+    size_t ChecksumMismatches = 0;
+    // Blocks of merge inputs which could not be read or decoded, or which did not match their
+    // checksums. A merge which finds one is abandoned and the tree stops taking writes.
+    size_t MergeReadErrors = 0;
+    // Lookups of the row cache and bytes it holds.
+    size_t RowCacheHits = 0;
+    size_t RowCacheMisses = 0;
+    size_t RowCacheUsage = 0;
+    // Entries compactions have to rewrite to bring the levels into shape.
+    size_t CompactionDebt = 0;
+    // Bytes compactions passed through the rate limiter and the time they waited for it.
+    size_t CompactionRateLimitedBytes = 0;
+    size_t CompactionRateLimitMicros = 0;
+    // Writes delayed by the write controller, their bytes and the time they waited, writers
+    // stopped to finish compactions and the time they spent on it.
+    size_t SlowedWrites = 0;
+    size_t SlowedWriteBytes = 0;
+    size_t WriteSlowdownMicros = 0;
+    size_t WriteStops = 0;
+    size_t WriteStopMicros = 0;
+    // Number of sorted runs (plus the memtable) a point lookup may have to probe.
+    size_t ReadAmplification = 0;
+    // Point lookups, lookups answered by the memtable and files read by lookups.
+    size_t Gets = 0;
+    size_t MemtableHits = 0;
+    size_t GetProbes = 0;
+    // Keys looked up by MultiGet and block reads it issued together, in this many batches.
+    size_t MultiGetKeys = 0;
+    size_t MultiGetBlockReads = 0;
+    size_t MultiGetBatches = 0;
+    // Files the filter excluded from a lookup and files read because of the filter
+    // although they did not have the key.
+    size_t FilterUseful = 0;
+    size_t FilterFalsePositives = 0;
+    // Time spent in flushes and in compactions (including trivial moves), the longest compaction.
+    size_t FlushMicros = 0;
+    size_t CompactionMicros = 0;
+    size_t MaxCompactionMicros = 0;
+
+    double WriteAmplification() const {
+        if (UserBytes == 0) {
+            return 0;
+        }
+        return static_cast<double>(FlushBytes + CompactionBytes + ValueLogBytes) / UserBytes;
+    }
+
+    double RowCacheHitRate() const {
+        if (RowCacheHits + RowCacheMisses == 0) {
+            return 0;
+        }
+        return static_cast<double>(RowCacheHits) / (RowCacheHits + RowCacheMisses);
+    }
+
+    double ProbesPerGet() const {
+        if (Gets == 0) {
+            return 0;
+        }
+        return static_cast<double>(GetProbes) / Gets;
+    }
+
+    double FilterFalsePositiveRate() const {
+        if (FilterUseful + FilterFalsePositives == 0) {
+            return 0;
+        }
+        return static_cast<double>(FilterFalsePositives) / (FilterUseful + FilterFalsePositives);
+    }
+
+    std::string ToString() const {
+        std::stringstream result;
+        result << "memtable: " << MemtableEntries << " entries\n";
+        for (size_t i = 0; i < Levels.size(); ++i) {
+            result << "level " << i << ": " << Levels[i].Runs << " runs, " << Levels[i].Files << " files, "
+                   << Levels[i].Entries << " entries, " << Levels[i].Bytes << " bytes, "
+                   << Levels[i].IndexMemory << " index bytes in memory\n";
+        }
+        result << "writes: " << UserBytes << " user bytes, " << FlushBytes << " flushed, "
+               << CompactionBytes << " compacted, " << ValueLogBytes << " to value log, "
+               << "write amplification " << WriteAmplification() << "\n";
+        result << "flushes: " << Flushes << ", " << FlushMicros << " us\n";
+        result << "compactions: " << Compactions << ", trivial moves " << TrivialMoves
+               << ", parallel " << ParallelCompactions << ", " << CompactionMicros << " us, longest "
+               << MaxCompactionMicros << " us, debt " << CompactionDebt << "\n";
+        result << "gets: " << Gets << ", memtable hits " << MemtableHits << ", probes per get " << ProbesPerGet()
+               << ", read amplification " << ReadAmplification << "\n";
+        result << "multi gets: " << MultiGetKeys << " keys, " << MultiGetBlockReads << " block reads in "
+               << MultiGetBatches << " batches\n";
+        result << "filter: " << FilterUseful << " useful, " << FilterFalsePositives << " false positives, "
+               << "false positive rate " << FilterFalsePositiveRate() << "\n";
+        result << "row cache: " << RowCacheHits << " hits, " << RowCacheMisses << " misses, "
+               << "hit rate " << RowCacheHitRate() << ", " << RowCacheUsage << " bytes\n";
+        result << "tombstones: " << DroppedTombstones << " dropped, " << RangeDeletes << " range deletes, "
+               << RangeDeletedEntries << " range deleted entries, " << FilteredEntries << " filtered entries\n";
+        result << "checksums: " << ChecksumMismatches << " mismatches, " << MergeReadErrors << " merge read errors\n";
+        result << "stalls: " << SlowedWrites << " slowed writes, " << WriteSlowdownMicros << " us, "
+               << WriteStops << " stops, " << WriteStopMicros << " us, rate limiter "
+               << CompactionRateLimitMicros << " us\n";
+        return result.str();
+    }
+};
+
+// Counters of one merge, added to LSMStats when the merge is finished.
+struct MergeStats {
+    size_t WrittenBytes = 0;
+    size_t DroppedTombstones = 0;
+    size_t FilteredEntries = 0;
+    size_t RangeDeletedEntries = 0;
+    size_t ReadErrors = 0;
+};
@@ -1 +1,2 @@
 #include "tree.h"
+#include "sharded_tree.h"
@@ -1,75 +1,259 @@
+#pragma once
+
+#include "../art/art.h"
 #include "../b-tree/b_tree.h"
+#include "../compaction/filter.h"
+#include "../compaction/merge_iterator.h"
+#include "../compaction/policy.h"
+#include "../common/instrumentation.h"
+#include "../common/rate_limiter.h"
+#include "../common/thread_pool.h"
 #include "../disk_component/component.h"
+#include "../disk_component/writer.h"
+#include "../value_log/value_log.h"
+#include "options.h"
+#include "row_cache.h"
+#include "write_controller.h"
+#include "stats.h"
+#include "write_batch.h"
 
 #include <algorithm>
+#include <atomic>
 #include <bitset>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
 #include <map>
+#include <set>
+#include <memory>
+
+// Files of one sorted run, ordered by key and with disjoint key ranges.
+using SortedRun = std::vector<DiskComponent>;
 
 class LSMTree {
 public:
-    LSMTree(size_t min_degree = 2, size_t max_components = 1, size_t component_size_multiplier = 10)
-        : MaxComponents_(max_components)
-        , ComponentSizeMultiplier_(component_size_multiplier)
-        , BTree_(min_degree)
+    LSMTree(size_t min_degree = 2, size_t max_components = 1, size_t component_size_multiplier = 10,
+            std::shared_ptr<CompactionPolicy> compaction_policy = nullptr, size_t max_file_size = 0)
+        : LSMTree(MakeOptions(min_degree, max_components, component_size_multiplier, compaction_policy, max_file_size))
+    {}
+
+    LSMTree(LSMOptions options)
+        : Directory_(options.Directory)
+        , MaxComponents_(options.MaxComponents)
+        , ComponentSizeMultiplier_(options.ComponentSizeMultiplier)
+        , MaxFileSize_(options.MaxFileSize)
+        , Memtable_(CreateMemtable(options))
+        , Policy_(options.Policy)
+        , Filter_(options.Filter)
+        , Levels_(options.MaxComponents)
+        , ValueLogThreshold_(options.ValueLogThreshold)
+        , ValueLogGarbageRatio_(options.ValueLogGarbageRatio)
+        , MaxCompactionsPerFlush_(options.MaxCompactionsPerFlush)
+        , LearnedIndexError_(options.LearnedIndexError)
+        , HashIndex_(options.HashIndex)
+        , ChecksumVerification_(options.ChecksumVerification)
+        , CompactionBypassCache_(options.CompactionBypassCache)
+        , CompactionPreallocate_(options.CompactionPreallocate)
+        , TombstoneValue_(options.FixedValueSize, '\0')
+        , Codecs_(options.Codecs)
+        , Instrumentation_(options.Instrumentation)
     {
-        for (size_t i = 0; i < max_components; ++i) {
-            std::string file_name = "file_";
-            file_name += '0' + i;
-            FileNames_.emplace_back(std::move(file_name));
-            Components_.emplace_back(FileNames_[i]);
+        if (!Directory_.empty()) {
+            std::filesystem::create_directories(Directory_);
+            if (Directory_.back() != '/') {
+                Directory_ += '/';
+            }
+        }
+        if (!Policy_) {
+            Policy_ = std::make_shared<LeveledCompactionPolicy>(ComponentSizeMultiplier_);
+        }
+        if (MaxFileSize_ == 0) {
+            MaxFileSize_ = std::max<size_t>(ComponentSizeMultiplier_ * ComponentSizeMultiplier_, 1);
+        }
+        if (options.MaxSubcompactions > 1) {
+            SubcompactionPool_ = std::make_unique<ThreadPool>(options.MaxSubcompactions);
+        }
+        if (ValueLogThreshold_ > 0) {
+            ValueLog_ = std::make_unique<ValueLog>(Directory_ + "vlog_", options.ValueLogFileSize);
+        }
+        if (options.CompactionRateLimit > 0) {
+            CompactionRateLimiter_ = std::make_unique<RateLimiter>(options.CompactionRateLimit);
+        }
+        if (options.SlowdownCompactionDebt > 0 || options.StopCompactionDebt > 0) {
+            WriteController_ = std::make_unique<WriteController>(
+                options.SlowdownCompactionDebt, options.StopCompactionDebt, options.DelayedWriteRate);
+        }
+        if (options.RowCacheSize > 0) {
+            RowCache_ = std::make_unique<RowCache>(options.RowCacheSize, options.RowCacheShards);
+        }
+        if (options.ReadQueueDepth > 0) {
+            ReadEngine_ = ReadEngine::Create(options.ReadQueueDepth);
+        }
+        ResolveTraces();
+    }
 
-            FILE* file = fopen(FileNames_[i].c_str(), "wb");
-            fclose(file);
+    // Opens a checkpoint for reads, writes to the returned tree are ignored.
+    // Returns nullptr if the directory has no readable manifest.
+    static std::unique_ptr<LSMTree> OpenReadOnly(const std::string& directory, LSMOptions options = LSMOptions()) {
+        std::error_code error;
+        if (!std::filesystem::exists(std::filesystem::path(directory) / MANIFEST_FILE_NAME, error)) {
+            return nullptr;
         }
+        options.Directory = directory;
+        auto tree = std::make_unique<LSMTree>(options);
+        if (!tree->LoadManifest(options)) {
+            return nullptr;
+        }
+        tree->IsReadOnly_ = true;
+        return tree;
     }
 
     bool Get(std::string& key, std::string& result_value) {
-        auto result = BTree_.Get(key);
-        if (result.IsDeleted) {
+        PinnedValue pinned_value;
+        if (!GetPinned(key, pinned_value)) {
             return false;
         }
-        if (result.IsFound) {
-            result_value = std::move(result.Value);
+        result_value.assign(pinned_value.View());
+        return true;
+    }
+
+    // Returns the value without copying it out of the memtable or a file. Only values
+    // from the value log are read into memory.
+    bool GetPinned(std::string& key, PinnedValue& result_value) {
+        ScopedTrace trace(Instrumentation_.get(), Traces_.Get);
+        ++Stats_.Gets;
+        // Writes invalidate cached keys, so a cached value is never older than the memtable.
+        if (RowCache_ && RowCache_->Lookup(key, result_value)) {
+            trace.SetDetail(Traces_.GetRowCache);
             return true;
         }
-
-        for (size_t i = 0; i < MaxComponents_; ++i) {
-            result = Components_[i].Get(key);
-            if (result.IsDeleted) {
+        size_t source = 0;
+        auto result = GetRawPinned(key, source);
+        bool is_in_memtable = (source == 0);
+        if (trace.IsEnabled()) {
+            trace.SetDetail(source == NOT_FOUND ? Traces_.GetNotFound : source == 0 ? Traces_.GetMemtable : Traces_.GetLevels[source - 1]);
+        }
+        if (!result.IsFound || result.IsDeleted) {
+            result_value.Reset();
+            return false;
+        }
+        if (result.IsValuePointer) {
+            V value;
+            if (!ValueLog_->Get(ValuePointer::Decode(result.Value.View()), value)) {
+                result_value.Reset();
                 return false;
             }
-            if (result.IsFound) {
-                result_value = std::move(result.Value);
-                return true;
+            result_value.PinString(std::move(value));
+        } else {
+            result_value = std::move(result.Value);
+        }
+        if (RowCache_ && !is_in_memtable) {
+            auto value = std::make_shared<const V>(result_value.View());
+            result_value.Pin(value, *value);
+            RowCache_->Insert(key, std::move(value));
+        }
+        return true;
+    }
+
+    // Looks up many keys at once, found[i] tells whether values[i] is the value of keys[i].
+    // The runs are visited one after another as by Get, and in every run the blocks of compressed
+    // files the keys fall into are read together (through the read engine if ReadQueueDepth is set).
+    std::vector<bool> MultiGet(std::vector<std::string>& keys, std::vector<std::string>& values) {
+        ScopedTrace trace(Instrumentation_.get(), Traces_.MultiGet);
+        Stats_.Gets += keys.size();
+        Stats_.MultiGetKeys += keys.size();
+        std::vector<bool> found(keys.size(), false);
+        std::vector<bool> is_cached(keys.size(), false);
+        std::vector<PinnedGetResult> results(keys.size());
+        std::vector<size_t> pending;
+        values.assign(keys.size(), V());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            PinnedValue cached;
+            if (RowCache_ && RowCache_->Lookup(keys[i], cached)) {
+                values[i].assign(cached.View());
+                found[i] = true;
+                is_cached[i] = true;
+                continue;
+            }
+            results[i] = Memtable_->GetPinned(keys[i]);
+            if (results[i].IsFound) {
+                ++Stats_.MemtableHits;
+                is_cached[i] = true;
+            } else if (MemRangeTombstones_.Covers(keys[i])) {
+                results[i] = { true, PinnedValue(), true };
+            } else {
+                pending.push_back(i);
             }
         }
-        return false;
+        for (auto& level : Levels_) {
+            for (auto& run : level) {
+                if (pending.empty()) {
+                    break;
+                }
+                pending = MultiGetFromRun(run, keys, pending, results);
+            }
+        }
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto& result = results[i];
+            if (found[i] || !result.IsFound || result.IsDeleted) {
+                continue;
+            }
+            if (result.IsValuePointer) {
+                if (!ValueLog_->Get(ValuePointer::Decode(result.Value.View()), values[i])) {
+                    continue;
+                }
+            } else {
+                values[i].assign(result.Value.View());
+            }
+            found[i] = true;
+            // Keys of the memtable are not cached, as in GetPinned.
+            if (RowCache_ && !is_cached[i]) {
+                RowCache_->Insert(keys[i], std::make_shared<const V>(values[i]));
+            }
+        }
+        return found;
     }
 
     std::vector<std::pair<std::string, V>> GetQuery(std::string& start_key, std::string& end_key) {
+        ScopedTrace trace(Instrumentation_.get(), Traces_.GetQuery);
         std::vector<std::pair<std::string, V>> result;
-        std::map<std::string, bool> is_key_deleted;
-        auto tree_result = BTree_.GetQuery(start_key, end_key);
+        std::map<std::string, bool> is_key_seen;
+        auto tree_result = Memtable_->GetQuery(start_key, end_key);
         for (auto& kvt : tree_result) {
-            if (kvt.Tombstone) {
-                is_key_deleted[kvt.Key] = true;
-            } else {
+            is_key_seen[kvt.Key] = true;
+            if (!kvt.Tombstone) {
                 result.emplace_back(kvt.Key, kvt.Value);
             }
         }
 
-        for (size_t i = 0; i < MaxComponents_; ++i) {
-            std::vector<KVTombstone> cmp_result;
-            Components_[i].GetQuery(start_key, end_key, cmp_result);
+        // Range tombstones of the memtable and of the runs already visited, they cover older runs.
+        RangeTombstoneSet range_tombstones = MemRangeTombstones_;
+        for (auto& level : Levels_) {
+            for (auto& run : level) {
+                std::vector<KVTombstone> cmp_result;
+                RangeTombstoneSet run_range_tombstones;
+                for (auto& file : run) {
+                    if (file.GetMaxKey() >= start_key && file.GetMinKey() <= end_key) {
+                        if (!file.GetQuery(start_key, end_key, cmp_result, ChecksumVerification_ == EChecksumVerification::Always, ReadEngine_.get())) {
+                            ++Stats_.ChecksumMismatches;
+                        }
+                        run_range_tombstones.Add(file.GetRangeTombstones());
+                    }
+                }
 
-            for (auto& kvt : cmp_result) {
-                if (kvt.Tombstone) {
-                    is_key_deleted[kvt.Key] = true;
-                } else {
-                    if (is_key_deleted.find(kvt.Key) == is_key_deleted.end()) {
+                for (auto& kvt : cmp_result) {
+                    if (is_key_seen.find(kvt.Key) != is_key_seen.end()) {
+                        continue;
+                    }
+                    is_key_seen[kvt.Key] = true;
+                    if (!kvt.Tombstone && !range_tombstones.Covers(kvt.Key)) {
+                        if (kvt.IsValuePointer) {
+                            ValueLog_->Get(ValuePointer::Decode(kvt.Value), kvt.Value);
+                        }
                         result.emplace_back(kvt.Key, kvt.Value);
                     }
                 }
+                range_tombstones.Add(run_range_tombstones);
             }
         }
 
@@ -78,174 +262,1219 @@ public:
     }
 
     void Add(std::string& key, std::string& value) {
-        BTree_.Add(key, value);
-
-        if (BTree_.GetSize() > ComponentSizeMultiplier_ && MaxComponents_ > 0) {
-            std::vector<KVTombstone> b_tree_data = BTree_.List();
-            size_t first_ptr = 0;
-            size_t second_ptr = 0;
-            auto first_kvt = b_tree_data[first_ptr];
-            size_t first_size = b_tree_data.size();
-            size_t second_size = Components_[0].GetSize();
-            std::string tmp_file_name = FileNames_[0] + "_tmp";
-            FILE* tmp_file = fopen(tmp_file_name.c_str(), "wb");
-            fclose(tmp_file);
-            tmp_file = fopen(tmp_file_name.c_str(), "rb+");
-
-            FILE* file = fopen(FileNames_[0].c_str(), "rb");
-            KVTombstone second_kvt;
-            if (second_size != 0) {
-                Components_[0].ReadFromFile(second_ptr, second_kvt, file);
-            }
-            while (first_ptr < first_size || second_ptr < second_size) {
-                if (first_ptr == first_size) {
-                    MoveComponentPointer(second_ptr, 0, 0, second_kvt, second_size, file, tmp_file);
+        if (IsReadOnly_) {
+            return;
+        }
+        ScopedTrace trace(Instrumentation_.get(), Traces_.Add);
+        AddToMemtable(key, value);
+        CheckFlush();
+    }
+
+    void Delete(std::string& key) {
+        if (IsReadOnly_) {
+            return;
+        }
+        ScopedTrace trace(Instrumentation_.get(), Traces_.Delete);
+        DeleteFromMemtable(key);
+        CheckFlush();
+    }
+
+    // Deletes all keys from [start_key, end_key) with one range tombstone.
+    void DeleteRange(std::string& start_key, std::string& end_key) {
+        if (IsReadOnly_) {
+            return;
+        }
+        ScopedTrace trace(Instrumentation_.get(), Traces_.DeleteRange);
+        DeleteRangeFromMemtable(start_key, end_key);
+        CheckFlush();
+    }
+
+    // Applies all operations of the batch to the memtable and checks for a flush once,
+    // the memtable may exceed its size by the size of the batch.
+    void Write(WriteBatch& batch) {
+        ScopedTrace trace(Instrumentation_.get(), Traces_.Write);
+        if (batch.Empty() || IsReadOnly_) {
+            return;
+        }
+        ++Stats_.WriteBatches;
+        for (auto& operation : batch.GetOperations()) {
+            switch (operation.Type) {
+                case WriteBatch::EOperationType::Put:
+                    AddToMemtable(operation.Key, operation.Value);
+                    break;
+                case WriteBatch::EOperationType::Delete:
+                    DeleteFromMemtable(operation.Key);
+                    break;
+                case WriteBatch::EOperationType::DeleteRange:
+                    DeleteRangeFromMemtable(operation.Key, operation.Value);
+                    break;
+            }
+        }
+        CheckFlush();
+    }
+
+    // Flushes the memtable and makes a copy of the tree in a new directory which can be opened
+    // with OpenReadOnly. Files on disk are never changed after they are written, so they are
+    // hard linked instead of copied and the time does not depend on the size of the data.
+    // Returns false if the directory exists or a file can not be created, or if the tree has
+    // no levels on disk to keep its entries.
+    bool CreateCheckpoint(const std::string& directory) {
+        ScopedTrace trace(Instrumentation_.get(), Traces_.Checkpoint);
+        std::filesystem::path target(directory);
+        std::error_code error;
+        if (Levels_.empty() || std::filesystem::exists(target, error) || !std::filesystem::create_directories(target, error)) {
+            return false;
+        }
+        Flush();
+
+        // The manifest is written last and renamed, so a checkpoint with a manifest is complete.
+        std::ofstream manifest(target / MANIFEST_TMP_FILE_NAME);
+        manifest << "levels " << Levels_.size() << "\n";
+        for (size_t level = 0; level < Levels_.size(); ++level) {
+            for (size_t run = 0; run < Levels_[level].size(); ++run) {
+                for (auto& file : Levels_[level][run]) {
+                    auto name = std::filesystem::path(file.GetFileName()).filename();
+                    if (!LinkFile(file.GetFileName(), target / name) || !file.SaveMetadata((target / name).string() + DiskComponent::METADATA_SUFFIX)) {
+                        return false;
+                    }
+                    manifest << "file " << level << " " << run << " " << name.string() << "\n";
+                }
+            }
+        }
+        if (ValueLog_) {
+            for (auto& [number, bytes] : ValueLog_->GetFiles()) {
+                auto file_name = ValueLog_->GetFileName(number);
+                if (!LinkFile(file_name, target / std::filesystem::path(file_name).filename())) {
+                    return false;
+                }
+                manifest << "vlog " << number << " " << bytes << "\n";
+            }
+        }
+        manifest.close();
+        if (!manifest) {
+            return false;
+        }
+        std::filesystem::rename(target / MANIFEST_TMP_FILE_NAME, target / MANIFEST_FILE_NAME, error);
+        ++Stats_.Checkpoints;
+        return !error;
+    }
+
+    // Adds files written by ComponentWriter to the tree, their entries are newer than all
+    // entries of the tree. A file goes to the lowest level such that it overlaps no file of that
+    // level and of the levels above, and is hard linked there without being rewritten. Only a file
+    // overlapping the first level is merged into it (or becomes a new run of it, like a flush).
+    // Returns false and adds nothing if a file can not be read or the files overlap each other.
+    bool IngestExternalFiles(const std::vector<std::string>& paths) {
+        ScopedTrace trace(Instrumentation_.get(), Traces_.Ingest);
+        if (IsReadOnly_ || Levels_.empty()) {
+            return false;
+        }
+        std::vector<std::string> file_paths;
+        std::vector<DiskComponent> files;
+        for (auto& path : paths) {
+            DiskComponent file(NewFileName());
+            if (!std::filesystem::exists(path) || !file.LoadMetadata(path + DiskComponent::METADATA_SUFFIX)) {
+                return false;
+            }
+            if (ChecksumVerification_ != EChecksumVerification::Never && !VerifyChecksums(file, path)) {
+                ++Stats_.ChecksumMismatches;
+                return false;
+            }
+            if (file.GetSize() > 0 || !file.GetRangeTombstones().Empty()) {
+                file_paths.push_back(path);
+                files.push_back(std::move(file));
+            }
+        }
+        std::vector<size_t> order(files.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&files](size_t lhs, size_t rhs) {
+            return files[lhs].GetMinKey() < files[rhs].GetMinKey();
+        });
+        for (size_t i = 1; i < order.size(); ++i) {
+            if (files[order[i - 1]].GetMaxKey() >= files[order[i]].GetMinKey()) {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (!LinkFile(file_paths[i], files[i].GetFileName())) {
+                for (size_t j = 0; j < i; ++j) {
+                    std::remove(files[j].GetFileName().c_str());
+                }
+                return false;
+            }
+        }
+
+        for (auto& file : files) {
+            // The memtable is newer than the tree but older than the ingested files.
+            if (MemtableOverlaps(file.GetMinKey(), file.GetMaxKey())) {
+                Flush();
+            }
+            IngestFile(std::move(file));
+        }
+        // Ingested keys may be newer than the cached values.
+        if (RowCache_) {
+            RowCache_->Clear();
+        }
+        Compact(MaxCompactionsPerFlush_);
+        if (WriteController_) {
+            UpdateWriteController();
+        }
+        return true;
+    }
+
+    // True for a tree opened by OpenReadOnly and after a merge found a corrupted file.
+    bool IsReadOnly() {
+        return IsReadOnly_;
+    }
+
+    LSMStats GetStats() {
+        LSMStats stats = Stats_;
+        stats.ValueLogBytes = ValueLog_ ? ValueLog_->GetWrittenBytes() : 0;
+        if (RowCache_) {
+            stats.RowCacheHits = RowCache_->GetHits();
+            stats.RowCacheMisses = RowCache_->GetMisses();
+            stats.RowCacheUsage = RowCache_->GetUsage();
+        }
+        auto shape = GetLevelsShape();
+        stats.CompactionDebt = Policy_->GetCompactionDebt(shape);
+        if (CompactionRateLimiter_) {
+            stats.CompactionRateLimitedBytes = CompactionRateLimiter_->GetRequestedBytes();
+            stats.CompactionRateLimitMicros = CompactionRateLimiter_->GetWaitMicros();
+        }
+        if (WriteController_) {
+            stats.SlowedWrites = WriteController_->GetSlowedWrites();
+            stats.SlowedWriteBytes = WriteController_->GetSlowedBytes();
+            stats.WriteSlowdownMicros = WriteController_->GetSlowdownMicros();
+            stats.WriteStops = WriteController_->GetStops();
+            stats.WriteStopMicros = WriteController_->GetStopMicros();
+        }
+        stats.ReadAmplification = 1;
+        for (auto& level : Levels_) {
+            stats.ReadAmplification += level.size();
+        }
+        stats.MemtableEntries = Memtable_->GetSize();
+        for (auto& level : Levels_) {
+            LevelStats level_stats;
+            level_stats.Runs = level.size();
+            for (auto& run : level) {
+                level_stats.Files += run.size();
+                for (auto& file : run) {
+                    level_stats.Entries += file.GetSize();
+                    level_stats.Bytes += file.GetBytes();
+                    level_stats.IndexMemory += file.GetIndexMemoryUsage();
+                }
+            }
+            stats.Levels.push_back(level_stats);
+        }
+        return stats;
+    }
+
+    std::string GetCompactionPolicyName() {
+        return Policy_->GetName();
+    }
+
+    LevelsShape GetLevelsShape() {
+        LevelsShape shape(Levels_.size());
+        for (size_t i = 0; i < Levels_.size(); ++i) {
+            for (auto& run : Levels_[i]) {
+                shape[i].push_back(GetRunShape(run));
+            }
+        }
+        return shape;
+    }
+
+private:
+    // Sorted sources of a merge together with their range tombstones.
+    struct MergeInputs {
+        std::vector<std::unique_ptr<KVTSource>> Sources;
+        std::vector<RangeTombstoneSet> RangeTombstones;
+        // Size of the input files, for preallocating the output.
+        size_t Bytes = 0;
+        size_t Entries = 0;
+        // Inputs of a compaction, which CompactionBypassCache and CompactionPreallocate apply to.
+        bool IsCompaction = false;
+    };
+
+    // Instrumentation handles of the traced operations, resolved once so that recording an
+    // operation neither looks its name up nor builds it.
+    struct TraceHandles {
+        size_t Get = 0;
+        size_t GetRowCache = 0;
+        size_t GetNotFound = 0;
+        size_t GetMemtable = 0;
+        // Gets answered by the level.
+        std::vector<size_t> GetLevels;
+        size_t MultiGet = 0;
+        size_t GetQuery = 0;
+        size_t Add = 0;
+        size_t Delete = 0;
+        size_t DeleteRange = 0;
+        size_t Write = 0;
+        size_t Checkpoint = 0;
+        size_t Ingest = 0;
+        size_t Flush = 0;
+        size_t Compaction = 0;
+        // Compactions into the level.
+        std::vector<size_t> CompactionLevels;
+        size_t Subcompaction = 0;
+    };
+
+    // Newest entry of the key without resolving value log pointers,
+    // a key deleted by a range tombstone is returned as a tombstone.
+    GetResult GetRaw(std::string& key) {
+        auto result = Memtable_->Get(key);
+        if (result.IsFound) {
+            return result;
+        }
+        if (MemRangeTombstones_.Covers(key)) {
+            return { true, V(), true };
+        }
+
+        for (auto& level : Levels_) {
+            for (auto& run : level) {
+                DiskComponent* file = FindFile(run, key);
+                if (!file) {
                     continue;
                 }
-                if (second_ptr == second_size) {
-                    Components_[0].WriteToFile(first_kvt, tmp_file, true);
-                    ++first_ptr;
-                    if (first_ptr != first_size) {
-                        first_kvt = b_tree_data[first_ptr];
-                    }
+                result = file->Get(key, ChecksumVerification_ == EChecksumVerification::Always);
+                if (result.IsCorrupted) {
+                    ++Stats_.ChecksumMismatches;
+                    return result;
+                }
+                if (result.IsFound) {
+                    return result;
+                }
+                if (file->IsRangeDeleted(key)) {
+                    return { true, V(), true };
+                }
+            }
+        }
+        return { false, V(), false };
+    }
+
+    // Same as GetRaw, but the value is pinned instead of copied. The source of the answer is
+    // 0 for the memtable, i + 1 for level i and NOT_FOUND if the key is not in the tree.
+    PinnedGetResult GetRawPinned(std::string& key, size_t& source) {
+        source = 0;
+        auto result = Memtable_->GetPinned(key);
+        if (result.IsFound) {
+            ++Stats_.MemtableHits;
+            return result;
+        }
+        if (MemRangeTombstones_.Covers(key)) {
+            return { true, PinnedValue(), true };
+        }
+
+        for (auto& level : Levels_) {
+            ++source;
+            for (auto& run : level) {
+                DiskComponent* file = FindFile(run, key);
+                if (!file) {
                     continue;
                 }
-                if (first_kvt.Key < second_kvt.Key) {
-                    Components_[0].WriteToFile(first_kvt, tmp_file, true);
-                    ++first_ptr;
-                    if (first_ptr != first_size) {
-                        first_kvt = b_tree_data[first_ptr];
-                    }
-                } else if (first_kvt.Key == second_kvt.Key) {
-                    Components_[0].WriteToFile(first_kvt, tmp_file, true);
-                    ++first_ptr;
-                    if (first_ptr != first_size) {
-                        first_kvt = b_tree_data[first_ptr];
+                if (!file->MayContain(key)) {
+                    ++Stats_.FilterUseful;
+                } else {
+                    ++Stats_.GetProbes;
+                    result = file->GetPinned(key, ChecksumVerification_ == EChecksumVerification::Always);
+                    if (result.IsCorrupted) {
+                        ++Stats_.ChecksumMismatches;
+                        source = NOT_FOUND;
+                        return result;
                     }
-                    ++second_ptr;
-                    if (second_ptr != second_size) {
-                        Components_[0].ReadFromFile(second_ptr, second_kvt, file);
+                    if (result.IsFound) {
+                        return result;
                     }
+                    ++Stats_.FilterFalsePositives;
+                }
+                if (file->IsRangeDeleted(key)) {
+                    return { true, PinnedValue(), true };
+                }
+            }
+        }
+        source = NOT_FOUND;
+        return {};
+    }
+
+    // Looks the pending keys of MultiGet up in one run and returns the keys the run has nothing
+    // about. The blocks of compressed files are read together after the other files are probed.
+    std::vector<size_t> MultiGetFromRun(SortedRun& run, std::vector<std::string>& keys, std::vector<size_t>& pending,
+                                        std::vector<PinnedGetResult>& results) {
+        bool verify = ChecksumVerification_ == EChecksumVerification::Always;
+        std::vector<size_t> still_pending;
+        // Keys waiting for a block of a compressed file, by the file and the block.
+        std::map<std::pair<DiskComponent*, size_t>, std::vector<size_t>> block_keys;
+        auto resolve = [&](DiskComponent* file, size_t i, PinnedGetResult result) {
+            if (result.IsCorrupted) {
+                ++Stats_.ChecksumMismatches;
+            } else if (!result.IsFound) {
+                ++Stats_.FilterFalsePositives;
+                if (!file->IsRangeDeleted(keys[i])) {
+                    still_pending.push_back(i);
+                    return;
+                }
+                result = { true, PinnedValue(), true };
+            }
+            results[i] = std::move(result);
+        };
+        for (size_t i : pending) {
+            DiskComponent* file = FindFile(run, keys[i]);
+            if (!file) {
+                still_pending.push_back(i);
+                continue;
+            }
+            if (!file->MayContain(keys[i])) {
+                ++Stats_.FilterUseful;
+                if (file->IsRangeDeleted(keys[i])) {
+                    results[i] = { true, PinnedValue(), true };
                 } else {
-                    MoveComponentPointer(second_ptr, 0, 0, second_kvt, second_size, file, tmp_file);
+                    still_pending.push_back(i);
                 }
+                continue;
             }
-            fclose(file);
-            file = fopen(FileNames_[0].c_str(), "wb");
+            ++Stats_.GetProbes;
+            if (auto block = file->FindBlock(keys[i])) {
+                block_keys[{ file, *block }].push_back(i);
+            } else {
+                resolve(file, i, file->GetPinned(keys[i], verify));
+            }
+        }
+        if (block_keys.empty()) {
+            return still_pending;
+        }
+
+        // Blocks of a file which can not be opened are not requested and fail as read errors.
+        std::map<DiskComponent*, FILE*> files;
+        std::vector<std::string> data(block_keys.size());
+        std::vector<ReadRequest> requests;
+        size_t location_index = 0;
+        for (auto& [location, block_pending] : block_keys) {
+            auto [it, is_new] = files.emplace(location.first, nullptr);
+            if (is_new) {
+                it->second = fopen(location.first->GetFileName().c_str(), "rb");
+            }
+            if (it->second) {
+                requests.push_back(location.first->PrepareBlockRead(location.second, it->second, data[location_index]));
+            }
+            ++location_index;
+        }
+        bool is_read = ReadEngine_ && ReadEngine_->ReadAll(requests);
+        Stats_.MultiGetBlockReads += requests.size();
+        ++Stats_.MultiGetBatches;
+        location_index = 0;
+        std::string block;
+        for (auto& [location, block_pending] : block_keys) {
+            auto [file, block_index] = location;
+            FILE* handle = files[file];
+            // Without the engine, or if it failed, the blocks are read one by one.
+            bool is_valid = handle && (is_read ? file->DecodeBlock(block_index, data[location_index], block, verify)
+                                               : file->ReadBlock(block_index, handle, block, verify));
+            ++location_index;
+            for (size_t i : block_pending) {
+                if (!is_valid) {
+                    PinnedGetResult result;
+                    result.IsCorrupted = true;
+                    resolve(file, i, std::move(result));
+                    continue;
+                }
+                auto get_result = file->GetFromBlock(keys[i], block_index, block);
+                PinnedGetResult result{ get_result.IsFound, PinnedValue(), get_result.IsDeleted, get_result.IsValuePointer };
+                result.Value.PinString(std::move(get_result.Value));
+                resolve(file, i, std::move(result));
+            }
+        }
+        for (auto& [component, file] : files) {
+            if (file) {
+                fclose(file);
+            }
+        }
+        std::sort(still_pending.begin(), still_pending.end());
+        return still_pending;
+    }
+
+    void AddToMemtable(std::string& key, std::string& value) {
+        AddUserBytes(key.size() + value.size() + 1);
+        Memtable_->Add(key, value);
+        if (RowCache_) {
+            RowCache_->Erase(key);
+        }
+    }
+
+    void DeleteFromMemtable(std::string& key) {
+        AddUserBytes(key.size() + 1);
+        Memtable_->Add(key, TombstoneValue_, true);
+        if (RowCache_) {
+            RowCache_->Erase(key);
+        }
+    }
+
+    void DeleteRangeFromMemtable(std::string& start_key, std::string& end_key) {
+        if (!(start_key < end_key)) {
+            return;
+        }
+        AddUserBytes(start_key.size() + end_key.size() + 1);
+        ++Stats_.RangeDeletes;
 
-            size_t file_size = ftell(tmp_file);
-            fseek(tmp_file, 0, SEEK_SET);
-            char buffer[BUFFER_SIZE + 1];
-            for (size_t i = 0; i < file_size / BUFFER_SIZE; ++i) {
-                fread(buffer, sizeof(char), BUFFER_SIZE, tmp_file);
-                fwrite(buffer, sizeof(char), BUFFER_SIZE, file);
+        // Memtable entries of the range are older than the tombstone, so they are removed right away
+        // and memtable tombstones only ever cover the disk components.
+        if (!Memtable_->GetQuery(start_key, end_key).empty()) {
+            std::vector<KVTombstone> b_tree_data = Memtable_->List();
+            Memtable_->Erase();
+            for (auto& kvt : b_tree_data) {
+                if (kvt.Key < start_key || kvt.Key >= end_key) {
+                    Memtable_->Add(kvt.Key, kvt.Value, kvt.Tombstone);
+                }
             }
-            fread(buffer, sizeof(char), file_size % BUFFER_SIZE, tmp_file);
-            fwrite(buffer, sizeof(char), file_size % BUFFER_SIZE, file);
+        }
+        MemRangeTombstones_.Add({ start_key, end_key });
+        // The cache is not ordered, so all of it is dropped.
+        if (RowCache_) {
+            RowCache_->Clear();
+        }
+    }
 
-            fclose(file);
-            fclose(tmp_file);
+    // Writes are delayed here while the write controller slows them down.
+    void AddUserBytes(size_t bytes) {
+        Stats_.UserBytes += bytes;
+        if (WriteController_) {
+            WriteController_->Delay(bytes);
+        }
+    }
+
+    void CheckFlush() {
+        if (Memtable_->GetSize() + MemRangeTombstones_.Size() > ComponentSizeMultiplier_ && MaxComponents_ > 0) {
+            auto start = std::chrono::steady_clock::now();
+            {
+                ScopedTrace trace(Instrumentation_.get(), Traces_.Flush);
+                Flush();
+            }
+            Stats_.FlushMicros += GetMicrosSince(start);
+            Compact(MaxCompactionsPerFlush_);
+            if (WriteController_) {
+                UpdateWriteController();
+            }
+            // The filter may have changed or removed cached values.
+            if (RowCache_ && Filter_) {
+                RowCache_->Clear();
+            }
+        }
+    }
+
+    // The memtable is written out through its cursor entry by entry, so the flush takes memory
+    // for one entry on top of the memtable. The memtable is erased only after the files are in
+    // place and stays whole if the flush fails. A tree without levels keeps all entries in the memtable.
+    void Flush() {
+        if (Levels_.empty()) {
+            return;
+        }
+        std::optional<K> min_key = Memtable_->GetMinKey();
+        std::optional<K> max_key = Memtable_->GetMaxKey();
+        for (auto& tombstone : MemRangeTombstones_.Get()) {
+            min_key = min_key ? std::min(*min_key, tombstone.Start) : tombstone.Start;
+            max_key = max_key ? std::max(*max_key, tombstone.End) : tombstone.End;
+        }
+        if (!min_key) {
+            return;
+        }
+
+        CompactionTask task;
+        if (Policy_->MergeOnFlush() && !Levels_[0].empty()) {
+            auto overlapping = GetOverlappingFiles(GetRunShape(Levels_[0][0]), *min_key, *max_key);
+            if (!overlapping.empty()) {
+                task.Inputs.push_back({ 0, 0, std::move(overlapping) });
+            }
+            task.OutputRun = 0;
+        }
+
+        std::unique_ptr<KVTSource> memtable_source = Memtable_->NewCursor();
+        if (ValueLog_) {
+            memtable_source = std::make_unique<TransformSource>(std::move(memtable_source), [this](KVTombstone& kvt) {
+                if (!kvt.Tombstone && kvt.Value.size() >= ValueLogThreshold_) {
+                    kvt.Value = ValueLog_->Add(kvt.Key, kvt.Value).Encode();
+                    kvt.IsValuePointer = true;
+                }
+            });
+        }
+
+        MergeInputs inputs;
+        MergeStats merge_stats;
+        inputs.Sources.push_back(std::move(memtable_source));
+        inputs.RangeTombstones.push_back(MemRangeTombstones_);
+        AddSources(task, inputs, merge_stats);
+        bool drop_tombstones = CanDropTombstones(task, min_key, max_key);
+        auto output = WriteFiles(std::move(inputs), std::nullopt, std::nullopt, 0, drop_tombstones, false, merge_stats);
+        if (merge_stats.ReadErrors > 0) {
+            AddMergeStats(merge_stats);
+            FailMerge(output);
+            return;
+        }
+        ReplaceFiles(task, std::move(output), true);
+        Stats_.FlushBytes += merge_stats.WrittenBytes;
+        AddMergeStats(merge_stats);
+
+        Memtable_->Erase();
+        MemRangeTombstones_.Clear();
+        ++Stats_.Flushes;
+    }
+
+    // Runs at most max_compactions compactions (all of them if zero), returns their number.
+    size_t Compact(size_t max_compactions = 0) {
+        size_t compactions = 0;
+        LevelsShape shape = GetLevelsShape();
+        for (auto task = Policy_->PickCompaction(shape); task && !IsReadOnly_; task = Policy_->PickCompaction(shape)) {
+            RunCompaction(*task);
+            shape = GetLevelsShape();
+            if (++compactions == max_compactions) {
+                break;
+            }
+        }
+        CollectValueLogGarbage();
+        return compactions;
+    }
+
+    // Sets the write controller state from the compaction debt. While the debt is above
+    // the stop threshold, the writer runs compactions itself.
+    void UpdateWriteController() {
+        LevelsShape shape = GetLevelsShape();
+        if (WriteController_->Update(Policy_->GetCompactionDebt(shape)) != WriteController::EState::Stop) {
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        while (Compact(1) > 0) {
+            shape = GetLevelsShape();
+            if (WriteController_->Update(Policy_->GetCompactionDebt(shape)) != WriteController::EState::Stop) {
+                break;
+            }
+        }
+        WriteController_->AddStop(GetMicrosSince(start));
+    }
+
+    // Rewrites the live values of value log files in which compactions found enough garbage:
+    // a value is live if the LSM still points to it, then it is added to the memtable again.
+    void CollectValueLogGarbage() {
+        if (!ValueLog_ || IsCollectingGarbage_) {
+            return;
+        }
+        IsCollectingGarbage_ = true;
+        for (size_t file_number : ValueLog_->GetFilesToCollect(ValueLogGarbageRatio_)) {
+            ValueLog_->ForEachRecord(file_number, [this](K& key, V& value, ValuePointer pointer) {
+                auto result = GetRaw(key);
+                if (result.IsFound && !result.IsDeleted && result.IsValuePointer && ValuePointer::Decode(result.Value) == pointer) {
+                    Memtable_->Add(key, value);
+                    CheckFlush();
+                }
+            });
+            ValueLog_->RemoveFile(file_number);
+            ++Stats_.ValueLogCollections;
+        }
+        IsCollectingGarbage_ = false;
+    }
+
+    void RunCompaction(CompactionTask& task) {
+        auto start = std::chrono::steady_clock::now();
+        {
+            ScopedTrace trace(Instrumentation_.get(), Traces_.Compaction);
+            if (trace.IsEnabled()) {
+                trace.SetDetail(Traces_.CompactionLevels[task.OutputLevel]);
+            }
+            RunCompactionTask(task);
+        }
+        size_t micros = GetMicrosSince(start);
+        Stats_.CompactionMicros += micros;
+        Stats_.MaxCompactionMicros = std::max(Stats_.MaxCompactionMicros, micros);
+    }
+
+    void RunCompactionTask(CompactionTask& task) {
+        bool drop_tombstones = CanDropTombstones(task);
+        if (task.Inputs.size() == 1 && !(drop_tombstones && HasTombstones(task))) {
+            // Files of one run are already sorted and disjoint, so they are moved without rewriting.
+            auto& input = task.Inputs[0];
+            std::vector<DiskComponent> moved;
+            for (size_t file : input.Files) {
+                moved.push_back(std::move(Levels_[input.Level][input.Run][file]));
+            }
+            ReplaceFiles(task, std::move(moved), false);
+            ++Stats_.TrivialMoves;
+            return;
+        }
+
+        size_t read_errors = Stats_.MergeReadErrors;
+        auto output = RunSubcompactions(task, drop_tombstones);
+        if (Stats_.MergeReadErrors > read_errors) {
+            FailMerge(output);
+            return;
+        }
+        ReplaceFiles(task, std::move(output), true);
+        ++Stats_.Compactions;
+    }
+
+    // Splits a large compaction into disjoint key ranges which are merged in parallel,
+    // every range writes its own files. The files of all ranges are installed together.
+    std::vector<DiskComponent> RunSubcompactions(CompactionTask& task, bool drop_tombstones) {
+        auto bounds = GetSubcompactionBounds(task);
+        if (bounds.empty()) {
+            MergeInputs inputs;
+            MergeStats merge_stats;
+            inputs.IsCompaction = true;
+            AddSources(task, inputs, merge_stats);
+            auto output = WriteFiles(std::move(inputs), std::nullopt, std::nullopt, task.OutputLevel, drop_tombstones, true, merge_stats);
+            Stats_.CompactionBytes += merge_stats.WrittenBytes;
+            AddMergeStats(merge_stats);
+            return output;
+        }
 
-            tmp_file = fopen(tmp_file_name.c_str(), "wb");
-            fclose(tmp_file);
-            BTree_.Erase();
-            Components_[0].SwapTmp();
+        size_t ranges_count = bounds.size() + 1;
+        std::vector<std::vector<DiskComponent>> outputs(ranges_count);
+        std::vector<MergeStats> merge_stats(ranges_count);
+        std::vector<std::future<void>> results;
+        for (size_t i = 0; i < ranges_count; ++i) {
+            std::optional<K> start_key = i > 0 ? std::optional<K>(bounds[i - 1]) : std::nullopt;
+            std::optional<K> end_key = i < bounds.size() ? std::optional<K>(bounds[i]) : std::nullopt;
+            results.push_back(SubcompactionPool_->Submit([this, &task, &outputs, &merge_stats, i, start_key, end_key, drop_tombstones] {
+                ScopedTrace trace(Instrumentation_.get(), Traces_.Subcompaction);
+                MergeInputs inputs;
+                inputs.IsCompaction = true;
+                AddSources(task, inputs, merge_stats[i], start_key, end_key);
+                outputs[i] = WriteFiles(std::move(inputs), start_key, end_key, task.OutputLevel, drop_tombstones, true, merge_stats[i]);
+            }));
+        }
+        for (auto& result : results) {
+            result.get();
         }
 
-        size_t cur_component_max_size = ComponentSizeMultiplier_ * ComponentSizeMultiplier_;
-        for (size_t i = 0; i < MaxComponents_ - 1; ++i) {
-            if (Components_[i].GetSize() > cur_component_max_size) {
-                size_t first_ptr = 0;
-                size_t second_ptr = 0;
+        std::vector<DiskComponent> output;
+        for (size_t i = 0; i < ranges_count; ++i) {
+            Stats_.CompactionBytes += merge_stats[i].WrittenBytes;
+            AddMergeStats(merge_stats[i]);
+            std::move(outputs[i].begin(), outputs[i].end(), std::back_inserter(output));
+        }
+        ++Stats_.ParallelCompactions;
+        return output;
+    }
 
-                size_t first_size = Components_[i].GetSize();
-                size_t second_size = Components_[i + 1].GetSize();
+    // Keys splitting the task into subcompactions: the smallest keys of the input files,
+    // evenly thinned out to the number of threads. Empty if the task is not worth splitting.
+    std::vector<K> GetSubcompactionBounds(CompactionTask& task) {
+        if (!SubcompactionPool_) {
+            return {};
+        }
+        std::vector<K> keys;
+        size_t input_size = 0;
+        for (auto& input : task.Inputs) {
+            for (size_t file : input.Files) {
+                auto& component = Levels_[input.Level][input.Run][file];
+                keys.push_back(component.GetMinKey());
+                input_size += component.GetSize();
+            }
+        }
+        if (input_size <= MaxFileSize_) {
+            return {};
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        keys.erase(keys.begin());
 
-                std::string tmp_file_name = FileNames_[i + 1] + "_tmp";
-                FILE* tmp_file = fopen(tmp_file_name.c_str(), "wb");
-                fclose(tmp_file);
-                tmp_file = fopen(tmp_file_name.c_str(), "rb+");
+        size_t ranges_count = std::min(SubcompactionPool_->GetThreadsCount(), keys.size() + 1);
+        std::vector<K> bounds;
+        for (size_t i = 1; i < ranges_count; ++i) {
+            bounds.push_back(keys[i * keys.size() / ranges_count]);
+        }
+        bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+        return bounds;
+    }
 
-                FILE* file1 = fopen(FileNames_[i].c_str(), "rb");
-                KVTombstone first_kvt;
-                if (first_size != 0) {
-                    Components_[i].ReadFromFile(first_ptr, first_kvt, file1);
+    // Blocks the sources can not read or decode (or which do not match their checksums)
+    // are counted in merge_stats, whatever the checksum verification is.
+    void AddSources(CompactionTask& task, MergeInputs& inputs, MergeStats& merge_stats,
+                    std::optional<K> start_key = std::nullopt, std::optional<K> end_key = std::nullopt) {
+        bool verify_checksums = ChecksumVerification_ != EChecksumVerification::Never;
+        for (auto& input : task.Inputs) {
+            auto& run = Levels_[input.Level][input.Run];
+            std::vector<std::unique_ptr<KVTSource>> run_sources;
+            RangeTombstoneSet run_range_tombstones;
+            for (size_t file : input.Files) {
+                auto& component = run[file];
+                if ((end_key && component.GetMinKey() >= *end_key) || (start_key && component.GetMaxKey() < *start_key)) {
+                    continue;
                 }
+                run_sources.push_back(std::make_unique<ComponentSource>(component, start_key, end_key, &merge_stats.ReadErrors, verify_checksums,
+                                                                        ReadEngine_.get(), inputs.IsCompaction && CompactionBypassCache_));
+                run_range_tombstones.Add(component.GetRangeTombstones());
+                inputs.Bytes += component.GetBytes();
+                inputs.Entries += component.GetSize();
+            }
+            inputs.Sources.push_back(std::make_unique<ConcatSource>(std::move(run_sources)));
+            inputs.RangeTombstones.push_back(std::move(run_range_tombstones));
+        }
+    }
 
-                FILE* file2 = fopen(FileNames_[i + 1].c_str(), "rb");
-                KVTombstone second_kvt;
-                if (second_size != 0) {
-                    Components_[i + 1].ReadFromFile(second_ptr, second_kvt, file2);
+    // Tombstones can be dropped if no file older than the output may still hold the key:
+    // every file of the output level and below that overlaps the task is one of its inputs.
+    bool CanDropTombstones(CompactionTask& task, std::optional<K> min_key = std::nullopt, std::optional<K> max_key = std::nullopt) {
+        std::set<std::pair<size_t, size_t>> input_runs;
+        for (auto& input : task.Inputs) {
+            auto& run = Levels_[input.Level][input.Run];
+            for (size_t file : input.Files) {
+                if (!min_key || run[file].GetMinKey() < *min_key) {
+                    min_key = run[file].GetMinKey();
                 }
-                while (first_ptr < first_size || second_ptr < second_size) {
-                    if (first_ptr == first_size) {
-                        MoveComponentPointer(second_ptr, i + 1, i + 1, second_kvt, second_size, file2, tmp_file);
-                        continue;
-                    }
-                    if (second_ptr == second_size) {
-                        MoveComponentPointer(first_ptr, i, i + 1, first_kvt, first_size, file1, tmp_file);
-                        continue;
-                    }
-                    if (first_kvt.Key < second_kvt.Key) {
-                        MoveComponentPointer(first_ptr, i, i + 1, first_kvt, first_size, file1, tmp_file);
-                        continue;
-                    } else if (first_kvt.Key == second_kvt.Key) {
-                        MoveComponentPointer(first_ptr, i, i + 1, first_kvt, first_size, file1, tmp_file);
-                        ++second_ptr;
-                        if (second_ptr != second_size) {
-                            Components_[i + 1].ReadFromFile(second_ptr, second_kvt, file2);
-                        }
-                    } else {
-                        MoveComponentPointer(second_ptr, i + 1, i + 1, second_kvt, second_size, file2, tmp_file);
-                    }
+                if (!max_key || run[file].GetMaxKey() > *max_key) {
+                    max_key = run[file].GetMaxKey();
                 }
-                fclose(file1);
-                file1 = fopen(FileNames_[i].c_str(), "wb");
-                fclose(file1);
-                fclose(file2);
-                file2 = fopen(FileNames_[i + 1].c_str(), "wb");
+            }
+            input_runs.insert({ input.Level, input.Run });
+        }
+        if (!min_key) {
+            return true;
+        }
 
-                size_t file2_size = ftell(tmp_file);
-                fseek(tmp_file, 0, SEEK_SET);
-                char buffer[BUFFER_SIZE + 1];
-                for (size_t i = 0; i < file2_size / BUFFER_SIZE; ++i) {
-                    fread(buffer, sizeof(char), BUFFER_SIZE, tmp_file);
-                    fwrite(buffer, sizeof(char), BUFFER_SIZE, file2);
+        for (size_t level = task.OutputLevel; level < Levels_.size(); ++level) {
+            for (size_t run = 0; run < Levels_[level].size(); ++run) {
+                auto overlapping = GetOverlappingFiles(GetRunShape(Levels_[level][run]), *min_key, *max_key);
+                if (overlapping.empty()) {
+                    continue;
+                }
+                auto input = std::find_if(task.Inputs.begin(), task.Inputs.end(), [level, run](CompactionInput& input) {
+                    return input.Level == level && input.Run == run;
+                });
+                if (input == task.Inputs.end() || !std::includes(input->Files.begin(), input->Files.end(), overlapping.begin(), overlapping.end())) {
+                    return false;
                 }
-                fread(buffer, sizeof(char), file2_size % BUFFER_SIZE, tmp_file);
-                fwrite(buffer, sizeof(char), file2_size % BUFFER_SIZE, file2);
+            }
+        }
+        return true;
+    }
 
-                fclose(file2);
-                fclose(tmp_file);
+    bool HasTombstones(CompactionTask& task) {
+        for (auto& input : task.Inputs) {
+            for (size_t file : input.Files) {
+                auto& component = Levels_[input.Level][input.Run][file];
+                if (component.GetTombstonesCount() > 0 || !component.GetRangeTombstones().Empty()) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
 
-                tmp_file = fopen(tmp_file_name.c_str(), "wb");
-                fclose(tmp_file);
-                Components_[i].Erase();
-                Components_[i + 1].SwapTmp();
+    // Merges the inputs restricted to [start_key, end_key) into new files of at most MaxFileSize_ entries.
+    std::vector<DiskComponent> WriteFiles(MergeInputs inputs, std::optional<K> start_key, std::optional<K> end_key,
+                                          size_t output_level, bool drop_tombstones, bool is_rate_limited,
+                                          MergeStats& merge_stats) {
+        RangeTombstoneSet output_range_tombstones;
+        if (!drop_tombstones) {
+            for (auto& range_tombstones : inputs.RangeTombstones) {
+                output_range_tombstones.Add(range_tombstones.Clip(start_key, end_key));
             }
+        }
 
-            cur_component_max_size *= ComponentSizeMultiplier_;
+        std::vector<DiskComponent> output;
+        FILE* file = nullptr;
+        RateLimiter* rate_limiter = is_rate_limited ? CompactionRateLimiter_.get() : nullptr;
+        size_t pending_bytes = 0;
+        bool drop_from_cache = inputs.IsCompaction && CompactionBypassCache_;
+        size_t preallocate_bytes = 0;
+        if (inputs.IsCompaction && CompactionPreallocate_ && inputs.Entries > 0) {
+            preallocate_bytes = std::min(inputs.Bytes, inputs.Bytes / inputs.Entries * MaxFileSize_);
         }
+        bool is_preallocated = false;
+        MergeIterator it(std::move(inputs.Sources), std::move(inputs.RangeTombstones),
+            [this](KVTombstone& kvt) { ReleaseValue(kvt); });
+        for (; it.IsValid(); it.Next()) {
+            auto& kvt = it.Current();
+            if (!kvt.Tombstone && Filter_ && ApplyFilter(kvt, output_level)) {
+                ++merge_stats.FilteredEntries;
+                ReleaseValue(kvt);
+                kvt.Value = TombstoneValue_;
+                kvt.Tombstone = true;
+                kvt.IsValuePointer = false;
+            }
+            if (kvt.Tombstone && drop_tombstones) {
+                ++merge_stats.DroppedTombstones;
+                continue;
+            }
+            if (!file || output.back().GetSize() >= MaxFileSize_) {
+                if (file) {
+                    output.back().FinishFile(file);
+                    FileHints::Finish(file, is_preallocated, drop_from_cache);
+                    fclose(file);
+                }
+                output.emplace_back(NewFileName());
+                if (LearnedIndexError_ > 0) {
+                    output.back().EnableLearnedIndex(LearnedIndexError_);
+                }
+                if (HashIndex_) {
+                    output.back().EnableHashIndex();
+                }
+                if (!Codecs_.empty()) {
+                    output.back().SetCodec(Codecs_[std::min(output_level, Codecs_.size() - 1)]);
+                }
+                file = fopen(output.back().GetFileName().c_str(), "wb");
+                is_preallocated = FileHints::Preallocate(file, preallocate_bytes);
+            }
+            output.back().WriteToFile(kvt, file);
+            if (rate_limiter) {
+                pending_bytes += kvt.Key.size() + kvt.Value.size() + 1;
+                if (pending_bytes >= RATE_LIMITER_CHUNK) {
+                    rate_limiter->Request(pending_bytes);
+                    pending_bytes = 0;
+                }
+            }
+        }
+        if (file) {
+            output.back().FinishFile(file);
+            FileHints::Finish(file, is_preallocated, drop_from_cache);
+            fclose(file);
+        }
+        if (rate_limiter && pending_bytes > 0) {
+            rate_limiter->Request(pending_bytes);
+        }
+        merge_stats.RangeDeletedEntries += it.GetRangeDeletedCount();
+        AddRangeTombstones(output, output_range_tombstones);
+        for (auto& component : output) {
+            merge_stats.WrittenBytes += component.GetBytes();
+        }
+        return output;
     }
 
-    void Delete(std::string& key) {
-        BTree_.Delete(key);
+    // Returns true if the filter removes the entry. Values from the value log are
+    // passed to the filter resolved and written back to the log if the filter changes them.
+    bool ApplyFilter(KVTombstone& kvt, size_t output_level) {
+        if (!kvt.IsValuePointer) {
+            return Filter_->Filter(output_level, kvt.Key, kvt.Value);
+        }
+        V value;
+        ValueLog_->Get(ValuePointer::Decode(kvt.Value), value);
+        V original_value = value;
+        if (Filter_->Filter(output_level, kvt.Key, value)) {
+            return true;
+        }
+        if (value != original_value) {
+            ReleaseValue(kvt);
+            kvt.Value = ValueLog_->Add(kvt.Key, value).Encode();
+        }
+        return false;
     }
 
-private:
-    void MoveComponentPointer(size_t& pointer, size_t read_index, size_t write_index, KVTombstone& kvt, size_t max_size, FILE* file, FILE* tmp_file) {
-        Components_[write_index].WriteToFile(kvt, tmp_file, true);
-        ++pointer;
-        if (pointer != max_size) {
-            Components_[read_index].ReadFromFile(pointer, kvt, file);
+    // Reports the value log record of an entry dropped by a merge as garbage.
+    void ReleaseValue(KVTombstone& kvt) {
+        if (ValueLog_ && kvt.IsValuePointer) {
+            ValueLog_->AddGarbage(ValuePointer::Decode(kvt.Value));
+        }
+    }
+
+    // Splits range tombstones between the output files, every file gets the part
+    // of the key space from its first key up to the first key of the next file.
+    void AddRangeTombstones(std::vector<DiskComponent>& output, RangeTombstoneSet& range_tombstones) {
+        if (range_tombstones.Empty()) {
+            return;
+        }
+        if (output.empty()) {
+            output.emplace_back(NewFileName());
+            fclose(fopen(output.back().GetFileName().c_str(), "wb"));
         }
+        std::vector<std::optional<K>> bounds(output.size() + 1);
+        for (size_t i = 1; i < output.size(); ++i) {
+            bounds[i] = output[i].GetMinKey();
+        }
+        for (size_t i = 0; i < output.size(); ++i) {
+            auto clipped = range_tombstones.Clip(bounds[i], bounds[i + 1]);
+            for (auto& tombstone : clipped.Get()) {
+                output[i].AddRangeTombstone(tombstone);
+            }
+        }
+    }
+
+    void AddMergeStats(MergeStats& merge_stats) {
+        Stats_.DroppedTombstones += merge_stats.DroppedTombstones;
+        Stats_.FilteredEntries += merge_stats.FilteredEntries;
+        Stats_.RangeDeletedEntries += merge_stats.RangeDeletedEntries;
+        Stats_.MergeReadErrors += merge_stats.ReadErrors;
+    }
+
+    // A merge which could not read a block of its inputs leaves them in place and removes its output,
+    // the tree stops taking writes as if it was opened read-only.
+    void FailMerge(std::vector<DiskComponent>& output) {
+        for (auto& component : output) {
+            component.Remove();
+        }
+        IsReadOnly_ = true;
+    }
+
+    static bool VerifyChecksums(DiskComponent& component, const std::string& path) {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) {
+            return false;
+        }
+        bool is_valid = component.VerifyChecksums(file);
+        fclose(file);
+        return is_valid;
+    }
+
+    void ReplaceFiles(CompactionTask& task, std::vector<DiskComponent> output, bool remove_input_files) {
+        for (auto& input : task.Inputs) {
+            auto& run = Levels_[input.Level][input.Run];
+            for (auto it = input.Files.rbegin(); it != input.Files.rend(); ++it) {
+                if (remove_input_files) {
+                    run[*it].Remove();
+                }
+                run.erase(run.begin() + *it);
+            }
+        }
+
+        auto& level = Levels_[task.OutputLevel];
+        if (task.OutputRun && !output.empty()) {
+            auto& run = level[*task.OutputRun];
+            auto pos = std::lower_bound(run.begin(), run.end(), output.front().GetMinKey(),
+                [](DiskComponent& file, const K& key) { return file.GetMinKey() < key; });
+            run.insert(pos, std::make_move_iterator(output.begin()), std::make_move_iterator(output.end()));
+        } else if (!output.empty()) {
+            level.insert(level.begin(), std::move(output));
+        }
+
+        for (auto& cur_level : Levels_) {
+            cur_level.erase(std::remove_if(cur_level.begin(), cur_level.end(),
+                [](SortedRun& run) { return run.empty(); }), cur_level.end());
+        }
+    }
+
+    void ResolveTraces() {
+        if (!Instrumentation_) {
+            return;
+        }
+        auto& i = *Instrumentation_;
+        Traces_.Get = i.GetHandle("get");
+        Traces_.GetRowCache = i.GetHandle("get.row_cache");
+        Traces_.GetNotFound = i.GetHandle("get.not_found");
+        Traces_.GetMemtable = i.GetHandle("get.memtable");
+        Traces_.MultiGet = i.GetHandle("multi_get");
+        Traces_.GetQuery = i.GetHandle("get_query");
+        Traces_.Add = i.GetHandle("add");
+        Traces_.Delete = i.GetHandle("delete");
+        Traces_.DeleteRange = i.GetHandle("delete_range");
+        Traces_.Write = i.GetHandle("write");
+        Traces_.Checkpoint = i.GetHandle("checkpoint");
+        Traces_.Ingest = i.GetHandle("ingest");
+        Traces_.Flush = i.GetHandle("flush");
+        Traces_.Compaction = i.GetHandle("compaction");
+        Traces_.Subcompaction = i.GetHandle("subcompaction");
+        Traces_.GetLevels.clear();
+        Traces_.CompactionLevels.clear();
+        for (size_t level = 0; level < Levels_.size(); ++level) {
+            Traces_.GetLevels.push_back(i.GetHandle("get.level_" + std::to_string(level)));
+            Traces_.CompactionLevels.push_back(i.GetHandle("compaction.level_" + std::to_string(level)));
+        }
+    }
+
+    static LSMOptions MakeOptions(size_t min_degree, size_t max_components, size_t component_size_multiplier,
+                                  std::shared_ptr<CompactionPolicy> compaction_policy, size_t max_file_size) {
+        LSMOptions options;
+        options.MinDegree = min_degree;
+        options.MaxComponents = max_components;
+        options.ComponentSizeMultiplier = component_size_multiplier;
+        options.Policy = std::move(compaction_policy);
+        options.MaxFileSize = max_file_size;
+        return options;
+    }
+
+    static std::unique_ptr<Memtable> CreateMemtable(const LSMOptions& options) {
+        if (options.MemtableType == EMemtableType::AdaptiveRadixTree) {
+            return std::make_unique<ArtTree>();
+        }
+        return std::make_unique<BTree>(options.MinDegree);
+    }
+
+    DiskComponent* FindFile(SortedRun& run, std::string& key) {
+        auto it = std::upper_bound(run.begin(), run.end(), key,
+            [](const K& key, DiskComponent& file) { return key < file.GetMinKey(); });
+        if (it == run.begin()) {
+            return nullptr;
+        }
+        --it;
+        return key <= it->GetMaxKey() ? &*it : nullptr;
+    }
+
+    RunShape GetRunShape(SortedRun& run) {
+        RunShape shape;
+        for (auto& file : run) {
+            shape.push_back({ file.GetSize(), file.GetMinKey(), file.GetMaxKey() });
+        }
+        return shape;
+    }
+
+    bool MemtableOverlaps(const K& min_key, const K& max_key) {
+        K start_key = min_key;
+        K end_key = max_key;
+        if (!Memtable_->GetQuery(start_key, end_key).empty()) {
+            return true;
+        }
+        for (auto& tombstone : MemRangeTombstones_.Get()) {
+            if (tombstone.Start <= max_key && min_key < tombstone.End) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Moves an ingested file to the lowest level it can go to, or merges it into the first
+    // level the same way a flushed memtable is merged.
+    void IngestFile(DiskComponent file) {
+        auto overlaps = [this, &file](size_t level) {
+            for (auto& run : Levels_[level]) {
+                if (!GetOverlappingFiles(GetRunShape(run), file.GetMinKey(), file.GetMaxKey()).empty()) {
+                    return true;
+                }
+            }
+            return false;
+        };
+        if (!overlaps(0)) {
+            size_t level = 0;
+            while (level + 1 < Levels_.size() && !overlaps(level + 1)) {
+                ++level;
+            }
+            if (Levels_[level].empty()) {
+                Levels_[level].emplace_back();
+            }
+            auto& run = Levels_[level][0];
+            auto pos = std::lower_bound(run.begin(), run.end(), file.GetMinKey(),
+                [](DiskComponent& run_file, const K& key) { return run_file.GetMinKey() < key; });
+            run.insert(pos, std::move(file));
+            ++Stats_.IngestedFiles;
+            return;
+        }
+
+        CompactionTask task;
+        if (Policy_->MergeOnFlush()) {
+            task.Inputs.push_back({ 0, 0, GetOverlappingFiles(GetRunShape(Levels_[0][0]), file.GetMinKey(), file.GetMaxKey()) });
+            task.OutputRun = 0;
+        }
+        MergeInputs inputs;
+        MergeStats merge_stats;
+        inputs.Sources.push_back(std::make_unique<ComponentSource>(file, std::nullopt, std::nullopt, &merge_stats.ReadErrors));
+        inputs.RangeTombstones.push_back(file.GetRangeTombstones());
+        AddSources(task, inputs, merge_stats);
+        bool drop_tombstones = CanDropTombstones(task, file.GetMinKey(), file.GetMaxKey());
+        auto output = WriteFiles(std::move(inputs), std::nullopt, std::nullopt, 0, drop_tombstones, false, merge_stats);
+        if (merge_stats.ReadErrors > 0) {
+            AddMergeStats(merge_stats);
+            FailMerge(output);
+            file.Remove();
+            return;
+        }
+        ReplaceFiles(task, std::move(output), true);
+        Stats_.FlushBytes += merge_stats.WrittenBytes;
+        AddMergeStats(merge_stats);
+        file.Remove();
+        ++Stats_.IngestedFiles;
+        ++Stats_.IngestedFilesMerged;
+    }
+
+    // Reads the levels written by CreateCheckpoint.
+    bool LoadManifest(const LSMOptions& options) {
+        std::ifstream manifest(Directory_ + MANIFEST_FILE_NAME);
+        std::string type;
+        while (manifest >> type) {
+            if (type == "levels") {
+                size_t levels_count = 0;
+                manifest >> levels_count;
+                Levels_.resize(std::max(Levels_.size(), levels_count));
+                ResolveTraces();
+            } else if (type == "file") {
+                size_t level = 0;
+                size_t run = 0;
+                std::string name;
+                manifest >> level >> run >> name;
+                if (!manifest || level >= Levels_.size()) {
+                    return false;
+                }
+                Levels_[level].resize(std::max(Levels_[level].size(), run + 1));
+                DiskComponent file(Directory_ + name);
+                if (!std::filesystem::exists(file.GetFileName()) || !file.LoadMetadata(Directory_ + name + DiskComponent::METADATA_SUFFIX)) {
+                    return false;
+                }
+                Levels_[level][run].push_back(std::move(file));
+            } else if (type == "vlog") {
+                size_t number = 0;
+                size_t bytes = 0;
+                manifest >> number >> bytes;
+                if (!ValueLog_) {
+                    ValueLog_ = std::make_unique<ValueLog>(Directory_ + "vlog_", options.ValueLogFileSize);
+                }
+                ValueLog_->AddFile(number, bytes);
+            } else {
+                return false;
+            }
+        }
+        return manifest.eof();
+    }
+
+    // Hard links the file, or copies it if the target is on another file system.
+    // A file left at the target (e.g. by an earlier tree in the directory) is replaced.
+    static bool LinkFile(const std::filesystem::path& from, const std::filesystem::path& to) {
+        std::error_code error;
+        std::filesystem::remove(to, error);
+        std::filesystem::create_hard_link(from, to, error);
+        if (error) {
+            error.clear();
+            std::filesystem::copy_file(from, to, error);
+        }
+        return !error;
+    }
+
+    static size_t GetMicrosSince(std::chrono::steady_clock::time_point start) {
+        auto duration = std::chrono::steady_clock::now() - start;
+        return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    }
+
+    // A file left under the name by an earlier tree is removed, so that a new file never
+    // overwrites data hard linked into a checkpoint or from an ingested file.
+    std::string NewFileName() {
+        std::string file_name = Directory_ + "file_" + std::to_string(NextFileNumber_.fetch_add(1));
+        std::remove(file_name.c_str());
+        return file_name;
     }
 
-    const size_t BUFFER_SIZE = 1024;
+    // Compaction writes are passed to the rate limiter in chunks of this many bytes.
+    static constexpr size_t RATE_LIMITER_CHUNK = 4096;
+    static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+    static constexpr const char* MANIFEST_FILE_NAME = "MANIFEST";
+    static constexpr const char* MANIFEST_TMP_FILE_NAME = "MANIFEST.tmp";
 
+    std::string Directory_;
     size_t MaxComponents_;
     size_t ComponentSizeMultiplier_;
-    BTree BTree_;
-    std::vector<std::string> FileNames_;
-    std::vector<DiskComponent> Components_ = {};
+    size_t MaxFileSize_;
+    std::unique_ptr<Memtable> Memtable_;
+    RangeTombstoneSet MemRangeTombstones_;
+    std::shared_ptr<CompactionPolicy> Policy_;
+    std::shared_ptr<CompactionFilter> Filter_;
+    // Sorted runs of every level, the newest run goes first.
+    std::vector<std::vector<SortedRun>> Levels_;
+    std::atomic<size_t> NextFileNumber_ = 0;
+    LSMStats Stats_;
+    std::unique_ptr<ThreadPool> SubcompactionPool_;
+    size_t ValueLogThreshold_;
+    double ValueLogGarbageRatio_;
+    std::unique_ptr<ValueLog> ValueLog_;
+    bool IsCollectingGarbage_ = false;
+    std::unique_ptr<RowCache> RowCache_;
+    // Issues the block reads of MultiGet, range scans and compactions together, not set if
+    // ReadQueueDepth is zero.
+    std::shared_ptr<ReadEngine> ReadEngine_;
+    size_t MaxCompactionsPerFlush_;
+    size_t LearnedIndexError_;
+    bool HashIndex_;
+    EChecksumVerification ChecksumVerification_;
+    bool CompactionBypassCache_;
+    bool CompactionPreallocate_;
+    // Value of tombstones, FixedValueSize zero bytes.
+    V TombstoneValue_;
+    std::vector<std::shared_ptr<BlockCodec>> Codecs_;
+    std::unique_ptr<RateLimiter> CompactionRateLimiter_;
+    std::unique_ptr<WriteController> WriteController_;
+    std::shared_ptr<Instrumentation> Instrumentation_;
+    TraceHandles Traces_;
+    bool IsReadOnly_ = false;
 };
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "../common/type_codec.h"
+#include "tree.h"
+
+#include <utility>
+#include <vector>
+
+// LSM-tree with typed keys and values (common/type_codec.h), e.g.
+// TypedLSMTree<FixedSizeCodec<std::array<char, 10>>, FixedSizeCodec<std::array<char, 10>>>.
+// Keys and values are encoded into buffers which are reused between calls, fixed-size ones of
+// up to 15 bytes are not allocated. With a fixed-size value codec the tree keeps every entry of
+// a file at one size, so the offset index of the file stores nothing per entry. Not thread safe.
+template <typename KeyCodec, typename ValueCodec>
+class TypedLSMTree {
+public:
+    using Key = typename KeyCodec::Type;
+    using Value = typename ValueCodec::Type;
+
+    TypedLSMTree(LSMOptions options = LSMOptions())
+        : Tree_(WithFixedSizes(std::move(options)))
+    {}
+
+    // Decodes the value in place, without copying it out of the memtable or a file.
+    bool Get(const Key& key, Value& value) {
+        KeyCodec::Encode(key, KeyBytes_);
+        PinnedValue pinned_value;
+        if (!Tree_.GetPinned(KeyBytes_, pinned_value)) {
+            return false;
+        }
+        value = ValueCodec::Decode(pinned_value.View());
+        return true;
+    }
+
+    // Keys from [start_key, end_key] in order.
+    std::vector<std::pair<Key, Value>> GetQuery(const Key& start_key, const Key& end_key) {
+        KeyCodec::Encode(start_key, KeyBytes_);
+        KeyCodec::Encode(end_key, EndKeyBytes_);
+        std::vector<std::pair<Key, Value>> result;
+        for (auto& [key, value] : Tree_.GetQuery(KeyBytes_, EndKeyBytes_)) {
+            result.emplace_back(KeyCodec::Decode(key), ValueCodec::Decode(value));
+        }
+        return result;
+    }
+
+    void Add(const Key& key, const Value& value) {
+        KeyCodec::Encode(key, KeyBytes_);
+        ValueCodec::Encode(value, ValueBytes_);
+        Tree_.Add(KeyBytes_, ValueBytes_);
+    }
+
+    void Delete(const Key& key) {
+        KeyCodec::Encode(key, KeyBytes_);
+        Tree_.Delete(KeyBytes_);
+    }
+
+    // Deletes all keys from [start_key, end_key).
+    void DeleteRange(const Key& start_key, const Key& end_key) {
+        KeyCodec::Encode(start_key, KeyBytes_);
+        KeyCodec::Encode(end_key, EndKeyBytes_);
+        Tree_.DeleteRange(KeyBytes_, EndKeyBytes_);
+    }
+
+    // The untyped tree, for statistics, checkpoints and compactions.
+    LSMTree& GetTree() {
+        return Tree_;
+    }
+
+private:
+    static LSMOptions WithFixedSizes(LSMOptions options) {
+        if constexpr (ValueCodec::SIZE > 0) {
+            options.FixedValueSize = ValueCodec::SIZE;
+        }
+        return options;
+    }
+
+    std::string KeyBytes_;
+    std::string EndKeyBytes_;
+    std::string ValueBytes_;
+    LSMTree Tree_;
+};
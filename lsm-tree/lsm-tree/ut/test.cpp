@@ -1,8 +1,16 @@
+#include "../sharded_tree.h"
 #include "../tree.h"
+#include "../typed_tree.h"
 
 #include <gtest/gtest.h>
 #include <algorithm>
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <filesystem>
 #include <random>
+#include <set>
+#include <thread>
 
 std::string GenString(size_t len) {
     std::random_device rd;
@@ -89,6 +97,1483 @@ TEST(LSMTreeTest, TestQuery)
     }
 }
 
+TEST(LSMTreeTest, TestTieredReadWrite)
+{
+    LSMTree tree(2, 3, 10, std::make_shared<TieredCompactionPolicy>(4));
+    ASSERT_EQ(tree.GetCompactionPolicyName(), "tiered");
+
+    auto key_values = GenKeyValues(2000);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    for (size_t i = 0; i < 500; ++i) {
+        key_values[i].second = GenString(10);
+        tree.Add(key_values[i].first, key_values[i].second);
+    }
+    for (auto& kv : key_values) {
+        std::string result;
+        ASSERT_EQ(tree.Get(kv.first, result), true);
+        ASSERT_EQ(result, kv.second);
+    }
+
+    sort(key_values.begin(), key_values.end());
+    auto result = tree.GetQuery(key_values[300].first, key_values[500].first);
+    ASSERT_EQ(result.size(), 201);
+    for (int i = 300; i < 501; ++i) {
+        ASSERT_EQ(result[i - 300].second, key_values[i].second);
+    }
+}
+
+TEST(LSMTreeTest, TestTieredDelete)
+{
+    LSMTree tree(2, 3, 10, std::make_shared<TieredCompactionPolicy>(4));
+
+    auto key_values = GenKeyValues(1000);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    for (auto& kv : key_values) {
+        std::string result;
+        tree.Delete(kv.first);
+        ASSERT_EQ(tree.Get(kv.first, result), false);
+    }
+}
+
+TEST(LSMTreeTest, TestAmplificationStats)
+{
+    auto key_values = GenKeyValues(3000);
+
+    auto get_stats = [&key_values](std::shared_ptr<CompactionPolicy> policy) {
+        LSMTree tree(2, 3, 10, policy);
+        for (auto& kv : key_values) {
+            tree.Add(kv.first, kv.second);
+        }
+        return tree.GetStats();
+    };
+
+    auto leveled_stats = get_stats(std::make_shared<LeveledCompactionPolicy>(10));
+    auto tiered_stats = get_stats(std::make_shared<TieredCompactionPolicy>(10));
+    ASSERT_EQ(leveled_stats.UserBytes, tiered_stats.UserBytes);
+    ASSERT_GT(leveled_stats.WriteAmplification(), tiered_stats.WriteAmplification());
+    ASSERT_LT(leveled_stats.ReadAmplification, tiered_stats.ReadAmplification);
+}
+
+TEST(LSMTreeTest, TestLevelStats)
+{
+    LSMTree tree(2, 3, 10);
+
+    auto key_values = GenKeyValues(3000);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    auto stats = tree.GetStats();
+    ASSERT_EQ(stats.Levels.size(), 3);
+    size_t entries = stats.MemtableEntries;
+    for (auto& level : stats.Levels) {
+        ASSERT_LE(level.Runs, 1);
+        entries += level.Entries;
+    }
+    // Leveled compaction keeps every key once.
+    ASSERT_EQ(entries, key_values.size());
+    ASSERT_GT(stats.Levels[2].Bytes, stats.Levels[1].Bytes);
+    ASSERT_GT(stats.CompactionMicros, 0);
+    ASSERT_GE(stats.CompactionMicros, stats.MaxCompactionMicros);
+
+    for (size_t i = 0; i < 1000; ++i) {
+        std::string result;
+        tree.Get(key_values[i].first, result);
+        std::string missing_key = GenString(11);
+        ASSERT_EQ(tree.Get(missing_key, result), false);
+    }
+    stats = tree.GetStats();
+    ASSERT_EQ(stats.Gets, 2000);
+    ASSERT_GE(stats.GetProbes + stats.MemtableHits, 1000);
+    ASSERT_LE(stats.ProbesPerGet(), stats.ReadAmplification);
+    ASSERT_GT(stats.FilterUseful, 0);
+    ASSERT_LT(stats.FilterFalsePositiveRate(), 0.5);
+
+    auto dump = stats.ToString();
+    ASSERT_NE(dump.find("level 2: 1 runs"), std::string::npos);
+    ASSERT_NE(dump.find("gets: 2000"), std::string::npos);
+}
+
+TEST(LSMTreeTest, TestPartitionedLevels)
+{
+    LSMTree tree(2, 3, 10, nullptr, 50);
+
+    auto key_values = GenKeyValues(3000);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    for (auto& kv : key_values) {
+        std::string result;
+        ASSERT_EQ(tree.Get(kv.first, result), true);
+        ASSERT_EQ(result, kv.second);
+    }
+
+    auto levels = tree.GetLevelsShape();
+    for (auto& level : levels) {
+        ASSERT_LE(level.size(), 1);
+        for (auto& run : level) {
+            for (size_t i = 0; i < run.size(); ++i) {
+                ASSERT_LE(run[i].Size, 50);
+                ASSERT_LE(run[i].MinKey, run[i].MaxKey);
+                if (i > 0) {
+                    ASSERT_LT(run[i - 1].MaxKey, run[i].MinKey);
+                }
+            }
+        }
+    }
+    ASSERT_GT(levels[2][0].size(), 1);
+
+    sort(key_values.begin(), key_values.end());
+    auto result = tree.GetQuery(key_values[1000].first, key_values[2000].first);
+    ASSERT_EQ(result.size(), 1001);
+    for (int i = 1000; i < 2001; ++i) {
+        ASSERT_EQ(result[i - 1000].second, key_values[i].second);
+    }
+}
+
+TEST(LSMTreeTest, TestTrivialMove)
+{
+    LSMTree tree(2, 3, 10, nullptr, 50);
+
+    auto key_values = GenKeyValues(3000);
+    sort(key_values.begin(), key_values.end());
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    for (auto& kv : key_values) {
+        std::string result;
+        ASSERT_EQ(tree.Get(kv.first, result), true);
+        ASSERT_EQ(result, kv.second);
+    }
+
+    auto stats = tree.GetStats();
+    ASSERT_GT(stats.TrivialMoves, 0);
+    ASSERT_EQ(stats.CompactionBytes, 0);
+}
+
+TEST(LSMTreeTest, TestSubcompactions)
+{
+    LSMOptions options;
+    options.MaxComponents = 3;
+    options.Policy = std::make_shared<TieredCompactionPolicy>(4);
+    options.MaxFileSize = 20;
+    options.MaxSubcompactions = 4;
+    LSMTree tree(options);
+
+    auto key_values = GenKeyValues(3000);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    for (size_t i = 0; i < 1000; ++i) {
+        tree.Delete(key_values[i].first);
+    }
+    for (size_t i = 0; i < key_values.size(); ++i) {
+        std::string result;
+        ASSERT_EQ(tree.Get(key_values[i].first, result), i >= 1000);
+        if (i >= 1000) {
+            ASSERT_EQ(result, key_values[i].second);
+        }
+    }
+    ASSERT_GT(tree.GetStats().ParallelCompactions, 0);
+
+    auto levels = tree.GetLevelsShape();
+    for (auto& level : levels) {
+        for (auto& run : level) {
+            for (size_t i = 1; i < run.size(); ++i) {
+                ASSERT_LT(run[i - 1].MaxKey, run[i].MinKey);
+            }
+        }
+    }
+}
+
+size_t GetEntriesOnDisk(LSMTree& tree) {
+    size_t result = 0;
+    for (auto& level : tree.GetLevelsShape()) {
+        for (auto& run : level) {
+            result += GetRunSize(run);
+        }
+    }
+    return result;
+}
+
+TEST(LSMTreeTest, TestBottomTombstones)
+{
+    LSMTree tree(2, 1, 10);
+
+    auto key_values = GenKeyValues(1000);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    for (auto& kv : key_values) {
+        tree.Delete(kv.first);
+    }
+    for (auto& kv : key_values) {
+        std::string result;
+        ASSERT_EQ(tree.Get(kv.first, result), false);
+    }
+    ASSERT_GT(tree.GetStats().DroppedTombstones, 0);
+    ASSERT_LT(GetEntriesOnDisk(tree), 20);
+}
+
+TEST(LSMTreeTest, TestTombstonesKeptAboveOlderData)
+{
+    LSMTree tree(2, 3, 10);
+
+    auto key_values = GenKeyValues(2000);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    for (size_t i = 0; i < 1000; ++i) {
+        tree.Delete(key_values[i].first);
+    }
+    for (size_t i = 0; i < key_values.size(); ++i) {
+        std::string result;
+        ASSERT_EQ(tree.Get(key_values[i].first, result), i >= 1000);
+    }
+}
+
+class PrefixFilter : public CompactionFilter {
+public:
+    bool Filter(size_t /*output_level*/, const K& key, V& value) override {
+        if (key.rfind("ttl_", 0) == 0) {
+            return true;
+        }
+        if (value.size() == 10) {
+            value += "_seen";
+        }
+        return false;
+    }
+};
+
+TEST(LSMTreeTest, TestCompactionFilter)
+{
+    LSMOptions options;
+    options.MaxComponents = 3;
+    options.Filter = std::make_shared<PrefixFilter>();
+    LSMTree tree(options);
+
+    auto key_values = GenKeyValues(1500);
+    for (size_t i = 0; i < 500; ++i) {
+        key_values[i].first = "ttl_" + key_values[i].first;
+    }
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    for (size_t i = 0; i < 1000; ++i) {
+        std::string result;
+        ASSERT_EQ(tree.Get(key_values[i].first, result), i >= 500);
+        if (i >= 500) {
+            ASSERT_EQ(result, key_values[i].second + "_seen");
+        }
+    }
+    ASSERT_GE(tree.GetStats().FilteredEntries, 500);
+}
+
+// Keeps entries on flushes and removes them once they are compacted into a deeper level.
+class LevelFilter : public CompactionFilter {
+public:
+    bool Filter(size_t output_level, const K& key, V& /*value*/) override {
+        if (output_level == 0) {
+            ++FlushedEntries;
+            return false;
+        }
+        CompactedKeys.insert(key);
+        return true;
+    }
+
+    size_t FlushedEntries = 0;
+    std::set<K> CompactedKeys;
+};
+
+TEST(LSMTreeTest, TestCompactionFilterLevel)
+{
+    auto filter = std::make_shared<LevelFilter>();
+    LSMOptions options;
+    options.MaxComponents = 3;
+    options.Filter = filter;
+    LSMTree tree(options);
+
+    auto key_values = GenKeyValues(1500);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    ASSERT_GE(filter->FlushedEntries, 1000);
+    ASSERT_GT(filter->CompactedKeys.size(), 0);
+    ASSERT_LT(filter->CompactedKeys.size(), key_values.size());
+    for (auto& kv : key_values) {
+        std::string result;
+        bool is_compacted = filter->CompactedKeys.count(kv.first) > 0;
+        ASSERT_EQ(tree.Get(kv.first, result), !is_compacted);
+        if (!is_compacted) {
+            ASSERT_EQ(result, kv.second);
+        }
+    }
+}
+
+TEST(LSMTreeTest, TestDeleteRange)
+{
+    LSMTree tree(2, 3, 10, nullptr, 50);
+
+    auto key_values = GenKeyValues(3000);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    sort(key_values.begin(), key_values.end());
+
+    size_t flushes = tree.GetStats().Flushes;
+    tree.DeleteRange(key_values[1000].first, key_values[2000].first);
+    ASSERT_LE(tree.GetStats().Flushes, flushes + 1);
+
+    tree.Add(key_values[1500].first, key_values[1500].second);
+    auto check = [&tree, &key_values]() {
+        for (size_t i = 0; i < key_values.size(); ++i) {
+            std::string result;
+            bool is_alive = i < 1000 || i >= 2000 || i == 1500;
+            ASSERT_EQ(tree.Get(key_values[i].first, result), is_alive);
+            if (is_alive) {
+                ASSERT_EQ(result, key_values[i].second);
+            }
+        }
+        auto result = tree.GetQuery(key_values[900].first, key_values[2100].first);
+        ASSERT_EQ(result.size(), 202);
+        ASSERT_EQ(result[100].first, key_values[1500].first);
+    };
+    check();
+
+    auto other_key_values = GenKeyValues(3000);
+    for (auto& kv : other_key_values) {
+        if (kv.first < key_values[900].first || kv.first > key_values[2100].first) {
+            tree.Add(kv.first, kv.second);
+        }
+    }
+    check();
+    ASSERT_GT(tree.GetStats().RangeDeletedEntries, 0);
+}
+
+TEST(LSMTreeTest, TestDeleteRangeInMemtable)
+{
+    LSMTree tree(2, 2, 100);
+
+    auto key_values = GenKeyValues(50);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    sort(key_values.begin(), key_values.end());
+    tree.DeleteRange(key_values[10].first, key_values[20].first);
+    for (size_t i = 0; i < key_values.size(); ++i) {
+        std::string result;
+        ASSERT_EQ(tree.Get(key_values[i].first, result), i < 10 || i >= 20);
+    }
+}
+
+TEST(LSMTreeTest, TestValueLog)
+{
+    auto run = [](size_t value_log_threshold) {
+        LSMOptions options;
+        options.MaxComponents = 3;
+        options.ValueLogThreshold = value_log_threshold;
+        options.ValueLogFileSize = 64 * 1024;
+        LSMTree tree(options);
+
+        auto key_values = GenKeyValues(500);
+        for (size_t round = 0; round < 4; ++round) {
+            for (auto& kv : key_values) {
+                kv.second = GenString(1000);
+                tree.Add(kv.first, kv.second);
+            }
+        }
+        for (auto& kv : key_values) {
+            std::string result;
+            EXPECT_EQ(tree.Get(kv.first, result), true);
+            EXPECT_EQ(result, kv.second);
+        }
+        sort(key_values.begin(), key_values.end());
+        auto result = tree.GetQuery(key_values[100].first, key_values[200].first);
+        EXPECT_EQ(result.size(), 101);
+        for (size_t i = 0; i < result.size(); ++i) {
+            EXPECT_EQ(result[i].second, key_values[100 + i].second);
+        }
+        return tree.GetStats();
+    };
+
+    auto inline_stats = run(0);
+    auto separated_stats = run(100);
+    ASSERT_GT(separated_stats.ValueLogCollections, 0);
+    ASSERT_GT(separated_stats.ValueLogBytes, 0);
+    ASSERT_LT(separated_stats.CompactionBytes * 10, inline_stats.CompactionBytes);
+}
+
+TEST(LSMTreeTest, TestWriteBatch)
+{
+    LSMTree tree(2, 3, 10);
+
+    auto key_values = GenKeyValues(2000);
+    WriteBatch batch;
+    for (size_t i = 0; i < key_values.size(); ++i) {
+        batch.Put(key_values[i].first, key_values[i].second);
+        if (batch.Size() == 50) {
+            tree.Write(batch);
+            batch.Clear();
+        }
+    }
+    ASSERT_EQ(tree.GetStats().WriteBatches, 40);
+    ASSERT_LE(tree.GetStats().Flushes, 40);
+
+    for (size_t i = 0; i < key_values.size(); i += 2) {
+        batch.Delete(key_values[i].first);
+    }
+    tree.Write(batch);
+    batch.Clear();
+
+    for (size_t i = 0; i < key_values.size(); ++i) {
+        std::string result;
+        ASSERT_EQ(tree.Get(key_values[i].first, result), i % 2 == 1);
+        if (i % 2 == 1) {
+            ASSERT_EQ(result, key_values[i].second);
+        }
+    }
+
+    // Operations of a batch are applied in order.
+    std::string key = "key";
+    std::string value = "value";
+    std::string end_key = "kez";
+    batch.Put(key, value);
+    batch.DeleteRange(key, end_key);
+    batch.Put(key, end_key);
+    tree.Write(batch);
+    std::string result;
+    ASSERT_EQ(tree.Get(key, result), true);
+    ASSERT_EQ(result, end_key);
+}
+
+TEST(LSMTreeTest, TestGetPinned)
+{
+    LSMTree tree(2, 3, 10);
+
+    auto key_values = GenKeyValues(500);
+    for (auto& kv : key_values) {
+        kv.second = GenString(1000);
+        tree.Add(kv.first, kv.second);
+    }
+
+    // Values from the memtable and from the files stay valid after they are overwritten and compacted.
+    std::vector<PinnedValue> pinned_values(key_values.size());
+    for (size_t i = 0; i < key_values.size(); ++i) {
+        ASSERT_EQ(tree.GetPinned(key_values[i].first, pinned_values[i]), true);
+        ASSERT_EQ(pinned_values[i].View(), key_values[i].second);
+    }
+    for (auto& kv : key_values) {
+        std::string value = GenString(10);
+        tree.Add(kv.first, value);
+    }
+    for (size_t i = 0; i < key_values.size(); ++i) {
+        ASSERT_EQ(pinned_values[i].View(), key_values[i].second);
+    }
+
+    tree.Delete(key_values[0].first);
+    ASSERT_EQ(tree.GetPinned(key_values[0].first, pinned_values[0]), false);
+    ASSERT_EQ(pinned_values[0].IsPinned(), false);
+}
+
+TEST(LSMTreeTest, TestRowCache)
+{
+    LSMOptions options;
+    options.MaxComponents = 3;
+    options.RowCacheSize = 64 * 1024;
+    options.RowCacheShards = 4;
+    LSMTree tree(options);
+
+    auto key_values = GenKeyValues(1000);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+
+    // A few hot keys are read many times.
+    for (size_t round = 0; round < 10; ++round) {
+        for (size_t i = 0; i < 100; ++i) {
+            std::string result;
+            ASSERT_EQ(tree.Get(key_values[i].first, result), true);
+            ASSERT_EQ(result, key_values[i].second);
+        }
+    }
+    auto stats = tree.GetStats();
+    ASSERT_GE(stats.RowCacheHits, 900);
+    ASSERT_GT(stats.RowCacheHitRate(), 0.8);
+    ASSERT_GT(stats.RowCacheUsage, 0);
+    ASSERT_LE(stats.RowCacheUsage, options.RowCacheSize);
+
+    // Writes are visible right away.
+    std::string new_value = "new_value";
+    tree.Add(key_values[0].first, new_value);
+    tree.Delete(key_values[1].first);
+    std::string result;
+    ASSERT_EQ(tree.Get(key_values[0].first, result), true);
+    ASSERT_EQ(result, new_value);
+    ASSERT_EQ(tree.Get(key_values[1].first, result), false);
+
+    std::string start_key = key_values[2].first;
+    std::string end_key = start_key + "a";
+    tree.DeleteRange(start_key, end_key);
+    ASSERT_EQ(tree.Get(key_values[2].first, result), false);
+}
+
+TEST(LSMTreeTest, TestRowCacheEviction)
+{
+    RowCache cache(4 * 1024, 1);
+    for (size_t i = 0; i < 100; ++i) {
+        cache.Insert(std::to_string(i), std::make_shared<const V>(100, 'a'));
+    }
+    ASSERT_LE(cache.GetUsage(), 4 * 1024);
+
+    PinnedValue value;
+    ASSERT_EQ(cache.Lookup("0", value), false);
+    ASSERT_EQ(cache.Lookup("99", value), true);
+    ASSERT_EQ(value.View(), std::string(100, 'a'));
+    cache.Erase("99");
+    ASSERT_EQ(value.Size(), 100);
+    ASSERT_EQ(cache.Lookup("99", value), false);
+    ASSERT_EQ(cache.GetHits(), 1);
+    ASSERT_EQ(cache.GetMisses(), 2);
+}
+
+TEST(LSMTreeTest, TestShardedTree)
+{
+    LSMOptions options;
+    options.Directory = "sharded";
+    options.MaxComponents = 3;
+    ShardedLSMTree tree(4, options);
+
+    auto key_values = GenKeyValues(4000);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            for (size_t i = t; i < key_values.size(); i += 4) {
+                tree.Add(key_values[i].first, key_values[i].second);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (size_t i = 0; i < tree.GetShardsCount(); ++i) {
+        ASSERT_GT(tree.GetStats(i).Flushes, 0);
+    }
+
+    for (size_t i = 0; i < key_values.size(); i += 2) {
+        tree.Delete(key_values[i].first);
+    }
+    for (size_t i = 0; i < key_values.size(); ++i) {
+        std::string result;
+        ASSERT_EQ(tree.Get(key_values[i].first, result), i % 2 == 1);
+        if (i % 2 == 1) {
+            ASSERT_EQ(result, key_values[i].second);
+        }
+    }
+
+    std::vector<std::pair<std::string, std::string>> expected;
+    for (size_t i = 1; i < key_values.size(); i += 2) {
+        expected.push_back(key_values[i]);
+    }
+    sort(expected.begin(), expected.end());
+    auto result = tree.GetQuery(expected[100].first, expected[1000].first);
+    ASSERT_EQ(result.size(), 901);
+    for (size_t i = 0; i < result.size(); ++i) {
+        ASSERT_EQ(result[i], expected[100 + i]);
+    }
+}
+
+TEST(LSMTreeTest, TestShardedTreeWriteBatch)
+{
+    LSMOptions options;
+    options.Directory = "sharded_batch";
+    options.MaxComponents = 3;
+    ShardedLSMTree tree(4, options);
+
+    // Every batch rewrites all keys with the same value, so a scan which sees a part
+    // of a batch finds two different values.
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < 100; ++i) {
+        keys.push_back("key_" + std::to_string(1000 + i));
+    }
+    std::atomic<bool> is_done = false;
+    std::thread writer([&] {
+        for (size_t round = 0; round < 200; ++round) {
+            WriteBatch batch;
+            for (auto& key : keys) {
+                batch.Put(key, "value_" + std::to_string(round));
+            }
+            tree.Write(batch);
+        }
+        is_done = true;
+    });
+    std::string start_key = keys.front();
+    std::string end_key = keys.back();
+    size_t scans = 0;
+    while (!is_done || scans == 0) {
+        auto result = tree.GetQuery(start_key, end_key);
+        ++scans;
+        if (result.empty()) {
+            continue;
+        }
+        ASSERT_EQ(result.size(), keys.size());
+        for (auto& kv : result) {
+            ASSERT_EQ(kv.second, result.front().second);
+        }
+    }
+    writer.join();
+    for (auto& key : keys) {
+        std::string result;
+        ASSERT_EQ(tree.Get(key, result), true);
+        ASSERT_EQ(result, "value_199");
+    }
+}
+
+// Leveled policy which notes when two compactions pick files through it at the same time.
+class ExclusiveLeveledPolicy : public LeveledCompactionPolicy {
+public:
+    ExclusiveLeveledPolicy(size_t multiplier, std::shared_ptr<std::atomic<size_t>> clones,
+                           std::shared_ptr<std::atomic<bool>> is_shared)
+        : LeveledCompactionPolicy(multiplier)
+        , Multiplier_(multiplier)
+        , Clones_(std::move(clones))
+        , IsShared_(std::move(is_shared))
+    {}
+
+    std::optional<CompactionTask> PickCompaction(LevelsShape& levels) override {
+        if (InUse_.exchange(true)) {
+            *IsShared_ = true;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        auto task = LeveledCompactionPolicy::PickCompaction(levels);
+        InUse_ = false;
+        return task;
+    }
+
+    std::shared_ptr<CompactionPolicy> Clone() override {
+        ++*Clones_;
+        return std::make_shared<ExclusiveLeveledPolicy>(Multiplier_, Clones_, IsShared_);
+    }
+
+private:
+    size_t Multiplier_;
+    std::shared_ptr<std::atomic<size_t>> Clones_;
+    std::shared_ptr<std::atomic<bool>> IsShared_;
+    std::atomic<bool> InUse_ = false;
+};
+
+TEST(LSMTreeTest, TestShardedTreePolicies)
+{
+    auto clones = std::make_shared<std::atomic<size_t>>(0);
+    auto is_shared = std::make_shared<std::atomic<bool>>(false);
+    LSMOptions options;
+    options.Directory = "sharded_policies";
+    options.MaxComponents = 3;
+    options.Policy = std::make_shared<ExclusiveLeveledPolicy>(10, clones, is_shared);
+    ShardedLSMTree tree(4, options);
+    ASSERT_EQ(*clones, 4);
+    ASSERT_EQ(options.Policy.use_count(), 1);
+
+    // Every shard compacts under its own lock, through its own policy.
+    auto key_values = GenKeyValues(8000);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            for (size_t i = t; i < key_values.size(); i += 4) {
+                tree.Add(key_values[i].first, key_values[i].second);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    ASSERT_FALSE(*is_shared);
+    for (size_t i = 0; i < tree.GetShardsCount(); ++i) {
+        ASSERT_GT(tree.GetStats(i).Compactions, 0);
+    }
+    for (auto& kv : key_values) {
+        std::string result;
+        ASSERT_EQ(tree.Get(kv.first, result), true);
+        ASSERT_EQ(result, kv.second);
+    }
+}
+
+TEST(LSMTreeTest, TestCompactionRateLimit)
+{
+    // Tokens never exceed the burst however long the limiter was idle, so a request of
+    // 10KB over the burst always waits at least the time 10KB take at the rate.
+    RateLimiter limiter(1024 * 1024, 100 * 1024);
+    limiter.Request(110 * 1024);
+    ASSERT_EQ(limiter.GetWaits(), 1);
+    ASSERT_GE(limiter.GetWaitMicros(), 10 * 1024 * 1000000ull / (1024 * 1024));
+    ASSERT_EQ(limiter.GetRequestedBytes(), 110 * 1024);
+
+    LSMOptions options;
+    options.MaxComponents = 3;
+    options.CompactionRateLimit = 1024 * 1024;
+    LSMTree tree(options);
+
+    auto key_values = GenKeyValues(2000);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    // Every byte written by compactions and none written by flushes goes through the limiter.
+    auto stats = tree.GetStats();
+    ASSERT_GT(stats.CompactionBytes, 0);
+    ASSERT_EQ(stats.CompactionRateLimitedBytes, stats.CompactionBytes);
+
+    for (auto& kv : key_values) {
+        std::string result;
+        ASSERT_EQ(tree.Get(kv.first, result), true);
+        ASSERT_EQ(result, kv.second);
+    }
+}
+
+TEST(LSMTreeTest, TestWriteStall)
+{
+    LSMOptions options;
+    options.MaxComponents = 3;
+    options.MaxFileSize = 10;
+    options.MaxCompactionsPerFlush = 1;
+    options.SlowdownCompactionDebt = 50;
+    options.StopCompactionDebt = 200;
+    options.DelayedWriteRate = 20 * 1024;
+    LSMTree tree(options);
+
+    auto key_values = GenKeyValues(2000);
+    size_t max_debt = 0;
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+        max_debt = std::max(max_debt, tree.GetStats().CompactionDebt);
+    }
+    // One compaction per flush does not keep up, so writers were slowed down and stopped,
+    // but the debt never reached the stop threshold. Every slowed write (a 10 byte key,
+    // a 10 byte value and a flag) went through the limiter; whether it had to wait for
+    // it depends on the speed of the machine.
+    auto stats = tree.GetStats();
+    ASSERT_GT(stats.SlowedWrites, 0);
+    ASSERT_EQ(stats.SlowedWriteBytes, stats.SlowedWrites * 21);
+    ASSERT_GT(stats.WriteStops, 0);
+    ASSERT_LT(max_debt, options.StopCompactionDebt);
+
+    for (auto& kv : key_values) {
+        std::string result;
+        ASSERT_EQ(tree.Get(kv.first, result), true);
+        ASSERT_EQ(result, kv.second);
+    }
+}
+
+TEST(LSMTreeTest, TestInstrumentation)
+{
+    LSMOptions options;
+    options.MaxComponents = 3;
+    options.Instrumentation = std::make_shared<Instrumentation>(true);
+    LSMTree tree(options);
+
+    auto key_values = GenKeyValues(2000);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    for (auto& kv : key_values) {
+        std::string result;
+        tree.Get(kv.first, result);
+    }
+    tree.GetQuery(key_values[0].first, key_values[1].first);
+
+    auto histograms = options.Instrumentation->GetHistograms();
+    ASSERT_EQ(histograms["add"].GetCount(), 2000);
+    ASSERT_EQ(histograms["get"].GetCount(), 2000);
+    ASSERT_EQ(histograms["get_query"].GetCount(), 1);
+    ASSERT_EQ(histograms["flush"].GetCount(), tree.GetStats().Flushes);
+    ASSERT_GT(histograms["compaction"].GetCount(), 0);
+    size_t per_source_gets = histograms["get.memtable"].GetCount();
+    for (size_t level = 0; level < 3; ++level) {
+        per_source_gets += histograms["get.level_" + std::to_string(level)].GetCount();
+    }
+    ASSERT_EQ(per_source_gets, 2000);
+
+    auto& get = histograms["get"];
+    ASSERT_LE(get.Percentile(0.5), get.Percentile(0.99));
+    ASSERT_LE(get.Percentile(0.99), get.Percentile(0.999));
+    ASSERT_LE(get.Percentile(0.999), get.GetMax());
+
+    auto trace = options.Instrumentation->ExportChromeTrace();
+    ASSERT_EQ(trace.rfind("{\"traceEvents\":[", 0), 0);
+    ASSERT_NE(trace.find("\"name\":\"flush\""), std::string::npos);
+    ASSERT_NE(options.Instrumentation->ToString().find("get.level_"), std::string::npos);
+
+    // Trees sharing the instrumentation record into the same operations.
+    LSMTree other(options);
+    std::string result;
+    other.Get(key_values[0].first, result);
+    ASSERT_EQ(options.Instrumentation->GetHistograms()["get"].GetCount(), 2001);
+    ASSERT_EQ(options.Instrumentation->GetHandle("get"), options.Instrumentation->GetHandle("get"));
+}
+
+TEST(LSMTreeTest, TestLatencyHistogram)
+{
+    LatencyHistogram histogram;
+    for (size_t i = 1; i <= 10000; ++i) {
+        histogram.Record(i);
+    }
+    ASSERT_EQ(histogram.GetCount(), 10000);
+    ASSERT_EQ(histogram.GetMax(), 10000);
+    ASSERT_NEAR(histogram.Percentile(0.5), 5000, 5000 / 16);
+    ASSERT_NEAR(histogram.Percentile(0.99), 9900, 9900 / 16);
+    ASSERT_EQ(histogram.Percentile(1), 10000);
+
+    LatencyHistogram other;
+    other.Record(20000);
+    histogram.Merge(other);
+    ASSERT_EQ(histogram.GetMax(), 20000);
+    ASSERT_EQ(histogram.GetCount(), 10001);
+}
+
+TEST(LSMTreeTest, TestCheckpoint)
+{
+    std::filesystem::remove_all("checkpoint_source");
+    std::filesystem::remove_all("checkpoint");
+    LSMOptions options;
+    options.MaxComponents = 3;
+    options.ValueLogThreshold = 100;
+    options.Directory = "checkpoint_source";
+    LSMTree tree(options);
+
+    auto key_values = GenKeyValues(1000);
+    for (size_t i = 0; i < key_values.size(); ++i) {
+        if (i % 2 == 0) {
+            key_values[i].second = GenString(200);
+        }
+        tree.Add(key_values[i].first, key_values[i].second);
+    }
+    for (size_t i = 0; i < 100; ++i) {
+        tree.Delete(key_values[i].first);
+    }
+    ASSERT_EQ(tree.CreateCheckpoint("checkpoint"), true);
+    ASSERT_EQ(tree.CreateCheckpoint("checkpoint"), false);
+    ASSERT_EQ(tree.GetStats().MemtableEntries, 0);
+
+    // Later writes and compactions of the tree do not change the checkpoint.
+    for (auto& kv : key_values) {
+        std::string value = GenString(10);
+        tree.Add(kv.first, value);
+    }
+
+    auto checkpoint = LSMTree::OpenReadOnly("checkpoint");
+    ASSERT_NE(checkpoint, nullptr);
+    for (size_t i = 0; i < key_values.size(); ++i) {
+        std::string result;
+        ASSERT_EQ(checkpoint->Get(key_values[i].first, result), i >= 100);
+        if (i >= 100) {
+            ASSERT_EQ(result, key_values[i].second);
+        }
+    }
+    std::string value = "value";
+    checkpoint->Add(key_values[0].first, value);
+    std::string result;
+    ASSERT_EQ(checkpoint->Get(key_values[0].first, result), false);
+    ASSERT_EQ(LSMTree::OpenReadOnly("checkpoint_missing"), nullptr);
+}
+
+TEST(LSMTreeTest, TestTreeWithoutLevels)
+{
+    std::filesystem::remove_all("checkpoint_no_levels");
+    LSMOptions options;
+    options.MaxComponents = 0;
+    LSMTree tree(options);
+
+    // Without levels nothing is flushed, so the entries can not be checkpointed.
+    auto key_values = GenKeyValues(100);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    ASSERT_EQ(tree.CreateCheckpoint("checkpoint_no_levels"), false);
+    ASSERT_FALSE(std::filesystem::exists("checkpoint_no_levels"));
+    ASSERT_EQ(tree.IngestExternalFiles({}), false);
+    ASSERT_EQ(tree.GetStats().MemtableEntries, key_values.size());
+    for (auto& kv : key_values) {
+        std::string result;
+        ASSERT_EQ(tree.Get(kv.first, result), true);
+        ASSERT_EQ(result, kv.second);
+    }
+}
+
+TEST(LSMTreeTest, TestTreeInCheckpointDirectory)
+{
+    for (size_t value_log_threshold : { 0, 5 }) {
+        std::filesystem::remove_all("checkpoint_reuse_source");
+        std::filesystem::remove_all("checkpoint_reuse");
+        std::filesystem::remove_all("checkpoint_reuse_copy");
+        LSMOptions options;
+        options.MaxComponents = 3;
+        options.ValueLogThreshold = value_log_threshold;
+        options.Directory = "checkpoint_reuse_source";
+        LSMTree tree(options);
+        auto key_values = GenKeyValues(1000);
+        for (auto& kv : key_values) {
+            tree.Add(kv.first, kv.second);
+        }
+        ASSERT_EQ(tree.CreateCheckpoint("checkpoint_reuse"), true);
+        ASSERT_EQ(tree.CreateCheckpoint("checkpoint_reuse_copy"), true);
+
+        // A new tree in the checkpoint directory numbers its files (and value log files) from
+        // zero again, the names of the hard links to the files of the source tree. Writing
+        // a file must not truncate them.
+        options.Directory = "checkpoint_reuse";
+        LSMTree other_tree(options);
+        for (auto& kv : GenKeyValues(2000)) {
+            other_tree.Add(kv.first, kv.second);
+        }
+        auto checkpoint = LSMTree::OpenReadOnly("checkpoint_reuse_copy", options);
+        ASSERT_NE(checkpoint, nullptr);
+        for (auto& kv : key_values) {
+            std::string result;
+            ASSERT_EQ(tree.Get(kv.first, result), true);
+            ASSERT_EQ(result, kv.second);
+            ASSERT_EQ(checkpoint->Get(kv.first, result), true);
+            ASSERT_EQ(result, kv.second);
+        }
+    }
+}
+
+TEST(LSMTreeTest, TestIngestExternalFiles)
+{
+    LSMTree tree(2, 3, 10);
+    auto key_values = GenKeyValues(2000);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    auto compaction_bytes = tree.GetStats().CompactionBytes;
+
+    // Keys after all keys of the tree go to the last level without a merge.
+    auto external_key_values = GenKeyValues(1000);
+    sort(external_key_values.begin(), external_key_values.end());
+    std::vector<std::string> paths = { "external_0", "external_1" };
+    for (size_t i = 0; i < paths.size(); ++i) {
+        ComponentWriter writer(paths[i]);
+        for (size_t j = i * 500; j < (i + 1) * 500; ++j) {
+            external_key_values[j].first = "~" + external_key_values[j].first;
+            ASSERT_EQ(writer.Put(external_key_values[j].first, external_key_values[j].second), true);
+        }
+        ASSERT_EQ(writer.Finish(), true);
+    }
+    ASSERT_EQ(tree.IngestExternalFiles(paths), true);
+    auto stats = tree.GetStats();
+    ASSERT_EQ(stats.IngestedFiles, 2);
+    ASSERT_EQ(stats.IngestedFilesMerged, 0);
+    ASSERT_EQ(stats.CompactionBytes, compaction_bytes);
+    auto levels = tree.GetLevelsShape();
+    auto& last_run = levels[2][0];
+    ASSERT_EQ(last_run[last_run.size() - 2].MinKey, external_key_values[0].first);
+    ASSERT_EQ(last_run.back().MaxKey, external_key_values.back().first);
+    for (auto& kv : external_key_values) {
+        std::string result;
+        ASSERT_EQ(tree.Get(kv.first, result), true);
+        ASSERT_EQ(result, kv.second);
+    }
+
+    // Overlapping files are newer than the tree.
+    sort(key_values.begin(), key_values.end());
+    {
+        ComponentWriter writer("external_2");
+        for (size_t i = 0; i < 100; ++i) {
+            key_values[i].second = GenString(10);
+            ASSERT_EQ(writer.Put(key_values[i].first, key_values[i].second), true);
+        }
+        ASSERT_EQ(writer.Delete(key_values[100].first), true);
+        ASSERT_EQ(writer.Finish(), true);
+    }
+    ASSERT_EQ(tree.IngestExternalFiles({ "external_2" }), true);
+    for (size_t i = 0; i < key_values.size(); ++i) {
+        std::string result;
+        ASSERT_EQ(tree.Get(key_values[i].first, result), i != 100);
+        if (i != 100) {
+            ASSERT_EQ(result, key_values[i].second);
+        }
+    }
+    ASSERT_EQ(tree.IngestExternalFiles({ "external_0", "external_0" }), false);
+    ASSERT_EQ(tree.IngestExternalFiles({ "external_missing" }), false);
+}
+
+TEST(LSMTreeTest, TestLearnedIndex)
+{
+    LSMOptions options;
+    options.MaxComponents = 3;
+    options.LearnedIndexError = 4;
+    LSMTree tree(options);
+
+    auto key_values = GenKeyValues(2000);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    for (size_t i = 0; i < 100; ++i) {
+        tree.Delete(key_values[i].first);
+    }
+    for (size_t i = 0; i < key_values.size(); ++i) {
+        std::string result;
+        ASSERT_EQ(tree.Get(key_values[i].first, result), i >= 100);
+        if (i >= 100) {
+            ASSERT_EQ(result, key_values[i].second);
+        }
+    }
+
+    key_values.erase(key_values.begin(), key_values.begin() + 100);
+    sort(key_values.begin(), key_values.end());
+    auto result = tree.GetQuery(key_values[300].first, key_values[500].first);
+    ASSERT_EQ(result.size(), 201);
+    for (size_t i = 300; i < 501; ++i) {
+        ASSERT_EQ(result[i - 300].second, key_values[i].second);
+    }
+}
+
+// Flips the flag byte of the first entry of every data file of the directory.
+void CorruptFiles(const std::string& directory) {
+    for (auto& entry : std::filesystem::directory_iterator(directory)) {
+        auto name = entry.path().filename().string();
+        if (name.rfind("file_", 0) != 0 || name.find('.') != std::string::npos || entry.file_size() == 0) {
+            continue;
+        }
+        FILE* file = fopen(entry.path().c_str(), "rb+");
+        fputc('x', file);
+        fclose(file);
+    }
+}
+
+TEST(LSMTreeTest, TestChecksums)
+{
+    std::filesystem::remove_all("checksum_tree");
+    std::filesystem::remove_all("checksum_tree_never");
+    auto key_values = GenKeyValues(1000);
+    LSMOptions options;
+    options.MaxComponents = 3;
+    options.Directory = "checksum_tree_never";
+    options.ChecksumVerification = EChecksumVerification::Never;
+    {
+        LSMTree tree(options);
+        for (auto& kv : key_values) {
+            tree.Add(kv.first, kv.second);
+        }
+        CorruptFiles(options.Directory);
+        for (auto& kv : key_values) {
+            std::string result;
+            tree.Get(kv.first, result);
+        }
+        ASSERT_EQ(tree.GetStats().ChecksumMismatches, 0);
+    }
+
+    options.Directory = "checksum_tree";
+    options.ChecksumVerification = EChecksumVerification::Always;
+    LSMTree tree(options);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    for (auto& kv : key_values) {
+        std::string result;
+        ASSERT_EQ(tree.Get(kv.first, result), true);
+    }
+    ASSERT_EQ(tree.GetStats().ChecksumMismatches, 0);
+
+    CorruptFiles(options.Directory);
+    size_t not_found = 0;
+    for (auto& kv : key_values) {
+        std::string result;
+        not_found += !tree.Get(kv.first, result);
+    }
+    ASSERT_GT(not_found, 0);
+    ASSERT_GT(tree.GetStats().ChecksumMismatches, 0);
+    ASSERT_EQ(tree.IsReadOnly(), false);
+
+    // The first flush or compaction which merges a corrupted file is abandoned,
+    // the memtable is kept and later writes are ignored.
+    auto new_key_values = GenKeyValues(1000);
+    size_t added = 0;
+    while (added < new_key_values.size() && !tree.IsReadOnly()) {
+        tree.Add(new_key_values[added].first, new_key_values[added].second);
+        ++added;
+    }
+    ASSERT_EQ(tree.IsReadOnly(), true);
+    new_key_values.resize(added);
+    for (auto& kv : new_key_values) {
+        std::string result;
+        ASSERT_EQ(tree.Get(kv.first, result), true);
+        ASSERT_EQ(result, kv.second);
+    }
+    std::string key = "~new_key";
+    std::string value = "value";
+    tree.Add(key, value);
+    std::string result;
+    ASSERT_EQ(tree.Get(key, result), false);
+}
+
+// Cuts off the last quarter of every data file of the directory.
+void TruncateFiles(const std::string& directory) {
+    for (auto& entry : std::filesystem::directory_iterator(directory)) {
+        auto name = entry.path().filename().string();
+        if (name.rfind("file_", 0) != 0 || name.find('.') != std::string::npos || entry.file_size() == 0) {
+            continue;
+        }
+        std::filesystem::resize_file(entry.path(), entry.file_size() * 3 / 4);
+    }
+}
+
+// Unreadable input blocks abandon a merge without checksum verification too.
+void CheckMergeReadErrors(LSMOptions options) {
+    std::filesystem::remove_all("read_error_tree");
+    options.MaxComponents = 3;
+    options.Directory = "read_error_tree";
+    options.ChecksumVerification = EChecksumVerification::Never;
+    LSMTree tree(options);
+    for (auto& kv : GenKeyValues(1000)) {
+        tree.Add(kv.first, kv.second);
+    }
+    TruncateFiles(options.Directory);
+
+    auto new_key_values = GenKeyValues(1000);
+    size_t added = 0;
+    while (added < new_key_values.size() && !tree.IsReadOnly()) {
+        tree.Add(new_key_values[added].first, new_key_values[added].second);
+        ++added;
+    }
+    ASSERT_EQ(tree.IsReadOnly(), true);
+    ASSERT_GT(tree.GetStats().MergeReadErrors, 0);
+    ASSERT_EQ(tree.GetStats().ChecksumMismatches, 0);
+    new_key_values.resize(added);
+    for (auto& kv : new_key_values) {
+        std::string result;
+        ASSERT_EQ(tree.Get(kv.first, result), true);
+        ASSERT_EQ(result, kv.second);
+    }
+}
+
+TEST(LSMTreeTest, TestMergeReadErrors)
+{
+    LSMOptions options;
+    CheckMergeReadErrors(options);
+    options.Codecs = { std::make_shared<LZCodec>() };
+    CheckMergeReadErrors(options);
+    options.Codecs.clear();
+    options.ReadQueueDepth = 4;
+    CheckMergeReadErrors(options);
+    options.ReadQueueDepth = 0;
+    options.CompactionBypassCache = true;
+    CheckMergeReadErrors(options);
+}
+
+TEST(LSMTreeTest, TestLevelCodecs)
+{
+    LSMOptions options;
+    options.MaxComponents = 3;
+    options.Codecs = { nullptr, std::make_shared<DeltaVarintCodec>(), std::make_shared<LZCodec>() };
+    LSMTree tree(options);
+
+    std::vector<std::pair<std::string, std::string>> key_values;
+    for (size_t i = 0; i < 2000; ++i) {
+        key_values.emplace_back("key_" + std::to_string(100000 + i), "value_" + std::to_string(i % 7) + "_value_value");
+    }
+    std::shuffle(key_values.begin(), key_values.end(), std::mt19937(42));
+    size_t raw_bytes = 0;
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+        raw_bytes += 1 + kv.first.size() + kv.second.size();
+    }
+    for (size_t i = 0; i < 100; ++i) {
+        tree.Delete(key_values[i].first);
+    }
+    for (size_t i = 0; i < key_values.size(); ++i) {
+        std::string result;
+        ASSERT_EQ(tree.Get(key_values[i].first, result), i >= 100);
+        if (i >= 100) {
+            ASSERT_EQ(result, key_values[i].second);
+        }
+    }
+
+    auto stats = tree.GetStats();
+    ASSERT_EQ(stats.ChecksumMismatches, 0);
+    ASSERT_GT(stats.Levels[2].Entries, 0);
+    ASSERT_LT(stats.Levels[2].Bytes, raw_bytes / 2);
+
+    key_values.erase(key_values.begin(), key_values.begin() + 100);
+    sort(key_values.begin(), key_values.end());
+    auto result = tree.GetQuery(key_values[300].first, key_values[500].first);
+    ASSERT_EQ(result.size(), 201);
+    for (size_t i = 300; i < 501; ++i) {
+        ASSERT_EQ(result[i - 300].second, key_values[i].second);
+    }
+}
+
+TEST(LSMTreeTest, TestMultiGet)
+{
+    LSMOptions options;
+    options.MaxComponents = 3;
+    options.Codecs = { nullptr, std::make_shared<LZCodec>() };
+    options.ReadQueueDepth = 8;
+    options.RowCacheSize = 1024 * 1024;
+    options.ValueLogThreshold = 30;
+    LSMTree tree(options);
+
+    std::vector<std::pair<std::string, std::string>> key_values;
+    for (size_t i = 0; i < 3000; ++i) {
+        key_values.emplace_back("key_" + std::to_string(100000 + i), "value_" + std::to_string(i) + (i % 5 == 0 ? GenString(30) : ""));
+    }
+    std::shuffle(key_values.begin(), key_values.end(), std::mt19937(42));
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    for (size_t i = 0; i < 100; ++i) {
+        tree.Delete(key_values[i].first);
+    }
+    std::string start_key = "key_101000";
+    std::string end_key = "key_101100";
+    tree.DeleteRange(start_key, end_key);
+
+    std::vector<std::string> keys;
+    for (auto& kv : key_values) {
+        keys.push_back(kv.first);
+        keys.push_back(kv.first + "_missing");
+    }
+    std::vector<std::string> values;
+    for (size_t round = 0; round < 2; ++round) {
+        auto found = tree.MultiGet(keys, values);
+        ASSERT_EQ(found.size(), keys.size());
+        ASSERT_EQ(values.size(), keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            std::string value;
+            ASSERT_EQ(found[i], tree.Get(keys[i], value));
+            if (found[i]) {
+                ASSERT_EQ(values[i], value);
+            }
+        }
+    }
+    auto found = tree.MultiGet(keys, values);
+    // The range deletion covers 100 keys, some of them may be deleted already.
+    size_t found_count = std::count(found.begin(), found.end(), true);
+    ASSERT_LE(found_count, key_values.size() - 100);
+    ASSERT_GE(found_count, key_values.size() - 200);
+    for (size_t i = 1; i < keys.size(); i += 2) {
+        ASSERT_EQ(found[i], false);
+    }
+
+    auto stats = tree.GetStats();
+    ASSERT_EQ(stats.MultiGetKeys, 3 * keys.size());
+    ASSERT_GT(stats.MultiGetBlockReads, 0);
+    ASSERT_GT(stats.MultiGetBlockReads, stats.MultiGetBatches);
+    ASSERT_EQ(stats.ChecksumMismatches, 0);
+
+    // The end of a deleted range is not deleted.
+    auto result = tree.GetQuery(start_key, end_key);
+    ASSERT_LE(result.size(), 1);
+    std::sort(key_values.begin() + 100, key_values.end());
+    result = tree.GetQuery(key_values[1500].first, key_values[2500].first);
+    ASSERT_EQ(result.size(), 1001);
+}
+
+// Keys in files which can not be opened are not found, with and without the read engine,
+// only the memtable still answers.
+void CheckMultiGetMissingFiles(size_t read_queue_depth) {
+    std::filesystem::remove_all("multiget_missing");
+    LSMOptions options;
+    options.MaxComponents = 3;
+    options.Directory = "multiget_missing";
+    options.Codecs = { std::make_shared<LZCodec>() };
+    options.ReadQueueDepth = read_queue_depth;
+    LSMTree tree(options);
+
+    auto key_values = GenKeyValues(1000);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    std::vector<std::string> keys;
+    for (auto& kv : key_values) {
+        keys.push_back(kv.first);
+    }
+    for (auto& entry : std::filesystem::directory_iterator("multiget_missing")) {
+        std::filesystem::remove(entry.path());
+    }
+
+    std::vector<std::string> values;
+    auto found = tree.MultiGet(keys, values);
+    auto stats = tree.GetStats();
+    ASSERT_EQ(std::count(found.begin(), found.end(), true), stats.MemtableEntries);
+    ASSERT_GT(stats.ChecksumMismatches, 0);
+}
+
+TEST(LSMTreeTest, TestMultiGetMissingFiles)
+{
+    CheckMultiGetMissingFiles(0);
+    CheckMultiGetMissingFiles(4);
+}
+
+TEST(LSMTreeTest, TestCompactionBypassCache)
+{
+    std::filesystem::remove_all("bypass_cache_tree");
+    LSMOptions options;
+    options.MaxComponents = 3;
+    options.Directory = "bypass_cache_tree";
+    options.CompactionBypassCache = true;
+    options.CompactionPreallocate = true;
+    options.Codecs = { nullptr, nullptr, std::make_shared<LZCodec>() };
+    LSMTree tree(options);
+
+    auto key_values = GenKeyValues(3000);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    for (size_t i = 0; i < 300; ++i) {
+        tree.Delete(key_values[i].first);
+    }
+    for (size_t i = 0; i < key_values.size(); ++i) {
+        std::string result;
+        ASSERT_EQ(tree.Get(key_values[i].first, result), i >= 300);
+        if (i >= 300) {
+            ASSERT_EQ(result, key_values[i].second);
+        }
+    }
+
+    // The preallocated space past the written bytes is released.
+    auto stats = tree.GetStats();
+    ASSERT_GT(stats.Compactions, 0);
+    ASSERT_EQ(stats.ChecksumMismatches, 0);
+    size_t bytes = 0;
+    for (auto& level : stats.Levels) {
+        bytes += level.Bytes;
+    }
+    size_t file_bytes = 0;
+    for (auto& entry : std::filesystem::directory_iterator("bypass_cache_tree")) {
+        if (entry.path().extension() != DiskComponent::METADATA_SUFFIX && entry.path().filename().string().find("MANIFEST") == std::string::npos) {
+            file_bytes += entry.file_size();
+        }
+    }
+    ASSERT_EQ(file_bytes, bytes);
+}
+
+TEST(LSMTreeTest, TestHashIndex)
+{
+    LSMOptions options;
+    options.MaxComponents = 3;
+    options.HashIndex = true;
+    options.Codecs = { nullptr, nullptr, std::make_shared<LZCodec>() };
+    LSMTree tree(options);
+
+    auto key_values = GenKeyValues(2000);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    for (size_t i = 0; i < 200; ++i) {
+        tree.Delete(key_values[i].first);
+    }
+    for (size_t i = 0; i < key_values.size(); ++i) {
+        std::string result;
+        ASSERT_EQ(tree.Get(key_values[i].first, result), i >= 200);
+        if (i >= 200) {
+            ASSERT_EQ(result, key_values[i].second);
+        }
+        std::string missing = key_values[i].first + "0";
+        ASSERT_EQ(tree.Get(missing, result), false);
+    }
+
+    key_values.erase(key_values.begin(), key_values.begin() + 200);
+    std::sort(key_values.begin(), key_values.end());
+    auto result = tree.GetQuery(key_values[100].first, key_values[300].first);
+    ASSERT_EQ(result.size(), 201);
+    for (size_t i = 0; i < result.size(); ++i) {
+        ASSERT_EQ(result[i].second, key_values[100 + i].second);
+    }
+}
+
+TEST(LSMTreeTest, TestArtMemtable)
+{
+    LSMOptions options;
+    options.MaxComponents = 3;
+    options.ComponentSizeMultiplier = 100;
+    options.MemtableType = EMemtableType::AdaptiveRadixTree;
+    LSMTree tree(options);
+
+    auto key_values = GenKeyValues(3000);
+    for (auto& kv : key_values) {
+        tree.Add(kv.first, kv.second);
+    }
+    for (size_t i = 0; i < 300; ++i) {
+        tree.Delete(key_values[i].first);
+    }
+    for (size_t i = 0; i < key_values.size(); ++i) {
+        std::string result;
+        ASSERT_EQ(tree.Get(key_values[i].first, result), i >= 300);
+        if (i >= 300) {
+            ASSERT_EQ(result, key_values[i].second);
+        }
+    }
+    ASSERT_GT(tree.GetStats().MemtableEntries, 0);
+    ASSERT_GT(tree.GetStats().MemtableHits, 0);
+
+    key_values.erase(key_values.begin(), key_values.begin() + 300);
+    std::sort(key_values.begin(), key_values.end());
+    auto result = tree.GetQuery(key_values[100].first, key_values[1100].first);
+    ASSERT_EQ(result.size(), 1001);
+    for (size_t i = 0; i < result.size(); ++i) {
+        ASSERT_EQ(result[i].first, key_values[100 + i].first);
+        ASSERT_EQ(result[i].second, key_values[100 + i].second);
+    }
+}
+
+TEST(LSMTreeTest, TestTypedTree)
+{
+    using Value = std::array<char, 10>;
+    LSMOptions options;
+    options.MaxComponents = 3;
+    options.ComponentSizeMultiplier = 100;
+    TypedLSMTree<UInt32Codec, FixedSizeCodec<Value>> tree(options);
+
+    std::mt19937 g(42);
+    std::vector<uint32_t> keys(3000);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        keys[i] = i * 1000;
+    }
+    std::shuffle(keys.begin(), keys.end(), g);
+    auto make_value = [](uint32_t key) {
+        Value value;
+        for (size_t i = 0; i < value.size(); ++i) {
+            value[i] = 'a' + (key / 1000 + i) % 26;
+        }
+        return value;
+    };
+    for (auto key : keys) {
+        tree.Add(key, make_value(key));
+    }
+    for (size_t i = 0; i < 300; ++i) {
+        tree.Delete(keys[i]);
+    }
+    for (size_t i = 0; i < keys.size(); ++i) {
+        Value value;
+        ASSERT_EQ(tree.Get(keys[i], value), i >= 300);
+        if (i >= 300) {
+            ASSERT_EQ(value, make_value(keys[i]));
+        }
+    }
+
+    // Keys are ordered as numbers, not as their little-endian bytes.
+    std::vector<uint32_t> live_keys(keys.begin() + 300, keys.end());
+    std::sort(live_keys.begin(), live_keys.end());
+    auto result = tree.GetQuery(live_keys[100], live_keys[1100]);
+    ASSERT_EQ(result.size(), 1001);
+    for (size_t i = 0; i < result.size(); ++i) {
+        ASSERT_EQ(result[i].first, live_keys[100 + i]);
+        ASSERT_EQ(result[i].second, make_value(live_keys[100 + i]));
+    }
+
+    // Tombstones have values of the same size, so no file stores offsets.
+    auto stats = tree.GetTree().GetStats();
+    size_t files = 0;
+    size_t index_memory = 0;
+    for (auto& level : stats.Levels) {
+        files += level.Files;
+        index_memory += level.IndexMemory;
+    }
+    ASSERT_GT(files, 0);
+    ASSERT_EQ(index_memory, files * sizeof(OffsetIndex) * 2);
+}
+
 int main(int argc, char** argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "../common/common.h"
+
+#include <vector>
+
+// Puts and deletes applied to the tree together by LSMTree::Write, in the order they were added.
+class WriteBatch {
+public:
+    enum class EOperationType {
+        Put,
+        Delete,
+        DeleteRange,
+    };
+
+    struct Operation {
+        EOperationType Type;
+        K Key;
+        // Value of a put or end of a deleted range.
+        V Value;
+    };
+
+    void Put(const K& key, const V& value) {
+        Operations_.push_back({ EOperationType::Put, key, value });
+    }
+
+    void Delete(const K& key) {
+        Operations_.push_back({ EOperationType::Delete, key, V() });
+    }
+
+    // Deletes all keys from [start_key, end_key).
+    void DeleteRange(const K& start_key, const K& end_key) {
+        Operations_.push_back({ EOperationType::DeleteRange, start_key, end_key });
+    }
+
+    std::vector<Operation>& GetOperations() {
+        return Operations_;
+    }
+
+    size_t Size() const {
+        return Operations_.size();
+    }
+
+    bool Empty() const {
+        return Operations_.empty();
+    }
+
+    void Clear() {
+        Operations_.clear();
+    }
+
+private:
+    std::vector<Operation> Operations_;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "../common/rate_limiter.h"
+
+#include <cstddef>
+
+// Slows writers down when compactions fall behind. The state is updated from the compaction
+// debt after every flush: above the slowdown threshold writes are limited to the delayed
+// write rate, above the stop threshold the writer has to finish compactions before it goes on.
+// A zero threshold is disabled.
+class WriteController {
+public:
+    enum class EState {
+        Normal,
+        Slowdown,
+        Stop,
+    };
+
+    WriteController(size_t slowdown_debt, size_t stop_debt, size_t delayed_write_rate)
+        : SlowdownDebt_(slowdown_debt)
+        , StopDebt_(stop_debt)
+        , DelayedWriteLimiter_(delayed_write_rate)
+    {}
+
+    EState Update(size_t debt) {
+        if (StopDebt_ > 0 && debt >= StopDebt_) {
+            State_ = EState::Stop;
+        } else if (SlowdownDebt_ > 0 && debt >= SlowdownDebt_) {
+            State_ = EState::Slowdown;
+        } else {
+            State_ = EState::Normal;
+        }
+        return State_;
+    }
+
+    EState GetState() const {
+        return State_;
+    }
+
+    // Called for every write, waits if writes are slowed down.
+    void Delay(size_t bytes) {
+        if (State_ == EState::Slowdown) {
+            ++SlowedWrites_;
+            DelayedWriteLimiter_.Request(bytes);
+        }
+    }
+
+    void AddStop(size_t micros) {
+        ++Stops_;
+        StopMicros_ += micros;
+    }
+
+    size_t GetSlowedWrites() const {
+        return SlowedWrites_;
+    }
+
+    size_t GetSlowedBytes() {
+        return DelayedWriteLimiter_.GetRequestedBytes();
+    }
+
+    size_t GetSlowdownMicros() {
+        return DelayedWriteLimiter_.GetWaitMicros();
+    }
+
+    size_t GetStops() const {
+        return Stops_;
+    }
+
+    size_t GetStopMicros() const {
+        return StopMicros_;
+    }
+
+private:
+    size_t SlowdownDebt_;
+    size_t StopDebt_;
+    EState State_ = EState::Normal;
+    RateLimiter DelayedWriteLimiter_;
+    size_t SlowedWrites_ = 0;
+    size_t Stops_ = 0;
+    size_t StopMicros_ = 0;
+};
@@ -0,0 +1,54 @@
+#include "../value_log.h"
+
+#include <gtest/gtest.h>
+
+TEST(ValueLogTest, TestAddGet)
+{
+    ValueLog log("vlog_test_", 100);
+    std::vector<std::pair<ValuePointer, V>> pointers;
+    for (size_t i = 0; i < 20; ++i) {
+        V value(10 + i, 'a' + i);
+        pointers.emplace_back(log.Add("key" + std::to_string(i), value), value);
+    }
+    ASSERT_GT(log.GetFilesCount(), 1);
+    for (auto& [pointer, value] : pointers) {
+        V result;
+        ASSERT_EQ(log.Get(ValuePointer::Decode(pointer.Encode()), result), true);
+        ASSERT_EQ(result, value);
+    }
+}
+
+TEST(ValueLogTest, TestGarbage)
+{
+    ValueLog log("vlog_test_", 100);
+    std::vector<ValuePointer> pointers;
+    for (size_t i = 0; i < 10; ++i) {
+        pointers.push_back(log.Add("key" + std::to_string(i), V(30, 'x')));
+    }
+    ASSERT_EQ(log.GetFilesToCollect(0.5).empty(), true);
+
+    // Every record takes 50 bytes, so each file holds two of them.
+    for (size_t i = 0; i < 2; ++i) {
+        log.AddGarbage(pointers[i]);
+    }
+    auto files = log.GetFilesToCollect(0.5);
+    ASSERT_EQ(files, std::vector<size_t>({ 0 }));
+
+    std::vector<K> keys;
+    log.ForEachRecord(0, [&keys, &pointers](K& key, V& value, ValuePointer pointer) {
+        ASSERT_EQ(pointer, pointers[keys.size()]);
+        ASSERT_EQ(value, V(30, 'x'));
+        keys.push_back(key);
+    });
+    ASSERT_EQ(keys, std::vector<K>({ "key0", "key1" }));
+
+    log.RemoveFile(0);
+    V result;
+    ASSERT_EQ(log.Get(pointers[0], result), false);
+}
+
+int main(int argc, char** argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
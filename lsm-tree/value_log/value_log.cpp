@@ -0,0 +1 @@
+#include "value_log.h"
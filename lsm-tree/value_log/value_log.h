@@ -0,0 +1,199 @@
+#pragma once
+
+#include "../common/common.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Position of a value in the value log, stored in the LSM instead of the value itself.
+struct ValuePointer {
+    size_t FileNumber = 0;
+    size_t Offset = 0;
+    size_t Size = 0;
+
+    V Encode() const {
+        V result(sizeof(ValuePointer), '\0');
+        memcpy(result.data(), this, sizeof(ValuePointer));
+        return result;
+    }
+
+    static ValuePointer Decode(std::string_view value) {
+        ValuePointer result;
+        memcpy(&result, value.data(), sizeof(ValuePointer));
+        return result;
+    }
+
+    bool operator==(const ValuePointer& other) const {
+        return FileNumber == other.FileNumber && Offset == other.Offset;
+    }
+};
+
+// Append-only files with large values. Every record is
+// [key size][value size][key][value], sizes are written as size_t.
+// Compactions report values they drop as garbage, files with too much garbage are collected.
+class ValueLog {
+public:
+    ValueLog(std::string file_prefix, size_t max_file_size)
+        : FilePrefix_(std::move(file_prefix))
+        , MaxFileSize_(max_file_size)
+    {}
+
+    ~ValueLog() {
+        if (ActiveFile_) {
+            fclose(ActiveFile_);
+        }
+    }
+
+    ValuePointer Add(const K& key, const V& value) {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        if (!ActiveFile_ || Files_[ActiveFileNumber_].Bytes >= MaxFileSize_) {
+            OpenNewFile();
+        }
+        auto& file_info = Files_[ActiveFileNumber_];
+        size_t sizes[2] = { key.size(), value.size() };
+        fwrite(sizes, sizeof(size_t), 2, ActiveFile_);
+        fwrite(key.data(), sizeof(char), key.size(), ActiveFile_);
+        fwrite(value.data(), sizeof(char), value.size(), ActiveFile_);
+
+        ValuePointer pointer = { ActiveFileNumber_, file_info.Bytes + sizeof(sizes) + key.size(), value.size() };
+        file_info.Bytes += sizeof(sizes) + key.size() + value.size();
+        WrittenBytes_ += sizeof(sizes) + key.size() + value.size();
+        return pointer;
+    }
+
+    bool Get(const ValuePointer& pointer, V& value) {
+        {
+            std::lock_guard<std::mutex> lock(Mutex_);
+            if (Files_.find(pointer.FileNumber) == Files_.end()) {
+                return false;
+            }
+            if (pointer.FileNumber == ActiveFileNumber_) {
+                fflush(ActiveFile_);
+            }
+        }
+        FILE* file = fopen(GetFileName(pointer.FileNumber).c_str(), "rb");
+        if (!file) {
+            return false;
+        }
+        value.resize(pointer.Size);
+        fseek(file, pointer.Offset, SEEK_SET);
+        size_t read = fread(value.data(), sizeof(char), pointer.Size, file);
+        fclose(file);
+        return read == pointer.Size;
+    }
+
+    void AddGarbage(const ValuePointer& pointer) {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        auto it = Files_.find(pointer.FileNumber);
+        if (it != Files_.end()) {
+            it->second.GarbageBytes += pointer.Size;
+        }
+    }
+
+    // Closed files in which at least garbage_ratio of the value bytes are garbage.
+    std::vector<size_t> GetFilesToCollect(double garbage_ratio) {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        std::vector<size_t> result;
+        for (auto& [number, file_info] : Files_) {
+            if (number != ActiveFileNumber_ && file_info.Bytes > 0 && file_info.GarbageBytes >= garbage_ratio * file_info.Bytes) {
+                result.push_back(number);
+            }
+        }
+        return result;
+    }
+
+    // Calls callback(key, value, pointer) for every record of the file.
+    template <typename Callback>
+    void ForEachRecord(size_t file_number, Callback callback) {
+        FILE* file = fopen(GetFileName(file_number).c_str(), "rb");
+        if (!file) {
+            return;
+        }
+        size_t offset = 0;
+        size_t sizes[2];
+        while (fread(sizes, sizeof(size_t), 2, file) == 2) {
+            K key(sizes[0], '\0');
+            V value(sizes[1], '\0');
+            fread(key.data(), sizeof(char), sizes[0], file);
+            fread(value.data(), sizeof(char), sizes[1], file);
+            offset += sizeof(sizes) + sizes[0];
+            callback(key, value, ValuePointer{ file_number, offset, sizes[1] });
+            offset += sizes[1];
+        }
+        fclose(file);
+    }
+
+    void RemoveFile(size_t file_number) {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        Files_.erase(file_number);
+        std::remove(GetFileName(file_number).c_str());
+    }
+
+    // Numbers and sizes of all files, the active file is flushed first so its
+    // records are on disk up to the returned size.
+    std::vector<std::pair<size_t, size_t>> GetFiles() {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        if (ActiveFile_) {
+            fflush(ActiveFile_);
+        }
+        std::vector<std::pair<size_t, size_t>> result;
+        for (auto& [number, file_info] : Files_) {
+            result.emplace_back(number, file_info.Bytes);
+        }
+        return result;
+    }
+
+    // Registers a file written earlier (e.g. by the tree a checkpoint was taken from).
+    void AddFile(size_t file_number, size_t bytes) {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        Files_[file_number].Bytes = bytes;
+        NextFileNumber_ = std::max(NextFileNumber_, file_number + 1);
+    }
+
+    std::string GetFileName(size_t file_number) {
+        return FilePrefix_ + std::to_string(file_number);
+    }
+
+    size_t GetWrittenBytes() {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        return WrittenBytes_;
+    }
+
+    size_t GetFilesCount() {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        return Files_.size();
+    }
+
+private:
+    struct FileInfo {
+        size_t Bytes = 0;
+        size_t GarbageBytes = 0;
+    };
+
+    void OpenNewFile() {
+        if (ActiveFile_) {
+            fclose(ActiveFile_);
+        }
+        ActiveFileNumber_ = NextFileNumber_++;
+        Files_[ActiveFileNumber_] = FileInfo();
+        // A file with this name may be a hard link of a checkpoint, so it is unlinked
+        // instead of truncated.
+        std::remove(GetFileName(ActiveFileNumber_).c_str());
+        ActiveFile_ = fopen(GetFileName(ActiveFileNumber_).c_str(), "wb");
+    }
+
+    std::string FilePrefix_;
+    size_t MaxFileSize_;
+    std::map<size_t, FileInfo> Files_;
+    FILE* ActiveFile_ = nullptr;
+    size_t ActiveFileNumber_ = 0;
+    size_t NextFileNumber_ = 0;
+    size_t WrittenBytes_ = 0;
+    std::mutex Mutex_;
+};
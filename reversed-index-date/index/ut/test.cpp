@@ -179,6 +179,31 @@ TEST(IndexTest, TestDateHelper) {
     }
 }
 
+TEST(IndexTest, TestInstrumentation)
+{
+    auto instrumentation = std::make_shared<Instrumentation>();
+    Index index(2, 3, 10, instrumentation);
+    index.AddDocument("cat", "i have cats, and dog, and horse", "2024-11-16 12:02", "2024-11-16 12:10");
+    index.AddDocument("dog", "i have Dog. and Horse and Crocodile", "2024-11-16 12:05", "2024-11-16 12:22");
+    {
+        Finder finder(index, "cat");
+        std::vector<std::string> expected = { "cat" };
+        ASSERT_EQ(finder.And("horse").GetDocuments(), expected);
+    }
+    {
+        Finder finder(index, "2024-11-16 12:06", "2024-11-16 12:09", true);
+        std::vector<std::string> expected = { "cat", "dog" };
+        ASSERT_EQ(finder.GetDocuments(), expected);
+    }
+
+    auto histograms = instrumentation->GetHistograms();
+    ASSERT_EQ(histograms["add_document"].GetCount(), 2);
+    ASSERT_EQ(histograms["get_documents_by_word"].GetCount(), 2);
+    ASSERT_GT(histograms["get_documents_by_date"].GetCount(), 0);
+    ASSERT_EQ(histograms["finder.and"].GetCount(), 1);
+    ASSERT_EQ(histograms["finder.get_documents"].GetCount(), 2);
+}
+
 int main(int argc, char** argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
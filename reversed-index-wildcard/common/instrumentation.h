@@ -0,0 +1,281 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Log-linear histogram of latencies in nanoseconds: every power of two is split into
+// 16 buckets, so a percentile is off by at most 1/16 of its value.
+class LatencyHistogram {
+public:
+    LatencyHistogram()
+        : Buckets_(BUCKETS_COUNT, 0)
+    {}
+
+    void Record(uint64_t value) {
+        ++Buckets_[GetBucket(value)];
+        ++Count_;
+        Sum_ += value;
+        Max_ = std::max(Max_, value);
+    }
+
+    void Merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < BUCKETS_COUNT; ++i) {
+            Buckets_[i] += other.Buckets_[i];
+        }
+        Count_ += other.Count_;
+        Sum_ += other.Sum_;
+        Max_ = std::max(Max_, other.Max_);
+    }
+
+    // Upper bound of the bucket holding the given share (from 0 to 1) of the values.
+    uint64_t Percentile(double share) const {
+        if (Count_ == 0) {
+            return 0;
+        }
+        uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(share * Count_ + 0.5), 1);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS_COUNT; ++i) {
+            seen += Buckets_[i];
+            if (seen >= rank) {
+                return std::min(GetBucketUpperBound(i), Max_);
+            }
+        }
+        return Max_;
+    }
+
+    uint64_t GetCount() const {
+        return Count_;
+    }
+
+    uint64_t GetMax() const {
+        return Max_;
+    }
+
+    double GetMean() const {
+        return Count_ == 0 ? 0 : static_cast<double>(Sum_) / Count_;
+    }
+
+private:
+    static size_t GetBucket(uint64_t value) {
+        if (value < SUB_BUCKETS) {
+            return value;
+        }
+        size_t exponent = 63 - __builtin_clzll(value);
+        size_t sub_bucket = (value >> (exponent - SUB_BUCKET_BITS)) - SUB_BUCKETS;
+        return SUB_BUCKETS + (exponent - SUB_BUCKET_BITS) * SUB_BUCKETS + sub_bucket;
+    }
+
+    static uint64_t GetBucketUpperBound(size_t bucket) {
+        if (bucket < SUB_BUCKETS) {
+            return bucket;
+        }
+        size_t shift = (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+        uint64_t lower = (SUB_BUCKETS + (bucket - SUB_BUCKETS) % SUB_BUCKETS) << shift;
+        return lower + (uint64_t(1) << shift) - 1;
+    }
+
+    static constexpr size_t SUB_BUCKET_BITS = 4;
+    static constexpr size_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKETS_COUNT = SUB_BUCKETS + (64 - SUB_BUCKET_BITS) * SUB_BUCKETS;
+
+    std::vector<uint64_t> Buckets_;
+    uint64_t Count_ = 0;
+    uint64_t Sum_ = 0;
+    uint64_t Max_ = 0;
+};
+
+// Latency histograms of named operations and, if tracing is on, their trace events.
+// Every thread records into its own data, which is merged only when it is read.
+class Instrumentation {
+public:
+    Instrumentation(bool is_tracing = false, size_t max_trace_events = 1 << 20)
+        : Id_(NextId_.fetch_add(1))
+        , IsTracing_(is_tracing)
+        , MaxTraceEvents_(max_trace_events)
+        , Start_(std::chrono::steady_clock::now())
+    {}
+
+    std::chrono::steady_clock::time_point Now() const {
+        return std::chrono::steady_clock::now();
+    }
+
+    // Handle of the named operation for Record. Takes the lock of the object, so users resolve
+    // their operations once and keep the handles.
+    size_t GetHandle(const std::string& name) {
+        std::lock_guard<std::mutex> lock(Mutex_);
+        auto it = Handles_.find(name);
+        if (it != Handles_.end()) {
+            return it->second;
+        }
+        Names_.push_back(name);
+        Handles_.emplace(name, Names_.size() - 1);
+        return Names_.size() - 1;
+    }
+
+    void Record(size_t handle, std::chrono::steady_clock::time_point start,
+                std::chrono::steady_clock::time_point end, bool is_traced = true) {
+        uint64_t duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        auto& data = GetThreadData();
+        // Only readers of the stats compete for this lock.
+        std::lock_guard<std::mutex> lock(data.Mutex);
+        if (handle >= data.Histograms.size()) {
+            data.Histograms.resize(handle + 1);
+        }
+        if (!data.Histograms[handle]) {
+            data.Histograms[handle] = std::make_unique<LatencyHistogram>();
+        }
+        data.Histograms[handle]->Record(duration);
+        if (IsTracing_ && is_traced && TraceEventsCount_.fetch_add(1) < MaxTraceEvents_) {
+            uint64_t start_offset = std::chrono::duration_cast<std::chrono::nanoseconds>(start - Start_).count();
+            data.Events.push_back({ handle, start_offset, duration });
+        }
+    }
+
+    std::map<std::string, LatencyHistogram> GetHistograms() {
+        std::map<std::string, LatencyHistogram> result;
+        std::lock_guard<std::mutex> lock(Mutex_);
+        for (auto& data : Threads_) {
+            std::lock_guard<std::mutex> data_lock(data->Mutex);
+            for (size_t handle = 0; handle < data->Histograms.size(); ++handle) {
+                if (data->Histograms[handle]) {
+                    result[Names_[handle]].Merge(*data->Histograms[handle]);
+                }
+            }
+        }
+        return result;
+    }
+
+    // One line per operation with latencies in microseconds.
+    std::string ToString() {
+        std::stringstream result;
+        for (auto& histogram : GetHistograms()) {
+            auto& h = histogram.second;
+            result << histogram.first << ": count " << h.GetCount() << ", mean " << h.GetMean() / 1000
+                   << " us, p50 " << h.Percentile(0.5) / 1000.0 << " us, p99 " << h.Percentile(0.99) / 1000.0
+                   << " us, p999 " << h.Percentile(0.999) / 1000.0 << " us, max " << h.GetMax() / 1000.0 << " us\n";
+        }
+        return result.str();
+    }
+
+    // Trace events in the Chrome trace format (chrome://tracing, Perfetto).
+    std::string ExportChromeTrace() {
+        std::stringstream result;
+        result << "{\"traceEvents\":[";
+        bool is_first = true;
+        std::lock_guard<std::mutex> lock(Mutex_);
+        for (auto& data : Threads_) {
+            std::lock_guard<std::mutex> data_lock(data->Mutex);
+            for (auto& event : data->Events) {
+                result << (is_first ? "" : ",") << "{\"name\":\"" << Names_[event.Handle] << "\",\"ph\":\"X\",\"pid\":1"
+                       << ",\"tid\":" << data->ThreadNumber << ",\"ts\":" << event.Start / 1000.0
+                       << ",\"dur\":" << event.Duration / 1000.0 << "}";
+                is_first = false;
+            }
+        }
+        result << "]}";
+        return result.str();
+    }
+
+private:
+    struct TraceEvent {
+        size_t Handle;
+        uint64_t Start;
+        uint64_t Duration;
+    };
+
+    struct ThreadData {
+        std::mutex Mutex;
+        size_t ThreadNumber = 0;
+        // Indexed by handle, only the operations the thread recorded are allocated.
+        std::vector<std::unique_ptr<LatencyHistogram>> Histograms;
+        std::vector<TraceEvent> Events;
+    };
+
+    ThreadData& GetThreadData() {
+        // Keyed by id and not by address, so a new object at the same address gets new data.
+        thread_local std::unordered_map<size_t, std::shared_ptr<ThreadData>> thread_data;
+        // A thread usually records into one object, so the map is searched only on a switch.
+        thread_local size_t last_id = SIZE_MAX;
+        thread_local ThreadData* last_data = nullptr;
+        if (last_id == Id_) {
+            return *last_data;
+        }
+        auto& data = thread_data[Id_];
+        if (!data) {
+            data = std::make_shared<ThreadData>();
+            std::lock_guard<std::mutex> lock(Mutex_);
+            data->ThreadNumber = Threads_.size();
+            Threads_.push_back(data);
+        }
+        last_id = Id_;
+        last_data = data.get();
+        return *data;
+    }
+
+    static inline std::atomic<size_t> NextId_ = 0;
+
+    size_t Id_;
+    bool IsTracing_;
+    size_t MaxTraceEvents_;
+    std::atomic<size_t> TraceEventsCount_ = 0;
+    std::chrono::steady_clock::time_point Start_;
+    std::mutex Mutex_;
+    std::vector<std::shared_ptr<ThreadData>> Threads_;
+    std::unordered_map<std::string, size_t> Handles_;
+    std::vector<std::string> Names_;
+};
+
+// Records the time from its creation to its destruction as the operation with the given
+// handle (see Instrumentation::GetHandle). Does nothing if the instrumentation is null.
+class ScopedTrace {
+public:
+    ScopedTrace(Instrumentation* instrumentation, size_t handle)
+        : Instrumentation_(instrumentation)
+        , Handle_(handle)
+    {
+        if (Instrumentation_) {
+            Start_ = Instrumentation_->Now();
+        }
+    }
+
+    ScopedTrace(const ScopedTrace&) = delete;
+    ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+    ~ScopedTrace() {
+        if (!Instrumentation_) {
+            return;
+        }
+        auto end = Instrumentation_->Now();
+        Instrumentation_->Record(Handle_, Start_, end, !HasDetail_);
+        if (HasDetail_) {
+            Instrumentation_->Record(Detail_, Start_, end);
+        }
+    }
+
+    // Also records the operation under a more detailed one, e.g. with the level which
+    // answered a lookup. The trace event gets the detailed name.
+    void SetDetail(size_t handle) {
+        Detail_ = handle;
+        HasDetail_ = true;
+    }
+
+    bool IsEnabled() const {
+        return Instrumentation_ != nullptr;
+    }
+
+private:
+    Instrumentation* Instrumentation_;
+    size_t Handle_;
+    size_t Detail_ = 0;
+    bool HasDetail_ = false;
+    std::chrono::steady_clock::time_point Start_;
+};
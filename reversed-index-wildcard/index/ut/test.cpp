@@ -161,6 +161,31 @@ TEST(IndexTest, TestDocumentWildcard)
     }
 }
 
+TEST(IndexTest, TestInstrumentation)
+{
+    auto instrumentation = std::make_shared<Instrumentation>();
+    Index index(2, 3, 10, instrumentation);
+    index.AddDocument("cat", "i have cat and dog and horse");
+    index.AddDocument("dog", "i have dog and horse and crocodile");
+    {
+        Finder finder(index, "cat", false);
+        std::vector<std::string> expected = { "cat" };
+        ASSERT_EQ(finder.And("horse").GetDocuments(), expected);
+    }
+    {
+        Finder finder(index, "cro*dile", true);
+        std::vector<std::string> expected = { "dog" };
+        ASSERT_EQ(finder.GetDocuments(), expected);
+    }
+
+    auto histograms = instrumentation->GetHistograms();
+    ASSERT_EQ(histograms["add_document"].GetCount(), 2);
+    ASSERT_EQ(histograms["get_documents_by_word"].GetCount(), 2);
+    ASSERT_EQ(histograms["get_documents_by_wildcard"].GetCount(), 1);
+    ASSERT_EQ(histograms["finder.and"].GetCount(), 1);
+    ASSERT_EQ(histograms["finder.get_documents"].GetCount(), 2);
+}
+
 int main(int argc, char** argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
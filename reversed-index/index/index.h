@@ -1,5 +1,6 @@
 #include "../b-tree/b_tree.h"
 #include "../disk_component/component.h"
+#include "../common/instrumentation.h"
 #include "english_stem.h"
 
 #include <algorithm>
@@ -13,10 +14,12 @@ class Finder;
 class Index {
     friend class Finder;
 public:
-    Index(size_t min_degree = 2, size_t max_components = 1, size_t component_size_multiplier = 10)
+    Index(size_t min_degree = 2, size_t max_components = 1, size_t component_size_multiplier = 10,
+          std::shared_ptr<Instrumentation> instrumentation = nullptr)
         : MaxComponents_(max_components)
         , ComponentSizeMultiplier_(component_size_multiplier)
         , BTree_(min_degree)
+        , Instrumentation_(std::move(instrumentation))
     {
         for (size_t i = 0; i < max_components; ++i) {
             std::string file_name = "file_";
@@ -27,9 +30,19 @@ public:
             FILE* file = fopen(FileNames_[i].c_str(), "wb");
             fclose(file);
         }
+        if (Instrumentation_) {
+            Traces_.AddDocument = Instrumentation_->GetHandle("add_document");
+            Traces_.GetDocumentsByWord = Instrumentation_->GetHandle("get_documents_by_word");
+            Traces_.Flush = Instrumentation_->GetHandle("flush");
+            Traces_.FinderAnd = Instrumentation_->GetHandle("finder.and");
+            Traces_.FinderOr = Instrumentation_->GetHandle("finder.or");
+            Traces_.FinderWithout = Instrumentation_->GetHandle("finder.without");
+            Traces_.FinderGetDocuments = Instrumentation_->GetHandle("finder.get_documents");
+        }
     }
 
     void AddDocument(std::string document_name, std::string document_text) {
+        ScopedTrace trace(Instrumentation_.get(), Traces_.AddDocument);
         K cur_index = DocumentNames_.size();
         DocumentNames_.emplace_back(document_name);
         auto words = ParseDocument(document_text);
@@ -40,11 +53,13 @@ public:
             if (IndexByWord_.find(word) == IndexByWord_.end()) {
                 IndexByWord_[word] = IndexByWord_.size();
             }
-            Add(IndexByWord_[word], to_add_bitmap);
+            BTree_.Add(IndexByWord_[word], to_add_bitmap);
         }
+        CheckFlush();
     }
 
     roaring::Roaring GetDocumentsByWord(std::string word) {
+        ScopedTrace trace(Instrumentation_.get(), Traces_.GetDocumentsByWord);
         roaring::Roaring result;
         Lemmatize(word);
         if (IndexByWord_.find(word) == IndexByWord_.end()) {
@@ -63,79 +78,124 @@ public:
 
     void Add(K key, V& value) {
         BTree_.Add(key, value);
+        CheckFlush();
+    }
+
+    void Delete(K key) {
+        BTree_.Delete(key);
+    }
+
+private:
+    void Lemmatize(std::string& word) {
+        std::string result;
+        std::remove_copy_if(
+            word.begin(), word.end(),            
+            std::back_inserter(result),   
+            std::ptr_fun<int, int>(&std::ispunct)  
+        );
+        std::transform(
+            result.begin(), result.end(), result.begin(),
+            [](unsigned char c) { return std::tolower(c); }
+        );
+        stemming::english_stem<> StemEnglish;
+        std::wstring wword(result.begin(), result.end());
+        StemEnglish(wword);
+        word = std::string(wword.begin(), wword.end());
+    }
 
-        if (BTree_.GetSize() > ComponentSizeMultiplier_ && MaxComponents_ > 0) {
-            std::vector<KV> b_tree_data = BTree_.List();
-            size_t first_ptr = 0;
-            size_t second_ptr = 0;
-            auto first_kv = b_tree_data[first_ptr];
-            size_t first_size = b_tree_data.size();
-            size_t second_size = Components_[0].GetSize();
-            std::string tmp_file_name = FileNames_[0] + "_tmp";
-            FILE* tmp_file = fopen(tmp_file_name.c_str(), "wb");
-            fclose(tmp_file);
-            tmp_file = fopen(tmp_file_name.c_str(), "rb+");
-
-            FILE* file = fopen(FileNames_[0].c_str(), "rb");
-            KV second_kv;
-            if (second_size != 0) {
-                Components_[0].ReadFromFile(second_ptr, second_kv, file);
+    std::vector<std::string> ParseDocument(std::string& document_text) {
+        std::vector<std::string> result;
+
+        std::stringstream stream(document_text);
+        std::string word;
+        while (stream >> word) {
+            if (word.size() < 3) {
+                continue;
             }
-            while (first_ptr < first_size || second_ptr < second_size) {
-                if (first_ptr == first_size) {
-                    MoveComponentPointer(second_ptr, 0, 0, second_kv, second_size, file, tmp_file);
-                    continue;
+            Lemmatize(word);
+            result.emplace_back(word);
+        }
+        return result;
+    }
+
+    // Flushes the full memtable and then merges overflowing components, the sizes
+    // of the components change only after a flush.
+    void CheckFlush() {
+        if (BTree_.GetSize() <= ComponentSizeMultiplier_ || MaxComponents_ == 0) {
+            return;
+        }
+        ScopedTrace trace(Instrumentation_.get(), Traces_.Flush);
+
+        std::vector<KV> b_tree_data = BTree_.List();
+        size_t first_ptr = 0;
+        size_t second_ptr = 0;
+        auto first_kv = b_tree_data[first_ptr];
+        size_t first_size = b_tree_data.size();
+        size_t second_size = Components_[0].GetSize();
+        std::string tmp_file_name = FileNames_[0] + "_tmp";
+        FILE* tmp_file = fopen(tmp_file_name.c_str(), "wb");
+        fclose(tmp_file);
+        tmp_file = fopen(tmp_file_name.c_str(), "rb+");
+
+        FILE* file = fopen(FileNames_[0].c_str(), "rb");
+        KV second_kv;
+        if (second_size != 0) {
+            Components_[0].ReadFromFile(second_ptr, second_kv, file);
+        }
+        while (first_ptr < first_size || second_ptr < second_size) {
+            if (first_ptr == first_size) {
+                MoveComponentPointer(second_ptr, 0, 0, second_kv, second_size, file, tmp_file);
+                continue;
+            }
+            if (second_ptr == second_size) {
+                Components_[0].WriteToFile(first_kv, tmp_file, true);
+                ++first_ptr;
+                if (first_ptr != first_size) {
+                    first_kv = b_tree_data[first_ptr];
                 }
-                if (second_ptr == second_size) {
-                    Components_[0].WriteToFile(first_kv, tmp_file, true);
-                    ++first_ptr;
-                    if (first_ptr != first_size) {
-                        first_kv = b_tree_data[first_ptr];
-                    }
-                    continue;
+                continue;
+            }
+            if (first_kv.Key < second_kv.Key) {
+                Components_[0].WriteToFile(first_kv, tmp_file, true);
+                ++first_ptr;
+                if (first_ptr != first_size) {
+                    first_kv = b_tree_data[first_ptr];
                 }
-                if (first_kv.Key < second_kv.Key) {
-                    Components_[0].WriteToFile(first_kv, tmp_file, true);
-                    ++first_ptr;
-                    if (first_ptr != first_size) {
-                        first_kv = b_tree_data[first_ptr];
-                    }
-                } else if (first_kv.Key == second_kv.Key) {
-                    first_kv.Value |= second_kv.Value;
-                    Components_[0].WriteToFile(first_kv, tmp_file, true);
-                    ++first_ptr;
-                    if (first_ptr != first_size) {
-                        first_kv = b_tree_data[first_ptr];
-                    }
-                    ++second_ptr;
-                    if (second_ptr != second_size) {
-                        Components_[0].ReadFromFile(second_ptr, second_kv, file);
-                    }
-                } else {
-                    MoveComponentPointer(second_ptr, 0, 0, second_kv, second_size, file, tmp_file);
+            } else if (first_kv.Key == second_kv.Key) {
+                first_kv.Value |= second_kv.Value;
+                Components_[0].WriteToFile(first_kv, tmp_file, true);
+                ++first_ptr;
+                if (first_ptr != first_size) {
+                    first_kv = b_tree_data[first_ptr];
                 }
+                ++second_ptr;
+                if (second_ptr != second_size) {
+                    Components_[0].ReadFromFile(second_ptr, second_kv, file);
+                }
+            } else {
+                MoveComponentPointer(second_ptr, 0, 0, second_kv, second_size, file, tmp_file);
             }
-            fclose(file);
-            file = fopen(FileNames_[0].c_str(), "wb");
-
-            size_t file_size = ftell(tmp_file);
-            fseek(tmp_file, 0, SEEK_SET);
-            char buffer[BUFFER_SIZE + 1];
-            for (size_t i = 0; i < file_size / BUFFER_SIZE; ++i) {
-                fread(buffer, sizeof(char), BUFFER_SIZE, tmp_file);
-                fwrite(buffer, sizeof(char), BUFFER_SIZE, file);
-            }
-            fread(buffer, sizeof(char), file_size % BUFFER_SIZE, tmp_file);
-            fwrite(buffer, sizeof(char), file_size % BUFFER_SIZE, file);
+        }
+        fclose(file);
+        file = fopen(FileNames_[0].c_str(), "wb");
+
+        size_t file_size = ftell(tmp_file);
+        fseek(tmp_file, 0, SEEK_SET);
+        char buffer[BUFFER_SIZE + 1];
+        for (size_t i = 0; i < file_size / BUFFER_SIZE; ++i) {
+            fread(buffer, sizeof(char), BUFFER_SIZE, tmp_file);
+            fwrite(buffer, sizeof(char), BUFFER_SIZE, file);
+        }
+        fread(buffer, sizeof(char), file_size % BUFFER_SIZE, tmp_file);
+        fwrite(buffer, sizeof(char), file_size % BUFFER_SIZE, file);
 
-            fclose(file);
-            fclose(tmp_file);
+        fclose(file);
+        fclose(tmp_file);
 
-            tmp_file = fopen(tmp_file_name.c_str(), "wb");
-            fclose(tmp_file);
-            BTree_.Erase();
-            Components_[0].SwapTmp();
-        }
+        tmp_file = fopen(tmp_file_name.c_str(), "wb");
+        fclose(tmp_file);
+        BTree_.Erase();
+        Components_[0].SwapTmp();
 
         size_t cur_component_max_size = ComponentSizeMultiplier_ * ComponentSizeMultiplier_;
         for (size_t i = 0; i < MaxComponents_ - 1; ++i) {
@@ -214,43 +274,6 @@ public:
         }
     }
 
-    void Delete(K key) {
-        BTree_.Delete(key);
-    }
-
-private:
-    void Lemmatize(std::string& word) {
-        std::string result;
-        std::remove_copy_if(
-            word.begin(), word.end(),            
-            std::back_inserter(result),   
-            std::ptr_fun<int, int>(&std::ispunct)  
-        );
-        std::transform(
-            result.begin(), result.end(), result.begin(),
-            [](unsigned char c) { return std::tolower(c); }
-        );
-        stemming::english_stem<> StemEnglish;
-        std::wstring wword(result.begin(), result.end());
-        StemEnglish(wword);
-        word = std::string(wword.begin(), wword.end());
-    }
-
-    std::vector<std::string> ParseDocument(std::string& document_text) {
-        std::vector<std::string> result;
-
-        std::stringstream stream(document_text);
-        std::string word;
-        while (stream >> word) {
-            if (word.size() < 3) {
-                continue;
-            }
-            Lemmatize(word);
-            result.emplace_back(word);
-        }
-        return result;
-    }
-
     void MoveComponentPointer(size_t& pointer, size_t read_index, size_t write_index, KV& kv, size_t max_size, FILE* file, FILE* tmp_file) {
         Components_[write_index].WriteToFile(kv, tmp_file, true);
         ++pointer;
@@ -259,6 +282,17 @@ private:
         }
     }
 
+    // Instrumentation handles of the traced operations, resolved once in the constructor.
+    struct TraceHandles {
+        size_t AddDocument = 0;
+        size_t GetDocumentsByWord = 0;
+        size_t Flush = 0;
+        size_t FinderAnd = 0;
+        size_t FinderOr = 0;
+        size_t FinderWithout = 0;
+        size_t FinderGetDocuments = 0;
+    };
+
     const size_t BUFFER_SIZE = 1024;
 
     size_t MaxComponents_;
@@ -269,6 +303,8 @@ private:
 
     std::vector<std::string> DocumentNames_;
     std::unordered_map<std::string, K> IndexByWord_;
+    std::shared_ptr<Instrumentation> Instrumentation_;
+    TraceHandles Traces_;
 };
 
 class Finder {
@@ -283,6 +319,7 @@ public:
     {}
 
     Finder& And(Finder& finder) {
+        ScopedTrace trace(Index_.Instrumentation_.get(), Index_.Traces_.FinderAnd);
         Bitmap_ &= finder.Bitmap_;
         return *this;
     }
@@ -293,6 +330,7 @@ public:
     }
 
     Finder& Or(Finder& finder) {
+        ScopedTrace trace(Index_.Instrumentation_.get(), Index_.Traces_.FinderOr);
         Bitmap_ |= finder.Bitmap_;
         return *this;
     }
@@ -303,6 +341,7 @@ public:
     }
 
     Finder& Without(Finder& finder) {
+        ScopedTrace trace(Index_.Instrumentation_.get(), Index_.Traces_.FinderWithout);
         Bitmap_ -= finder.Bitmap_;
         return *this;
     }
@@ -313,6 +352,7 @@ public:
     }
 
     std::vector<std::string> GetDocuments() {
+        ScopedTrace trace(Index_.Instrumentation_.get(), Index_.Traces_.FinderGetDocuments);
         std::vector<std::string> result;
         uint32_t* indexes = new uint32_t[Bitmap_.cardinality()];
         Bitmap_.toUint32Array(indexes);
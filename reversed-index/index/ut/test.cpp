@@ -108,6 +108,25 @@ TEST(IndexTest, TestDocument)
     }
 }
 
+TEST(IndexTest, TestInstrumentation)
+{
+    auto instrumentation = std::make_shared<Instrumentation>();
+    Index index(2, 3, 10, instrumentation);
+    index.AddDocument("cat", "i have cats, and dog, and horse");
+    index.AddDocument("dog", "i have Dog. and Horse and Crocodile");
+    {
+        Finder finder(index, "cat");
+        std::vector<std::string> expected = { "cat" };
+        ASSERT_EQ(finder.And("horse").GetDocuments(), expected);
+    }
+
+    auto histograms = instrumentation->GetHistograms();
+    ASSERT_EQ(histograms["add_document"].GetCount(), 2);
+    ASSERT_EQ(histograms["get_documents_by_word"].GetCount(), 2);
+    ASSERT_EQ(histograms["finder.and"].GetCount(), 1);
+    ASSERT_EQ(histograms["finder.get_documents"].GetCount(), 1);
+}
+
 int main(int argc, char** argv)
 {
     ::testing::InitGoogleTest(&argc, argv);